@@ -0,0 +1,141 @@
+/*
+Library:       Behaviours.h
+Purpose:       Arbitration between behaviours by priority: the highest one that
+               wants to act owns the actuators, and can take them at any time
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The program has several behaviours (ie. escape, avoid, wander), numbered by
+priority: 0 is the highest. Behaviour_Arbitrate() asks them, from the highest,
+if they want to act now (Behaviour_Wants()), and runs the first one that does
+(Behaviour_Run()). The ones below it are not asked. When the owner changes,
+the old one is told first (Behaviour_Stop()) and the new one runs with First
+true, so it can start its manoeuvre. A manoeuvre is not a sequence of waits:
+it goes on as long as its behaviour keeps the actuators, and it is left at the
+moment a higher behaviour wants them.
+
+Each behaviour keeps its own state between runs. Behaviour_Wants() can use
+Behaviour_Owner to want to go on with looser conditions than to start
+(hysteresis), so two behaviours do not take the actuators in turns.
+
+Call Behaviour_Arbitrate() after every new reading of the sensors, and also
+every few ticks, so the behaviours that wait for a time are served too.
+
+Counters (never cleared but by Behaviour_Init()):
+Behaviour_Wins[b]     Times behaviour b has taken the actuators
+Behaviour_Ticks[b]    Ticks (13.1ms) it has owned them
+Behaviour_Preempts    Times the owner lost them to a higher behaviour
+
+FUNCTIONS:
+Behaviour_Init(): Nobody owns the actuators. Counters to 0
+Behaviour_Arbitrate(): Find the behaviour that owns the actuators now and run
+it. Returns it, or BEHAVIOUR_NONE if none wants to act
+Behaviour_Release(): The owner stops (ie. before sleeping). The next
+Behaviour_Arbitrate() starts again from nobody
+Behaviour_Owner: The behaviour that owns the actuators (or BEHAVIOUR_NONE)
+
+Example:
+
+   #define  BehavioursNumber  2        //Before including this library
+   #define  BEH_AVOID         0
+   #define  BEH_WANDER        1
+   ...
+   int1 Behaviour_Wants (byte B)
+   {
+      if (B==BEH_AVOID) return (Distance<50);
+      return (TRUE);
+   }
+
+   void Behaviour_Run (byte B, int1 First)
+   {
+      if (B==BEH_AVOID) SetWheels (FORWARD, BACKWARD);
+      else SetWheels (FORWARD, FORWARD);
+   }
+
+   void Behaviour_Stop (byte B) {}
+
+CONFIGURATION:
+Define BehavioursNumber before including the library. Include Timers.h before
+this library. The program must define these functions (after including this
+library):
+int1 Behaviour_Wants(byte B): true if behaviour B wants to act now
+void Behaviour_Run(byte B, int1 First): act. First is true when B has just
+     taken the actuators
+void Behaviour_Stop(byte B): B has lost the actuators. The new owner sets
+     them, so it should only leave what the others do not use
+*/
+
+#ifndef BehavioursNumber
+#define  BehavioursNumber  4        //Number of behaviours
+#endif
+
+#define  BEHAVIOUR_NONE 0xFF        //No behaviour wants to act
+
+int1 Behaviour_Wants(byte B);
+void Behaviour_Run(byte B, int1 First);
+void Behaviour_Stop(byte B);
+
+byte  Behaviour_Owner=BEHAVIOUR_NONE;      //Owner of the actuators
+int16 Behaviour_Last;                      //Tick of the last arbitration
+int16 Behaviour_Wins[BehavioursNumber];    //Times each one took them
+int32 Behaviour_Ticks[BehavioursNumber];   //Ticks each one has had them
+int16 Behaviour_Preempts=0;                //Owners taken over by higher ones
+
+
+void Behaviour_Init()
+//Nobody owns the actuators. Counters to 0
+{
+   byte B;
+
+   Behaviour_Owner=BEHAVIOUR_NONE;
+   Behaviour_Preempts=0;
+   for(B=0;B<BehavioursNumber;B++) {
+      Behaviour_Wins[B]=0;
+      Behaviour_Ticks[B]=0;
+   }
+}
+
+void Behaviour_Count()
+//Add the ticks since the last arbitration to the owner
+{
+   int16 Now;
+
+   Now=Timer_Now();
+   if (Behaviour_Owner!=BEHAVIOUR_NONE)
+      Behaviour_Ticks[Behaviour_Owner]+=(int16)(Now-Behaviour_Last);
+   Behaviour_Last=Now;
+}
+
+byte Behaviour_Arbitrate()
+//Give the actuators to the highest behaviour that wants them, and run it
+{
+   byte B;
+
+   Behaviour_Count();
+   for(B=0;B<BehavioursNumber;B++)
+      if (Behaviour_Wants(B)) break;
+   if (B==BehavioursNumber) B=BEHAVIOUR_NONE;
+   if (B==Behaviour_Owner) {
+      if (B!=BEHAVIOUR_NONE) Behaviour_Run(B, FALSE);
+      return (B);
+   }
+   if (Behaviour_Owner!=BEHAVIOUR_NONE) {
+      if (B<Behaviour_Owner) Behaviour_Preempts++;   //It still wanted them
+      Behaviour_Stop(Behaviour_Owner);
+   }
+   Behaviour_Owner=B;
+   if (B==BEHAVIOUR_NONE) return (B);
+   Behaviour_Wins[B]++;
+   Behaviour_Run(B, TRUE);
+   return (B);
+}
+
+void Behaviour_Release()
+//The owner stops. Nobody owns the actuators until the next arbitration
+{
+   Behaviour_Count();
+   if (Behaviour_Owner==BEHAVIOUR_NONE) return;
+   Behaviour_Stop(Behaviour_Owner);
+   Behaviour_Owner=BEHAVIOUR_NONE;
+}
@@ -0,0 +1,120 @@
+/*
+Library:       Config.h
+Purpose:       Configuration of the program (addresses, motor map, tuning
+               values) kept in the data EEPROM, with defaults in program memory
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The program gives the layout: ConfigSize bytes, the meaning of each one and
+their default values (ConfigDefault[], in program memory). Config_Init() reads
+the block of the EEPROM into Config[], or takes the defaults if the block is
+not good, and the program uses Config[] from then on. Nothing has to be
+compiled again to change a value: it is written in the EEPROM (ie. from the
+ZX81) and used from the next power on.
+
+Block in the data EEPROM, from Config_EEBase:
+   Size        ConfigSize. A block of another size (another version of the
+               program) is not used
+   Data[ConfigSize]
+   Check       Complement of the sum of Size and Data (8 bits)
+An erased EEPROM (all 0xFF) or a block half written fail the check.
+
+There are two copies of the block: the first one at Config_EEBase and the
+second one at Config_EECopy. Config_Save() writes the second copy and then the
+first one, each with its check made bad while the data is written, so if the
+power is lost while saving one copy the other one is whole: Config_Init()
+takes the first copy, or the second one if the first is not good, and gets
+either all the old configuration or all the new one, never half of each. The
+defaults are only used if both copies are bad.
+
+FUNCTIONS:
+Config_Init(): Config[] from the EEPROM, or from ConfigDefault[] if neither
+copy is good. Returns true if one was good
+Config_Save(): Write Config[] to both copies in the EEPROM. Only the bytes that
+have changed are written (4ms each)
+Config_Read(int16 Base): Config[] from the copy at Base. True if it is good
+Config_Default(): Config[] back to the defaults (not saved)
+Config[n]: Value n of the configuration
+
+Example:
+
+   #define  ConfigSize       2         //Before including this library
+   #define  CFG_SONAR        0
+   #define  CFG_SPEED        1
+   const byte ConfigDefault[ConfigSize]={0xE0, 255};
+   ...
+   Config_Init();
+   SRF02_Add(Config[CFG_SONAR]);
+
+CONFIGURATION:
+Include EEPROM.h before this library. Define ConfigSize and ConfigDefault[]
+before including it, and Config_EEBase and Config_EECopy if the copies do not
+go at 0x010 and 0x040. Each copy takes ConfigSize+2 bytes of the data EEPROM
+(up to 48 with the default addresses).
+*/
+
+#ifndef Config_EEBase
+#define  Config_EEBase 0x010        //Block in the data EEPROM
+#endif
+#ifndef Config_EECopy
+#define  Config_EECopy 0x040        //Second copy of the block
+#endif
+
+byte Config[ConfigSize];            //Configuration in use
+
+
+byte Config_Check()
+//Check byte of Config[]
+{
+   byte n, Sum;
+
+   Sum=ConfigSize;
+   for(n=0;n<ConfigSize;n++) Sum+=Config[n];
+   return (~Sum);
+}
+
+void Config_Default()
+//Defaults of the program
+{
+   byte n;
+
+   for(n=0;n<ConfigSize;n++) Config[n]=ConfigDefault[n];
+}
+
+int1 Config_Read(int16 Base)
+//Configuration from a copy in the EEPROM. True if it is good
+{
+   byte n;
+
+   if (EE_Read(Base)!=ConfigSize) return (FALSE);
+   for(n=0;n<ConfigSize;n++) Config[n]=EE_Read(Base+1+n);
+   return (EE_Read(Base+1+ConfigSize)==Config_Check());
+}
+
+int1 Config_Init()
+//Configuration from the EEPROM. True if a copy was good
+{
+   if (Config_Read(Config_EEBase)) return (TRUE);
+   if (Config_Read(Config_EECopy)) return (TRUE);
+   Config_Default();
+   return (FALSE);
+}
+
+void Config_SaveCopy(int16 Base)
+//Config[] to one copy
+{
+   byte n;
+
+   EE_Write(Base+1+ConfigSize, ~Config_Check());   //Bad while writing
+   EE_Write(Base, ConfigSize);
+   for(n=0;n<ConfigSize;n++) EE_Write(Base+1+n, Config[n]);
+   EE_Write(Base+1+ConfigSize, Config_Check());
+}
+
+void Config_Save()
+//Config[] to the EEPROM, the second copy first
+{
+   Config_SaveCopy(Config_EECopy);
+   Config_SaveCopy(Config_EEBase);
+}
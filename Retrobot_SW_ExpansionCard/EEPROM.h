@@ -0,0 +1,143 @@
+/*
+Library:       EEPROM.h
+Purpose:       Writes of the data EEPROM that do not stop the program
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+A byte of the data EEPROM takes 4ms to write, and write_eeprom() of CCS waits
+for it: a few hundred bytes stop the main loop for more than a second (no
+sonar, no ZX81). EE_Start() only starts the write with the registers of the
+PIC and returns; the program goes on and starts the next one when EE_Busy() is
+false (ie. a step of a task each pass of the main loop).
+
+While a write is in progress the EEPROM cannot be read or written, so all the
+libraries use EE_Read() and EE_Write(), that wait for it to end first (4ms at
+most): the blocking writes can be mixed with the writes in the background.
+
+A few bytes (ie. the calibration of the map) can be left in a queue with
+EE_Put(): EE_Service(), called each pass of the main loop, starts them one
+after the other.
+
+FUNCTIONS:
+EE_Start(int16 Address, byte Data): Start a write and return at once. False
+(and nothing is written) if a write is in progress
+EE_Busy(): True while a write is in progress
+EE_Read(int16 Address): Read a byte (waits for a write in progress)
+EE_Write(int16 Address, byte Data): Write a byte if it is not already there,
+and wait for it to end, as write_eeprom()
+EE_Put(int16 Address, byte Data): Queue a write. False (nothing queued) if the
+queue is full
+EE_Room(): Writes that still fit in the queue
+EE_Service(): Start the next write of the queue if the EEPROM is free. Call
+it each pass of the main loop
+EE_Pending(): True while there are writes in the queue or in progress
+EE_Writes: Bytes written since power on
+
+Example:
+
+   if (!EE_Busy() && (n<Len)) {        //A byte each pass
+      if (EE_Read(Base+n)!=Buffer[n]) EE_Start(Base+n, Buffer[n]);
+      n++;
+   }
+
+CONFIGURATION:
+Include it before the libraries that use the data EEPROM (Config.h, Map.h,
+MotionScript.h). The interrupts are disabled for the 5 instructions of the
+sequence that starts a write, as the PIC asks. EE_QueueSize (a power of 2)
+can be defined before including it.
+*/
+
+#ifdef __PCH__
+#byte EE_CON1      = 0xFA6
+#byte EE_CON2      = 0xFA7
+#byte EE_DATA      = 0xFA8
+#byte EE_ADR       = 0xFA9
+#byte EE_ADRH      = 0xFAA
+#bit  EE_WR        = 0xFA6.1           //Write in progress
+#bit  EE_WREN      = 0xFA6.2           //Writes allowed
+#endif
+
+#ifndef EE_QueueSize
+#define  EE_QueueSize      8           //Writes waiting (power of 2)
+#endif
+
+int16 EE_Writes=0;                     //Bytes written
+int16 EE_QAddress[EE_QueueSize];       //Queue of writes
+byte  EE_QData[EE_QueueSize];
+byte  EE_QIn=0, EE_QOut=0;
+
+
+int1 EE_Busy()
+//True while a write is in progress
+{
+   return (EE_WR);
+}
+
+int1 EE_Start(int16 Address, byte Data)
+//Start a write. False if a write is in progress
+{
+   if (EE_WR) return (FALSE);
+   EE_ADRH=make8(Address,1);
+   EE_ADR=make8(Address,0);
+   EE_DATA=Data;
+   EE_CON1=0x04;                       //Data EEPROM, WREN
+   disable_interrupts(GLOBAL);
+   EE_CON2=0x55;                       //Sequence of the PIC
+   EE_CON2=0xAA;
+   EE_WR=1;
+   enable_interrupts(GLOBAL);
+   EE_WREN=0;
+   EE_Writes++;
+   return (TRUE);
+}
+
+byte EE_Read(int16 Address)
+//Byte of the EEPROM, once the write in progress has ended
+{
+   while (EE_WR) delay_cycles(1);
+   return (read_eeprom(Address));
+}
+
+void EE_Write(int16 Address, byte Data)
+//Write a byte if it changes, waiting for the end
+{
+   if (EE_Read(Address)==Data) return;
+   write_eeprom(Address, Data);
+   EE_Writes++;
+}
+
+byte EE_Room()
+//Writes that still fit in the queue
+{
+   return ((EE_QOut-EE_QIn-1)&(EE_QueueSize-1));
+}
+
+int1 EE_Put(int16 Address, byte Data)
+//Queue a write. False if the queue is full
+{
+   if (EE_Room()==0) return (FALSE);
+   EE_QAddress[EE_QIn]=Address;
+   EE_QData[EE_QIn]=Data;
+   EE_QIn=(EE_QIn+1)&(EE_QueueSize-1);
+   return (TRUE);
+}
+
+void EE_Service()
+//Start the next write of the queue if the EEPROM is free
+{
+   int16 Address;
+   byte Data;
+
+   if ((EE_QOut==EE_QIn)||EE_WR) return;
+   Address=EE_QAddress[EE_QOut];
+   Data=EE_QData[EE_QOut];
+   EE_QOut=(EE_QOut+1)&(EE_QueueSize-1);
+   if (read_eeprom(Address)!=Data) EE_Start(Address, Data);
+}
+
+int1 EE_Pending()
+//True while there are writes queued or in progress
+{
+   return ((EE_QOut!=EE_QIn)||EE_WR);
+}
@@ -0,0 +1,175 @@
+/*
+Library:       Filter.h
+Purpose:       Fixed point filters between the sensor drivers and the control
+               logic: outlier rejection, median, smoothing and the speed the
+               value changes at
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+A single bad sample (ie. an echo of the sonar off the floor, or a ranging
+without echo) must not make the program act. Each channel (one sensor) takes
+its samples with Filter_Put() with the time they were taken, and goes through:
+
+1. Outlier: a sample farther than FilterGate from the median of the channel
+   is rejected (Filter_Rejected[] counts it). FilterConfirm samples in a row
+   on the same side of the median are a real jump (ie. the robot has turned
+   to a wall): the channel starts again from the new value.
+2. Median of the last FilterMedian samples accepted (Filter_Value[]). It
+   takes out a sample on its own, and follows a real change one sample
+   later. This is the value to act on.
+3. Smoothing of the median: Filter_Smooth[] moves 1/2^FilterShift of the way
+   to it with each sample, in 1/16 of the units of the samples.
+4. Speed: difference of two smoothed values over the time between them,
+   smoothed again (1/2^FilterSpeedShift). Filter_Speed[] is in units per
+   second, positive when the value goes down (an obstacle getting closer: the
+   closing speed).
+
+Filter_Predict() gives the value expected some ms after the last sample with
+that speed, so the program can act on where the obstacle will be when the
+wheels react, not on where it was when it was measured.
+
+All the arithmetic is integer: 16 bit values, 32 bit for the smoothed ones and
+the speed. The time is Perf_Now() (Timer3 counts of 0.2us).
+
+FUNCTIONS:
+Filter_Init(): All the channels empty and their counters cleared. Call it
+before the first sample
+Filter_Reset(byte C): The channel starts again with its next sample (ie.
+after sleeping)
+Filter_Put(byte C, sint16 Value, int32 At): A sample taken at At (Perf_Now()).
+Returns true if it was accepted, false if it was an outlier
+Filter_Predict(byte C, int16 Ms): Value Ms ms after the last sample, at the
+speed of the channel
+Filter_Value[c]: Median (the value of the channel)
+Filter_Smooth[c]: Smoothed value x16
+Filter_Speed[c]: Units per second the value goes down
+Filter_Accepted[c], Filter_Rejected[c]: Samples of the channel
+
+Example:
+
+   if (Raw==0) Raw=600;                //No echo: nothing in range
+   Filter_Put(0, Raw, Perf_Now());
+   if (Filter_Predict(0, 200)<50) Brake();   //Where it will be in 0.2s
+
+CONFIGURATION:
+Include Perf.h before this library. FilterChannels (default 1), FilterMedian
+(3 or 5), FilterShift, FilterGate and FilterConfirm can be defined before
+including it.
+*/
+
+#ifndef FilterChannels
+#define  FilterChannels    1        //Sensors filtered
+#endif
+#ifndef FilterMedian
+#define  FilterMedian      3        //Samples of the median (odd, 5 at most)
+#endif
+#ifndef FilterShift
+#define  FilterShift       2        //Smoothing: 1/4 of the way each sample
+#endif
+#ifndef FilterGate
+#define  FilterGate       40        //Farther from the median: outlier
+#endif
+#ifndef FilterConfirm
+#define  FilterConfirm     3        //Outliers in a row that are a real jump
+#endif
+#define  FilterSpeedShift  1        //Smoothing of the speed: 1/2
+#define  FilterPerSecond 4883       //1/16 unit per 64 Timer3 counts (12.8us)
+                                    //in units per second
+
+sint16 Filter_Window[FilterChannels][FilterMedian];   //Last samples accepted
+byte   Filter_Count[FilterChannels];    //Samples in the window
+byte   Filter_Next[FilterChannels];     //Place of the next sample
+byte   Filter_Outliers[FilterChannels]; //Outliers in a row
+sint8  Filter_Side[FilterChannels];     //Side of the median they were on
+sint16 Filter_Value[FilterChannels];    //Median
+sint32 Filter_Smooth[FilterChannels];   //Smoothed median x16
+sint16 Filter_Speed[FilterChannels];    //Units per second, positive closing
+int32  Filter_At[FilterChannels];       //Perf_Now() of the last sample
+int16  Filter_Accepted[FilterChannels];
+int16  Filter_Rejected[FilterChannels];
+
+
+void Filter_Reset(byte C)
+//Start again with the next sample
+{
+   Filter_Count[C]=0;
+   Filter_Next[C]=0;
+   Filter_Outliers[C]=0;
+   Filter_Speed[C]=0;
+}
+
+void Filter_Init()
+//All the channels empty, counters cleared
+{
+   byte C;
+
+   for(C=0;C<FilterChannels;C++) {
+      Filter_Reset(C);
+      Filter_Accepted[C]=0;
+      Filter_Rejected[C]=0;
+   }
+}
+
+sint16 Filter_MedianOf(byte C)
+//Median of the samples in the window
+{
+   sint16 Sorted[FilterMedian], Value;
+   byte n, k;
+
+   for(n=0;n<Filter_Count[C];n++) {          //Insertion sort
+      Value=Filter_Window[C][n];
+      for(k=n;(k>0)&&(Sorted[k-1]>Value);k--) Sorted[k]=Sorted[k-1];
+      Sorted[k]=Value;
+   }
+   return (Sorted[(Filter_Count[C]-1)/2]);
+}
+
+int1 Filter_Put(byte C, sint16 Value, int32 At)
+//A sample. False if it is an outlier
+{
+   sint32 Old, Speed;
+   int32 Dt;
+   sint8 Side;
+
+   if (Filter_Count[C]!=0) {
+      Side=(Value>Filter_Value[C]) ? 1 : -1;
+      if ((Value>Filter_Value[C]+FilterGate)||
+          (Value<Filter_Value[C]-FilterGate)) {
+         if ((Filter_Outliers[C]==0)||(Filter_Side[C]!=Side)) {
+            Filter_Outliers[C]=0;
+            Filter_Side[C]=Side;
+         }
+         if (++Filter_Outliers[C]<FilterConfirm) {
+            Filter_Rejected[C]++;
+            return (FALSE);
+         }
+         Filter_Reset(C);                     //Confirmed: a real jump
+      }
+      else Filter_Outliers[C]=0;
+   }
+   Filter_Accepted[C]++;
+   Filter_Window[C][Filter_Next[C]]=Value;
+   if (++Filter_Next[C]==FilterMedian) Filter_Next[C]=0;
+   if (Filter_Count[C]<FilterMedian) Filter_Count[C]++;
+   Filter_Value[C]=Filter_MedianOf(C);
+   if (Filter_Count[C]==1) {                  //First one
+      Filter_Smooth[C]=(sint32)Value*16;
+      Filter_At[C]=At;
+      return (TRUE);
+   }
+   Old=Filter_Smooth[C];
+   Filter_Smooth[C]+=((sint32)Filter_Value[C]*16-Old)>>FilterShift;
+   Dt=(At-Filter_At[C])>>6;
+   Filter_At[C]=At;
+   if (Dt==0) return (TRUE);
+   Speed=((Old-Filter_Smooth[C])*FilterPerSecond)/(sint32)Dt;
+   Filter_Speed[C]+=(sint16)((Speed-Filter_Speed[C])>>FilterSpeedShift);
+   return (TRUE);
+}
+
+sint16 Filter_Predict(byte C, int16 Ms)
+//Value expected Ms ms after the last sample
+{
+   return (Filter_Value[C]-(sint16)(((sint32)Filter_Speed[C]*Ms)/1000));
+}
@@ -0,0 +1,676 @@
+/*
+Library:       I2CMaster.h
+Purpose:       Interrupt driven I2C master (MSSP module) with a queue of
+               transactions
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The drivers of the I2C devices do not control the bus themselves. They fill a
+transaction (address, bytes to write, number of bytes to read) in a slot of a
+queue and submit it. The MSSP interrupt does all the work on the bus (start,
+address, data, acknowledge, stop) and goes on with the next transaction of the
+queue as soon as one is finished, so the program can go on working while the
+data is being shifted.
+
+A transaction is: Start, Address+W, WriteData[0..WriteLen-1], then if ReadLen>0
+Repeated Start, Address+R, ReadData[0..ReadLen-1] (last one with NAK), and Stop.
+If WriteLen is 0, the transaction starts directly with Address+R.
+
+FUNCTIONS:
+I2C_Init(): Configure the MSSP module as I2C master at 100KHz and its interrupt
+I2C_New(byte Address, byte WriteLen, byte ReadLen): Reserve a slot of the queue
+for a transaction and return it. If the queue is full, wait until there is a
+free slot. Fill I2CQueue[Slot].WriteData[] after calling it.
+I2C_Submit(byte Slot): Put the transaction in the queue to be sent
+I2C_Busy(byte Slot): True while the transaction is waiting or on the bus
+I2C_Wait(byte Slot): Wait for the transaction to finish and return its status
+(I2C_DONE, I2C_NAK or I2C_TIMEOUT)
+I2C_Free(byte Slot): Give back the slot once the read data has been used
+I2C_Idle(): True when there is nothing left to do on the bus
+I2C_Check(): Call it often (ie. in the main loop). If the transaction on the
+bus has not finished in time, the bus is recovered. Returns true then
+I2C_Errors(byte Address): Transactions of a device that have failed (NAK or
+timeout)
+I2C_Probe(byte Address): True if a device answers at that address (it reads
+one byte). A NAK is not counted as an error of the device. It waits (0.2ms)
+I2C_Scan(byte First, byte Last): First address from First to Last (step 2)
+where a device answers, 0 if none
+I2C_TraceStart(): Empty the trace and start recording (only with
+I2C_TraceSize)
+I2C_TraceTake(byte *Data, byte Max): Move the oldest whole transactions of the
+trace, up to Max bytes, to Data. Returns the bytes moved (0: trace empty)
+
+Options of a transaction (I2CQueue[Slot].Options):
+I2C_AUTOFREE: The slot is freed when the transaction finishes. Use it for
+writes nobody waits for.
+I2C_SPLIT: Stop and Start between the write and the read, instead of a
+Repeated Start (for devices that do not accept it)
+I2C_POLL: The device is polled (ACK polling). A NAK means it is busy, so it
+is not counted as an error of the device
+
+I2CQueue[Slot].Gap: Microseconds (max 100) the device needs after a Stop of
+this transaction before it is addressed again (and between the write and the
+read of a split). Only the next transaction to the same device waits (Timer0):
+transactions to other devices go on during the gap, and if the time has passed
+already, nobody waits. The gap is measured with Timer3. Only the gap of the
+last transaction is kept, as a transaction to another device takes longer than
+100us anyway.
+
+BUS FAULTS:
+A device that holds SCL or SDA low stops the MSSP module, and its interrupt
+never comes again. Each transaction must finish before I2C_TimeoutTicks ticks
+of Timers.h (13 to 26ms, when a transaction takes less than 1ms). If it does
+not, I2C_Check() finishes it with I2C_TIMEOUT and clears the bus: the MSSP is
+turned off, up to 9 clocks are given on SCL until the device releases SDA, a
+Stop is sent by hand and the MSSP is configured again. Then the queue goes on
+with the next transaction. It takes less than 1ms, with the interrupts off
+from the decision to the end, so the transaction cleared is the one that was
+late. A gap (Timer0) that has not ended by the same deadline is ended by
+I2C_Check() too, without touching the bus. I2C_Wait() and I2C_New() call
+I2C_Check() while they wait, so they never wait forever.
+Failed transactions are counted for each device (I2C_Errors()), and the bus
+clears in I2C_Recoveries. The drivers decide what to do with a device that
+fails (ie. SRF02.h counts the rangings lost).
+
+TRACE:
+If the program defines I2C_TraceSize, each transaction is written when it
+finishes in a ring of I2C_TraceSize bytes (a power of 2) while I2C_Tracing is
+true. When the ring is full the oldest transactions are dropped (I2C_TraceLost)
+so the trace always keeps the last ones. A transaction takes 6 bytes and its
+data:
+   Time(4)     Perf_Now() at the end (TimerTicks, Timer3), high byte first
+   Address     Address of the device (write)
+   Info        Bits 7-5: WriteLen, 4-3: ReadLen, 2: I2C_POLL,
+               1-0: result (0 I2C_DONE, 1 I2C_NAK, 2 I2C_TIMEOUT)
+   WriteData[WriteLen], then ReadData[ReadLen] only if the result is I2C_DONE
+I2C_TraceTake() gives whole transactions, oldest first, so a dump is just
+them one after the other. I2CTrace.cpp of Retrobot_SW_Host decodes a dump and
+replays it against the models of the chips.
+
+Example:
+
+   //Read 2 bytes of register 0 of the device 0x9E
+   Slot=I2C_New(0x9E, 1, 2);
+   I2CQueue[Slot].WriteData[0]=0x00;
+   I2C_Submit(Slot);
+   ...                              //Do other things
+   if (I2C_Wait(Slot)==I2C_DONE) Data=I2CQueue[Slot].ReadData[0];
+   I2C_Free(Slot);
+
+CONFIGURATION:
+Call I2C_Init() and enable global interrupts before using the drivers. The
+MSSP module uses RC3 (SCL) and RC4 (SDA). Timer0 is used for the gaps, and
+Timer3 (0.2us per count, see Perf.h) to measure them.
+Include Timers.h and Perf.h before this library: transactions, bytes and the
+time spent waiting for the queue are counted there.
+Do not use the CCS i2c_xxx() functions (#use i2c) together with this library.
+Define I2C_TraceSize before including it to have the trace.
+*/
+
+//MSSP registers
+#ifdef __PCH__
+#byte SSPBUF   = 0xFC9
+#byte SSPADD   = 0xFC8
+#byte SSPSTAT  = 0xFC7
+#byte SSPCON1  = 0xFC6
+#byte SSPCON2  = 0xFC5
+#bit  SEN      = SSPCON2.0            //Start
+#bit  RSEN     = SSPCON2.1            //Repeated Start
+#bit  PEN      = SSPCON2.2            //Stop
+#bit  RCEN     = SSPCON2.3            //Receive a byte
+#bit  ACKEN    = SSPCON2.4            //Send acknowledge
+#bit  ACKDT    = SSPCON2.5            //Acknowledge to send (1:NAK)
+#bit  ACKSTAT  = SSPCON2.6            //Acknowledge received (1:NAK)
+#bit  TRISC3   = 0xF94.3              //SCL pin direction
+#bit  TRISC4   = 0xF94.4              //SDA pin direction
+#bit  LATC3    = 0xF8B.3              //SCL output latch (bus clear)
+#bit  LATC4    = 0xF8B.4              //SDA output latch (bus clear)
+#bit  RC4      = 0xF82.4              //SDA level
+#endif
+
+#define  I2C_QueueSize     8        //Transactions in the queue
+#define  I2C_MaxWrite      4        //Max bytes written by a transaction
+#define  I2C_MaxRead       2        //Max bytes read by a transaction
+#define  I2C_NONE       0xFF        //No slot
+#define  I2C_TimeoutTicks  2        //Ticks for a transaction to finish
+#define  I2C_ErrDevices    4        //Devices with errors counted
+#define  I2C_ProbeGap    100        //us after a probe: any device of the card
+
+//Status of a transaction
+#define  I2C_FREE          0        //Slot not used
+#define  I2C_RESERVED      1        //Being filled by the driver
+#define  I2C_QUEUED        2        //Waiting for the bus
+#define  I2C_BUSY          3        //On the bus
+#define  I2C_DONE          4        //Finished OK. Read data available
+#define  I2C_NAK           5        //Finished. The device did not acknowledge
+#define  I2C_TIMEOUT       6        //Finished. The bus was stuck and cleared
+
+//Options of a transaction
+#define  I2C_AUTOFREE   0x01        //Free the slot when finished
+#define  I2C_SPLIT      0x02        //Stop+Start instead of Repeated Start
+#define  I2C_POLL       0x04        //NAK means busy, not an error
+
+//Phases of the engine (I2C_Phase)
+#define  I2C_PH_IDLE       0        //Nothing to do
+#define  I2C_PH_START      1        //Start sent
+#define  I2C_PH_WRITE      2        //Address+W or data byte sent
+#define  I2C_PH_SPLIT      3        //Stop between write and read sent
+#define  I2C_PH_RESTART    4        //Repeated Start (or Start) for read sent
+#define  I2C_PH_ADDR_R     5        //Address+R sent
+#define  I2C_PH_READ       6        //Receiving a byte
+#define  I2C_PH_ACK        7        //Acknowledge of received byte sent
+#define  I2C_PH_STOP       8        //Stop sent
+#define  I2C_PH_GAP        9        //Gap of the device of next transaction
+#define  I2C_PH_GAP_READ  10        //Bus free time before the read of a split
+
+typedef struct {
+   byte  Address;                   //I2C address of the device (write)
+   byte  Options;                   //I2C_AUTOFREE, I2C_SPLIT, I2C_POLL
+   byte  Gap;                       //us the device needs after a Stop
+   byte  WriteLen;                  //Bytes to write
+   byte  WriteData[I2C_MaxWrite];   //Bytes to write
+   byte  ReadLen;                   //Bytes to read
+   byte  ReadData[I2C_MaxRead];     //Bytes read
+   byte  Status;                    //I2C_FREE ... I2C_TIMEOUT
+} I2CTransaction;
+
+I2CTransaction I2CQueue[I2C_QueueSize];   //Queue of transactions
+byte  I2C_Head=0;                   //Transaction on the bus or next to go
+byte  I2C_Tail=0;                   //Next slot to be reserved
+byte  I2C_Phase=I2C_PH_IDLE;        //Phase of the transaction on the bus
+byte  I2C_Index;                    //Byte being written or read
+byte  I2C_Result;                   //Status the transaction will finish with
+int16 I2C_Deadline;                 //Tick the transaction on the bus must end
+byte  I2C_ErrAddress[I2C_ErrDevices];  //Devices with errors
+int16 I2C_ErrCount[I2C_ErrDevices];    //Failed transactions (0: not used)
+int16 I2C_Recoveries=0;             //Times the bus has been cleared
+byte  I2C_GapAddress;               //Device of the last gap
+byte  I2C_GapUs=0;                  //Gap it needs (0: none)
+int16 I2C_GapFrom;                  //Timer3 at its Stop
+int16 I2C_GapTick;                  //Tick of its Stop
+
+#ifdef I2C_TraceSize
+byte  I2C_Trace[I2C_TraceSize];     //Ring of finished transactions
+int16 I2C_TraceIn=0;                //Next byte written
+int16 I2C_TraceOut=0;               //First byte of the oldest transaction
+int16 I2C_TraceUsed=0;              //Bytes in the ring
+int16 I2C_TraceLost=0;              //Transactions dropped (ring full)
+int1  I2C_Tracing=FALSE;            //Recording
+#endif
+
+#define  I2C_T   I2CQueue[I2C_Head] //Transaction on the bus
+
+
+void I2C_Setup()
+//MSSP as I2C master at 100KHz (20MHz clock)
+{
+   TRISC3=1;                        //MSSP needs SCL and SDA as inputs
+   TRISC4=1;
+   SSPSTAT=0x80;                    //Slew rate control off (100KHz)
+   SSPADD=49;                       //20MHz/(4*(49+1))=100KHz
+   SSPCON1=0x28;                    //MSSP on, I2C master mode
+   SSPCON2=0x00;
+}
+
+void I2C_Init()
+//MSSP as I2C master at 100KHz (20MHz clock) with interrupts
+{
+   byte Slot;
+
+   for(Slot=0;Slot<I2C_QueueSize;Slot++)
+      I2CQueue[Slot].Status=I2C_FREE;
+   for(Slot=0;Slot<I2C_ErrDevices;Slot++) {
+      I2C_ErrAddress[Slot]=0;
+      I2C_ErrCount[Slot]=0;
+   }
+   I2C_Setup();
+   setup_timer_0(RTCC_INTERNAL|RTCC_DIV_2|RTCC_8_BIT);  //0.4us per count
+   clear_interrupt(INT_SSP);
+   enable_interrupts(INT_SSP);
+}
+
+byte I2C_GapLeft(byte Address)
+//us left of the gap the device needs since its last Stop
+{
+   int16 Elapsed, Needed;
+
+   if (I2C_GapUs==0) return (0);
+   Needed=(int16)I2C_GapUs*5;                   //Timer3 counts
+   Elapsed=get_timer3()-I2C_GapFrom;
+   if ((TimerTicks-I2C_GapTick>1)||(Elapsed>=Needed)) {
+      I2C_GapUs=0;                              //Gap over
+      return (0);
+   }
+   if (Address!=I2C_GapAddress) return (0);
+   return ((Needed-Elapsed+4)/5);
+}
+
+void I2C_Gap(byte Gap)
+//Timer0 interrupt after some us (100 at most)
+{
+   if (Gap>100) Gap=100;
+   set_timer0(256-(((int16)Gap*5)>>1));   //0.4us per count
+   clear_interrupt(INT_TIMER0);
+   enable_interrupts(INT_TIMER0);
+}
+
+void I2C_Begin()
+//Start the transaction at the head of the queue, if there is one and its
+//device is ready
+{
+   byte Gap;
+
+   if (I2C_T.Status!=I2C_QUEUED) {
+      I2C_Phase=I2C_PH_IDLE;
+      return;
+   }
+   Gap=I2C_GapLeft(I2C_T.Address);
+   if (Gap!=0) {                                //Device not ready yet
+      I2C_Deadline=TimerTicks+I2C_TimeoutTicks;
+      I2C_Phase=I2C_PH_GAP;
+      I2C_Gap(Gap);
+      return;
+   }
+   I2C_T.Status=I2C_BUSY;
+   I2C_Result=I2C_DONE;
+   I2C_Deadline=TimerTicks+I2C_TimeoutTicks;   //Interrupts are off here
+   I2C_Phase=I2C_PH_START;
+   SEN=1;
+}
+
+void I2C_Resume()
+//End of the bus free time
+{
+   if (I2C_Phase==I2C_PH_GAP_READ) {
+      I2C_Phase=I2C_PH_RESTART;
+      SEN=1;
+   }
+   else I2C_Begin();
+}
+
+void I2C_Hold(byte Gap, byte Next)
+//Keep the bus free some us (Timer0), then go on with the phase Next
+{
+   if (Gap==0) {
+      I2C_Phase=Next;
+      I2C_Resume();
+      return;
+   }
+   I2C_Phase=Next;
+   I2C_Gap(Gap);
+}
+
+void I2C_Stop(byte Result)
+//Finish the transaction on the bus with a Stop
+{
+   I2C_Result=Result;
+   I2C_Phase=I2C_PH_STOP;
+   PEN=1;
+}
+
+void I2C_Error(byte Address)
+//Count a failed transaction of a device
+{
+   byte n;
+
+   for(n=0;n<I2C_ErrDevices;n++) {
+      if (I2C_ErrCount[n]==0) I2C_ErrAddress[n]=Address;     //New device
+      if (I2C_ErrAddress[n]==Address) {
+         if (I2C_ErrCount[n]!=0xFFFF) I2C_ErrCount[n]++;
+         return;
+      }
+   }
+}
+
+#ifdef I2C_TraceSize
+byte I2C_TraceLength(byte Info)
+//Bytes of a transaction in the trace
+{
+   byte Len;
+
+   Len=6+(Info>>5);
+   if ((Info & 0x03)==0) Len+=(Info>>3)&0x03;   //Read data if I2C_DONE
+   return (Len);
+}
+
+void I2C_TracePut(byte Data)
+//Add a byte to the trace
+{
+   I2C_Trace[I2C_TraceIn]=Data;
+   I2C_TraceIn=(I2C_TraceIn+1)&(I2C_TraceSize-1);
+   I2C_TraceUsed++;
+}
+
+void I2C_TraceRecord()
+//Write the transaction at the head in the trace (interrupts are off)
+{
+   byte Info, Len, n;
+   int16 Ticks, Count;
+
+   Info=(I2C_T.WriteLen<<5)|(I2C_T.ReadLen<<3)|(I2C_Result-I2C_DONE);
+   if (I2C_T.Options & I2C_POLL) Info|=0x04;
+   Len=I2C_TraceLength(Info);
+   while (I2C_TraceSize-I2C_TraceUsed<Len) {    //Drop the oldest
+      n=I2C_TraceLength(I2C_Trace[(I2C_TraceOut+5)&(I2C_TraceSize-1)]);
+      I2C_TraceOut=(I2C_TraceOut+n)&(I2C_TraceSize-1);
+      I2C_TraceUsed-=n;
+      I2C_TraceLost++;
+   }
+   Count=get_timer3();                          //Perf_Now() without
+   Ticks=TimerTicks;                            //enabling interrupts
+   if (interrupt_active(INT_TIMER3) && (Count<0x8000)) Ticks++;
+   I2C_TracePut(make8(Ticks,1));
+   I2C_TracePut(make8(Ticks,0));
+   I2C_TracePut(make8(Count,1));
+   I2C_TracePut(make8(Count,0));
+   I2C_TracePut(I2C_T.Address);
+   I2C_TracePut(Info);
+   for(n=0;n<I2C_T.WriteLen;n++) I2C_TracePut(I2C_T.WriteData[n]);
+   if (I2C_Result==I2C_DONE)
+      for(n=0;n<I2C_T.ReadLen;n++) I2C_TracePut(I2C_T.ReadData[n]);
+}
+
+void I2C_TraceStart()
+//Empty the trace and start recording
+{
+   disable_interrupts(GLOBAL);
+   I2C_TraceIn=I2C_TraceOut=I2C_TraceUsed=0;
+   I2C_TraceLost=0;
+   I2C_Tracing=TRUE;
+   enable_interrupts(GLOBAL);
+}
+
+byte I2C_TraceTake(byte *Data, byte Max)
+//Move the oldest whole transactions (up to Max bytes) out of the trace
+{
+   byte Len, Taken=0, n;
+
+   disable_interrupts(GLOBAL);
+   while (I2C_TraceUsed!=0) {
+      Len=I2C_TraceLength(I2C_Trace[(I2C_TraceOut+5)&(I2C_TraceSize-1)]);
+      if (Taken+Len>Max) break;
+      for(n=0;n<Len;n++) {
+         Data[Taken++]=I2C_Trace[I2C_TraceOut];
+         I2C_TraceOut=(I2C_TraceOut+1)&(I2C_TraceSize-1);
+      }
+      I2C_TraceUsed-=Len;
+   }
+   enable_interrupts(GLOBAL);
+   return (Taken);
+}
+#endif
+
+void I2C_Finish()
+//The transaction at the head is finished. Go to the next one
+{
+#ifdef I2C_TraceSize
+   if (I2C_Tracing) I2C_TraceRecord();
+#endif
+   if ((I2C_Result!=I2C_DONE)&&
+       !((I2C_Result==I2C_NAK)&&(I2C_T.Options & I2C_POLL)))
+      I2C_Error(I2C_T.Address);
+   if (I2C_T.Gap!=0) {                          //Gap starts at the Stop
+      I2C_GapAddress=I2C_T.Address;
+      I2C_GapUs=I2C_T.Gap;
+      I2C_GapFrom=get_timer3();
+      I2C_GapTick=TimerTicks;
+   }
+   if (I2C_T.Options & I2C_AUTOFREE) I2C_T.Status=I2C_FREE;
+   else I2C_T.Status=I2C_Result;
+   if (++I2C_Head==I2C_QueueSize) I2C_Head=0;
+   I2C_Begin();
+}
+
+
+#ifdef __PCH__
+#INT_SSP
+#endif
+//MSSP Interrupt. Each time the module finishes an action on the bus
+void I2C_isr()
+{
+   switch (I2C_Phase) {
+      case I2C_PH_START:
+         I2C_Index=0;
+         if (I2C_T.WriteLen==0) {
+            SSPBUF=I2C_T.Address|1;
+            I2C_Phase=I2C_PH_ADDR_R;
+         }
+         else {
+            SSPBUF=I2C_T.Address;
+            I2C_Phase=I2C_PH_WRITE;
+         }
+         break;
+      case I2C_PH_WRITE:
+         if (ACKSTAT) {                         //Device did not answer
+            I2C_Stop(I2C_NAK);
+            break;
+         }
+         if (I2C_Index<I2C_T.WriteLen) {
+            SSPBUF=I2C_T.WriteData[I2C_Index++];
+            break;
+         }
+         if (I2C_T.ReadLen==0) {
+            I2C_Stop(I2C_DONE);
+            break;
+         }
+         if (I2C_T.Options & I2C_SPLIT) {
+            I2C_Phase=I2C_PH_SPLIT;
+            PEN=1;
+            break;
+         }
+         I2C_Phase=I2C_PH_RESTART;
+         RSEN=1;
+         break;
+      case I2C_PH_SPLIT:
+         I2C_Hold(I2C_T.Gap, I2C_PH_GAP_READ);
+         break;
+      case I2C_PH_RESTART:
+         SSPBUF=I2C_T.Address|1;
+         I2C_Phase=I2C_PH_ADDR_R;
+         break;
+      case I2C_PH_ADDR_R:
+         if (ACKSTAT) {
+            I2C_Stop(I2C_NAK);
+            break;
+         }
+         I2C_Index=0;
+         I2C_Phase=I2C_PH_READ;
+         RCEN=1;
+         break;
+      case I2C_PH_READ:
+         I2C_T.ReadData[I2C_Index++]=SSPBUF;
+         ACKDT=(I2C_Index>=I2C_T.ReadLen);      //NAK to the last byte
+         I2C_Phase=I2C_PH_ACK;
+         ACKEN=1;
+         break;
+      case I2C_PH_ACK:
+         if (I2C_Index<I2C_T.ReadLen) {
+            I2C_Phase=I2C_PH_READ;
+            RCEN=1;
+         }
+         else I2C_Stop(I2C_DONE);
+         break;
+      case I2C_PH_STOP:
+         I2C_Finish();
+         break;
+   }
+}
+
+#ifdef __PCH__
+#INT_TIMER0
+#endif
+//Timer0 Interrupt. End of a gap
+void I2C_Gap_isr()
+{
+   disable_interrupts(INT_TIMER0);
+   I2C_Resume();
+}
+
+
+void I2C_BusClear()
+//Free a device that holds SDA low: clocks on SCL until it releases SDA (9 at
+//most, a whole byte and its acknowledge), then a Stop. MSSP must be off
+{
+   byte n;
+
+   LATC3=0;                         //Pins pull low only when they are outputs
+   LATC4=0;
+   TRISC4=1;
+   for(n=0;(n<9)&&!RC4;n++) {
+      TRISC3=0;                     //SCL low
+      delay_us(5);
+      TRISC3=1;                     //SCL high
+      delay_us(5);
+   }
+   TRISC3=0;                        //Stop: SDA goes high while SCL is high
+   delay_us(5);
+   TRISC4=0;
+   delay_us(5);
+   TRISC3=1;
+   delay_us(5);
+   TRISC4=1;
+   delay_us(5);
+}
+
+void I2C_Recover()
+//The bus is stuck. Clear it and finish the transaction with I2C_TIMEOUT.
+//Interrupts must be off
+{
+   disable_interrupts(INT_SSP);
+   disable_interrupts(INT_TIMER0);
+   SSPCON1=0x00;                    //MSSP off. SCL and SDA are port pins
+   I2C_BusClear();
+   I2C_Setup();
+   I2C_Recoveries++;
+   clear_interrupt(INT_SSP);
+   enable_interrupts(INT_SSP);
+   I2C_Result=I2C_TIMEOUT;
+   I2C_Finish();                    //Next transaction
+}
+
+int1 I2C_Check()
+//Recover the bus if the transaction on it is taking too long
+{
+   int1 Stuck=FALSE;
+
+   disable_interrupts(GLOBAL);      //Until recovered: the ISR cannot finish
+   if ((I2C_Phase!=I2C_PH_IDLE)&&   //it meanwhile and start the next one
+       ((sint16)(TimerTicks-I2C_Deadline)>=0)) {
+      if (I2C_Phase==I2C_PH_GAP) {  //Timer0 lost: the bus is free
+         disable_interrupts(INT_TIMER0);
+         I2C_Begin();
+      }
+      else {
+         I2C_Recover();
+         Stuck=TRUE;
+      }
+   }
+   enable_interrupts(GLOBAL);
+   return (Stuck);
+}
+
+int16 I2C_Errors(byte Address)
+//Failed transactions of a device
+{
+   byte n;
+
+   for(n=0;n<I2C_ErrDevices;n++)
+      if ((I2C_ErrCount[n]!=0)&&(I2C_ErrAddress[n]==Address))
+         return (I2C_ErrCount[n]);
+   return (0);
+}
+
+byte I2C_New(byte Address, byte WriteLen, byte ReadLen)
+//Reserve the next slot of the queue. Wait if the queue is full
+{
+   byte Slot;
+   int32 Start;
+
+   Slot=I2C_Tail;
+   if (I2CQueue[Slot].Status!=I2C_FREE) {     //Queue full
+      Start=Perf_Now();
+      while (I2CQueue[Slot].Status!=I2C_FREE) I2C_Check();
+      Perf_Blocked(Start);
+   }
+   I2CQueue[Slot].Status=I2C_RESERVED;
+   if (++I2C_Tail==I2C_QueueSize) I2C_Tail=0;
+   I2CQueue[Slot].Address=Address;
+   I2CQueue[Slot].Options=0;
+   I2CQueue[Slot].Gap=0;
+   I2CQueue[Slot].WriteLen=WriteLen;
+   I2CQueue[Slot].ReadLen=ReadLen;
+   I2CQueue[Slot].ReadData[0]=0;
+   I2CQueue[Slot].ReadData[1]=0;
+   return (Slot);
+}
+
+void I2C_Submit(byte Slot)
+//Send the transaction. Starts the bus if it was idle
+{
+   Perf_I2C(I2CQueue[Slot].Address,
+            (I2CQueue[Slot].WriteLen ? 1+I2CQueue[Slot].WriteLen : 0)+
+            (I2CQueue[Slot].ReadLen ? 1+I2CQueue[Slot].ReadLen : 0));
+   I2CQueue[Slot].Status=I2C_QUEUED;
+   disable_interrupts(GLOBAL);
+   if (I2C_Phase==I2C_PH_IDLE) I2C_Begin();
+   enable_interrupts(GLOBAL);
+}
+
+int1 I2C_Busy(byte Slot)
+//True while the transaction has not finished
+{
+   return ((I2CQueue[Slot].Status==I2C_QUEUED)||
+           (I2CQueue[Slot].Status==I2C_BUSY));
+}
+
+byte I2C_Wait(byte Slot)
+//Wait for the transaction to finish. Returns I2C_DONE, I2C_NAK or I2C_TIMEOUT
+{
+   int32 Start;
+
+   if (I2C_Busy(Slot)) {
+      Start=Perf_Now();
+      while (I2C_Busy(Slot)) I2C_Check();
+      Perf_Blocked(Start);
+   }
+   return (I2CQueue[Slot].Status);
+}
+
+int1 I2C_Idle()
+//True when all the transactions have finished and the bus is free
+{
+   return (I2C_Phase==I2C_PH_IDLE);
+}
+
+void I2C_Free(byte Slot)
+//The slot can be used by another transaction
+{
+   I2CQueue[Slot].Status=I2C_FREE;
+}
+
+int1 I2C_Probe(byte Address)
+//True if a device answers at the address
+{
+   byte Slot, Status;
+
+   Slot=I2C_New(Address, 0, 1);
+   I2CQueue[Slot].Options=I2C_POLL;          //Nobody there is not an error
+   I2CQueue[Slot].Gap=I2C_ProbeGap;
+   I2C_Submit(Slot);
+   Status=I2C_Wait(Slot);
+   I2C_Free(Slot);
+   return (Status==I2C_DONE);
+}
+
+byte I2C_Scan(byte First, byte Last)
+//First address of the range with a device, 0 if none
+{
+   byte Address;
+
+   for(Address=First;Address<=Last;Address+=2) {
+      if (I2C_Probe(Address)) return (Address);
+      if (Address>=0xFE) break;
+   }
+   return (0);
+}
@@ -9,6 +9,20 @@ FUNCTIONS:
 -LM75_TempRead(byte LM75Address) returns the temperature value of the selected
 LM75 chip in C in a signed integer8 value
 
+LM75_TempRead() waits for the I2C transaction. To go on working while it is
+on the bus, use the following functions instead:
+
+-LM75_TempStart(byte LM75Address) queues the read of the temperature and
+returns the slot of the I2C transaction at once
+-LM75_TempCollect(byte Slot) returns the temperature read in that slot once
+I2C_Busy(Slot) is false, and frees the slot. LM75_Failed is true if it could
+not be read (the value is 0 then). Only the whole degrees are kept, and a
+temperature below 0 is returned as 0, so the value is 0 to 150
+
+   Slot=LM75_TempStart(0x9E);
+   ...                                 //Do other things
+   if (!I2C_Busy(Slot)) Temperature=LM75_TempCollect(Slot);
+
 CONFIGURATION:
 
 LM75 have four pins for configuring the address. They are A0, A1 and A2. 
@@ -19,25 +33,38 @@ A0=A1=A2=1, then address is 10011110.
 */
 
 
+int1 LM75_Failed=FALSE;             //Last temperature could not be read
+
+
+byte LM75_TempStart(byte LM75Address)
+//Queue the read of the temperature. Returns the I2C slot
+{
+   byte Slot;
+
+   Slot=I2C_New(LM75Address, 1, 2);
+   I2CQueue[Slot].WriteData[0]=0x00;   // Pointer Byte
+   I2C_Submit(Slot);
+   return (Slot);
+}
+
+signed int LM75_TempCollect(byte Slot)
+//Temperature read in a slot (see LM75_TempRead). Frees the slot
+{
+   byte DataHigh=0;                    //Byte read
+
+   LM75_Failed=(I2C_Wait(Slot)!=I2C_DONE);
+   if (!LM75_Failed) DataHigh=I2CQueue[Slot].ReadData[0];   // ReadData[1] is DataLow
+   I2C_Free(Slot);
+   if (DataHigh>150) DataHigh=0; //Error in data. Better return 0.
+   return (DataHigh);
+}
+
 signed int LM75_TempRead(byte LM75Address)       //
 //Read the temperature:
 //DataHigh contains the signed C figure
 //MSB of DataLow contains the decimal value as LM75 have 0.5C sensibility
-//we ignore this sensibility in this function, so the function returns
-//the C value either positive or negative as per LM75 caracteristics.
+//we ignore this sensibility in this function. Below 0C it returns 0
+//(see LM75_TempCollect).
 {
-   byte DataHigh=0, DataLow=0;         //Bytes read
-   
-   i2c_start();
-   i2c_write(LM75Address);
-   i2c_write(0x00);                    // Pointer Byte
-   i2c_start();
-   i2c_write(LM75Address|1);
-   DataHigh = i2c_read();              // with ACK
-   DataLow = i2c_read(0);              // with NAK
-   i2c_stop();
-   if (DataHigh>150) DataHigh=0; //Error in data. Better return 0.
-   return (DataHigh);
+   return (LM75_TempCollect(LM75_TempStart(LM75Address)));
 }
-
-
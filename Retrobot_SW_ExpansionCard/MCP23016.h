@@ -12,58 +12,99 @@ of #DEFINES). Each element of the couple is refered to each of the ports.
 The registers could be accesed (for read or write) either individualy or in
 couples.
 
+SEVERAL CHIPS:
+Up to 8 chips can share the I2C bus (pins A2,A1,A0). Each one is a device of
+the library, with its address and its shadow latch (see below) kept in a
+table (up to MCP23016Devices). A chip goes into the table with MCP23016_Add(),
+that returns its device number (0 for the first one). All the functions take
+the device number as the first parameter.
+
 Read below the information about Functions, Configuration and Warnings.
 
 FUNCTIONS:
-MCP23016_Reg_Write(byte Reg, Data): Write a byte to a register
-MCP23016_Reg_Write16(byte Reg, unsigned int16 Data): Write data to registers in 
-16 bit mode (a couple of registers at a time). 
-PCF8574_Reg_Read(byte Reg): Read data from the register
-PCF8574_Reg_Read16(byte Reg): Read data from a couple of registers
-MCP23016_output_high (int16 Pin): Set a pin or set of pins at PortA and PortB
-MCP23016_output_low (int16 Pin): clear a pin or set of pins at PortA and PortB
-MCP23016_input(int16 Pin): Get the value of a pin at PortA and PortB. If more 
-than one pin is requested, the function return true if any of the pins is active
+MCP23016_Add(byte Address): Put a chip in the table and return its device
+number. If it is already there, its number is returned. If the table is full
+it returns MCP23016_NONE (0xFF), that no other function accepts
+MCP23016_Reg_Write(byte Dev, byte Reg, Data): Write a byte to a register
+MCP23016_Reg_Write16(byte Dev, byte Reg, int16 Data): Write data to registers
+in 16 bit mode (a couple of registers at a time). 
+PCF8574_Reg_Read(byte Dev, byte Reg): Read data from the register
+PCF8574_Reg_Read16(byte Dev, byte Reg): Read data from a couple of registers
+MCP23016_output_high (byte Dev, int16 Pin): Set a pin or set of pins at PortA
+and PortB
+MCP23016_output_low (byte Dev, int16 Pin): clear a pin or set of pins at PortA
+and PortB
+MCP23016_input(byte Dev, int16 Pin): Get the value of a pin at PortA and PortB.
+If more than one pin is requested, the function return true if any of the pins
+is active
+MCP23016_output_write(byte Dev, int16 Value): Write the 16 output bits of PortA
+and PortB at once. If the value is the same the chip already has, nothing is
+sent.
+MCP23016_Latch_Sync(byte Dev): Read the output latches (OLAT0/OLAT1) from the
+chip and refresh the RAM copy of them (see SHADOW LATCH below)
+MCP23016_Latch_Invalidate(byte Dev): Force the next pin update to read the
+output latches from the chip first. Use it if you suspect the chip has been
+reset.
+MCP23016_Latch_Refresh(byte Dev): Write the RAM copy of the output latches to
+the chip again. Use it after an error on the I2C bus, as the last write could
+be lost.
 
 Examples:
 
+   Dev=MCP23016_Add(MCP23016Address);
+
    //write 0b00001111 (0F) at IODIR0 register
-   MCP23016_Reg_Write(IODIR0, 0b00001111);
+   MCP23016_Reg_Write(Dev, IODIR0, 0b00001111);
    
    //write FF at IODIR1 and 0F at IODIR0 register
-   MCP23016_Reg_Write16(IODIR0, 0xFF0F);
+   MCP23016_Reg_Write16(Dev, IODIR0, 0xFF0F);
    
    //read the values at PortA (GP0 register)
-   data=PCF8574_Reg_Read(GP0);
+   data=PCF8574_Reg_Read(Dev, GP0);
    
    //read the values at PortA (GP0) and PortB (GP1)
-   data16=PCF8574_Reg_Read16(GP0);
+   data16=PCF8574_Reg_Read16(Dev, GP0);
    
    //set the Pin 3 at PortA not changing the rest of the bits
-   MCP23016_output_high (MCP23016_PIN_A3)
+   MCP23016_output_high (Dev, MCP23016_PIN_A3)
 
    //clear the bits 3 and 5 at PortB not changing the rest of the bits
-   MCP23016_output_low (MCP23016_PIN_B3|MCP23016_PIN_B5)
+   MCP23016_output_low (Dev, MCP23016_PIN_B3|MCP23016_PIN_B5)
 
    //Read bit 3 of PortA
-   data=MCP23016_input(MCP23016_PIN_A3)
+   data=MCP23016_input(Dev, MCP23016_PIN_A3)
+
+   //Set pins A0 and B1 and clear the rest of them in a single write
+   MCP23016_output_write (Dev, MCP23016_PIN_A0|MCP23016_PIN_B1)
+
+SHADOW LATCH:
+The library keeps a copy in RAM of the output latches OLAT0 and OLAT1 of each
+chip (MCP23016_Latch[Dev]). MCP23016_output_high and MCP23016_output_low
+work over this copy, so changing a pin is just one 16 bit write instead of
+reading the port and then writing it back. If the new value is the same as the
+one in the copy, the write is skipped and the bus is not used at all.
+The copy is loaded from the chip the first time it is needed, and again every 
+time MCP23016_Latch_Sync() is called or after MCP23016_Latch_Invalidate(). 
+Writes done with MCP23016_Reg_Write or MCP23016_Reg_Write16 to GP0, GP1, OLAT0
+or OLAT1 also update the copy.
 
 CONFIGURATION:
-(1) Include the I2C preprocessor command at your main program. Something like:
-#use i2c(Master,Slow,sda=PIN_C4,scl=PIN_C3)
+(1) Include I2CMaster.h (interrupt driven I2C) before this library. Writes are
+queued and the functions return at once, while reads wait for the data.
 (2) Ensure you use the correct I2C address. 
 MCP23016 address: |0|1|0|0|A2|A1|A0|R/W|
 A2,A1 and A0 are the external pins for getting different addreses.
 R/W is the read, write bit.
-In this library we have considered the use of the MCP23016 with A2, A1, A0 
-connected to Vss (0 volts). If this is not the case, change the address at
-#DEFINE MCP23016Address
+MCP23016Address is the chip of the Expansion Card, with A2, A1, A0 connected
+to Vss (0 volts). Add more chips with their own addresses, and define
+MCP23016Devices (chips in the table, default 1) before including the library
+if there are more than one.
 (3) Configure direction (input or output) of each port bit by writing to the
 registers IODIR0 and IODIR1. A port coud have some bits as inputs (1) and others
-as outputs (0). ie: MCP23016_Reg_Write(IODIR0, 0b00001111) the first 4 pins
+as outputs (0). ie: MCP23016_Reg_Write(Dev, IODIR0, 0b00001111) the first 4 pins
 of the register will be used as inputs and the last 4 as outputs
-(4) Write/read from/to the ports. ie: MCP23016_Reg_Write(GP0, 0xFF); write FF
-to PortA while data=PCF8574_Reg_Read(GP0); reads the values at PortA
+(4) Write/read from/to the ports. ie: MCP23016_Reg_Write(Dev, GP0, 0xFF); write
+FF to PortA while data=PCF8574_Reg_Read(Dev, GP0); reads the values at PortA
 
 
 WARNINGS:
@@ -87,126 +128,192 @@ register of such port)
 ---
 */
 
-#DEFINE MCP23016Address  0b01000000  //The I2C address of the device if A0,A1,A2 
+#define MCP23016Address  0b01000000  //The I2C address of the device if A0,A1,A2 
                                      //are connected to Vss (0v)
+#ifndef MCP23016Devices
+#define MCP23016Devices  1           //Chips in the table (8 at most)
+#endif
+#define MCP23016_NONE    0xFF        //MCP23016_Add(): the table is full
+#ifndef MCP23016_Gap
+#define MCP23016_Gap     50          //us after each of its Stops before it can
+                                     //be addressed again. Requires this delay
+                                     //to work properly. Other devices can use
+                                     //the bus meanwhile (I2CMaster.h)
+#endif
                                      
 //Registers described in datasheet                                     
-#DEFINE  GP0     0x00               //PortA
-#DEFINE  GP1     0x01               //PortB
-#DEFINE  OLAT0   0x02               //Output latch of PortA
-#DEFINE  OLAT1   0x03               //Output latch of PortB
-#DEFINE  IPOL0   0x04               //Polarity of PortA pins
-#DEFINE  IPOL1   0x05               //Polarity of PortB pins
-#DEFINE  IODIR0  0x06               //Direction of PortA pins (1=In, 0=Out)
-#DEFINE  IODIR1  0x07               //Direction of PortB pins (1=In, 0=Out)
-#DEFINE  INTCAP0 0x08               //Interrupt Capture of PortA
-#DEFINE  INTCAP1 0x09               //Interrupt Capture of PortB
-#DEFINE  IOCON0  0x0A               //I/O expander control register
-#DEFINE  IOCON1  0x0B               //Same as IOCON0
+#define  GP0     0x00               //PortA
+#define  GP1     0x01               //PortB
+#define  OLAT0   0x02               //Output latch of PortA
+#define  OLAT1   0x03               //Output latch of PortB
+#define  IPOL0   0x04               //Polarity of PortA pins
+#define  IPOL1   0x05               //Polarity of PortB pins
+#define  IODIR0  0x06               //Direction of PortA pins (1=In, 0=Out)
+#define  IODIR1  0x07               //Direction of PortB pins (1=In, 0=Out)
+#define  INTCAP0 0x08               //Interrupt Capture of PortA
+#define  INTCAP1 0x09               //Interrupt Capture of PortB
+#define  IOCON0  0x0A               //I/O expander control register
+#define  IOCON1  0x0B               //Same as IOCON0
 
 //Bits of registers
-#DEFINE  MCP23016_PIN_A0 0x0001     
-#DEFINE  MCP23016_PIN_A1 0x0002     
-#DEFINE  MCP23016_PIN_A2 0x0004     
-#DEFINE  MCP23016_PIN_A3 0x0008     
-#DEFINE  MCP23016_PIN_A4 0x0010     
-#DEFINE  MCP23016_PIN_A5 0x0020     
-#DEFINE  MCP23016_PIN_A6 0x0040     
-#DEFINE  MCP23016_PIN_A7 0x0080     
-#DEFINE  MCP23016_PIN_B0 0x0100     
-#DEFINE  MCP23016_PIN_B1 0x0200     
-#DEFINE  MCP23016_PIN_B2 0x0400     
-#DEFINE  MCP23016_PIN_B3 0x0800     
-#DEFINE  MCP23016_PIN_B4 0x1000     
-#DEFINE  MCP23016_PIN_B5 0x2000     
-#DEFINE  MCP23016_PIN_B6 0x4000     
-#DEFINE  MCP23016_PIN_B7 0x8000     
-
-void MCP23016_Reg_Write(byte Reg, Data)
+#define  MCP23016_PIN_A0 0x0001     
+#define  MCP23016_PIN_A1 0x0002     
+#define  MCP23016_PIN_A2 0x0004     
+#define  MCP23016_PIN_A3 0x0008     
+#define  MCP23016_PIN_A4 0x0010     
+#define  MCP23016_PIN_A5 0x0020     
+#define  MCP23016_PIN_A6 0x0040     
+#define  MCP23016_PIN_A7 0x0080     
+#define  MCP23016_PIN_B0 0x0100     
+#define  MCP23016_PIN_B1 0x0200     
+#define  MCP23016_PIN_B2 0x0400     
+#define  MCP23016_PIN_B3 0x0800     
+#define  MCP23016_PIN_B4 0x1000     
+#define  MCP23016_PIN_B5 0x2000     
+#define  MCP23016_PIN_B6 0x4000     
+#define  MCP23016_PIN_B7 0x8000     
+
+byte  MCP23016_Count=0;                    //Chips in the table
+byte  MCP23016_Address[MCP23016Devices];   //I2C address of each chip
+int16 MCP23016_Latch[MCP23016Devices];     //RAM copy of OLAT1 (high) and
+                                           //OLAT0 (low) of each chip
+int1  MCP23016_LatchValid[MCP23016Devices];   //TRUE when the copy matches
+
+byte MCP23016_Add(byte Address)
+//Device number of the chip. It is added if it is not in the table
+{
+   byte Dev;
+
+   for(Dev=0;Dev<MCP23016_Count;Dev++)
+      if (MCP23016_Address[Dev]==Address) return (Dev);
+   if (MCP23016_Count==MCP23016Devices) return (MCP23016_NONE);   //Full
+   MCP23016_Address[Dev]=Address;
+   MCP23016_Latch[Dev]=0;
+   MCP23016_LatchValid[Dev]=FALSE;
+   MCP23016_Count++;
+   return (Dev);
+}
+
+void MCP23016_Reg_Write(byte Dev, byte Reg, byte Data)
 //Write data to a register in 8 bit mode
 {
-   i2c_start();                  //Starting Signal
-   i2c_write(MCP23016Address);   //I2C Address (Write)
-   i2c_write(Reg);               //Select register
-   i2c_write(Data);              //Write data
-   i2c_stop();
-   delay_us(50);                //Requires this delay to work properly
+   byte Slot;
+
+   Slot=I2C_New(MCP23016_Address[Dev], 2, 0);
+   I2CQueue[Slot].WriteData[0]=Reg;       //Select register
+   I2CQueue[Slot].WriteData[1]=Data;      //Write data
+   I2CQueue[Slot].Options=I2C_AUTOFREE;
+   I2CQueue[Slot].Gap=MCP23016_Gap;
+   I2C_Submit(Slot);
+   if ((Reg==GP0)||(Reg==OLAT0))          //Keep the copy of the latch updated
+      MCP23016_Latch[Dev]=(MCP23016_Latch[Dev] & 0xFF00)|Data;
+   if ((Reg==GP1)||(Reg==OLAT1))
+      MCP23016_Latch[Dev]=(MCP23016_Latch[Dev] & 0x00FF)|((int16)Data<<8);
 }
 
-void MCP23016_Reg_Write16(byte Reg, unsigned int16 Data)
+void MCP23016_Reg_Write16(byte Dev, byte Reg, int16 Data)
 //Write data to registers in 16 bit mode
 {
-   byte Data1, Data2;            //Data to write
-   
-   Data1= (Data & 0x00FF);
-   Data2=((Data & 0xFF00) >> 8);
-   i2c_start();                  //Starting Signal
-   i2c_write(MCP23016Address);   //I2C Address (Write)
-   i2c_write(Reg);               //Select register
-   i2c_write(Data1);              //Write data
-   i2c_write(Data2);              //Write data
-   i2c_stop();
-   delay_us(50);                //Requires this delay to work properly
+   byte Slot;
+
+   Slot=I2C_New(MCP23016_Address[Dev], 3, 0);
+   I2CQueue[Slot].WriteData[0]=Reg;             //Select register
+   I2CQueue[Slot].WriteData[1]=make8(Data,0);   //Write data
+   I2CQueue[Slot].WriteData[2]=make8(Data,1);   //Write data
+   I2CQueue[Slot].Options=I2C_AUTOFREE;
+   I2CQueue[Slot].Gap=MCP23016_Gap;
+   I2C_Submit(Slot);
+   if ((Reg==GP0)||(Reg==OLAT0)) {        //Keep the copy of the latch updated
+      MCP23016_Latch[Dev]=Data;
+      MCP23016_LatchValid[Dev]=TRUE;
+   }
 }
 
+byte MCP23016_Read(byte Dev, byte Reg, byte Bytes)
+//Read registers. The data is left in the slot returned. Free it after use
+{
+   byte Slot;
+
+   Slot=I2C_New(MCP23016_Address[Dev], 1, Bytes);
+   I2CQueue[Slot].WriteData[0]=Reg;       //Select register
+   I2CQueue[Slot].Options=I2C_SPLIT;      //Stop before reading
+   I2CQueue[Slot].Gap=MCP23016_Gap;
+   I2C_Submit(Slot);
+   I2C_Wait(Slot);
+   return (Slot);
+}
 
-byte PCF8574_Reg_Read(byte Reg)
+byte PCF8574_Reg_Read(byte Dev, byte Reg)
 //Read data from the register in 8 bit mode
 {
    byte Data;            //Data read
-   
-   i2c_start();                  //Starting Signal
-   i2c_write(MCP23016Address);    //I2C Address (Write)
-   i2c_write(Reg);               //Select register
-   i2c_stop();
-   delay_us(50);                //Requires this delay to work properly
-   i2c_start();                  //Starting Signal
-   i2c_write(MCP23016Address|1);  //I2C Address (Read)
-   Data = i2c_read(0);           //Read value with NAK
+   byte Slot;
+
+   Slot=MCP23016_Read(Dev, Reg, 1);
+   Data=I2CQueue[Slot].ReadData[0];
+   I2C_Free(Slot);
    return (Data);
 }
 
-int16 PCF8574_Reg_Read16(byte Reg)
+int16 PCF8574_Reg_Read16(byte Dev, byte Reg)
 //Read data from a couple of registers
 {
-   byte Data1, Data2;            //Data read
-   unsigned int16 Data;          //the 16bit value of both registers
-   
-   i2c_start();                  //Starting Signal
-   i2c_write(MCP23016Address);    //I2C Address (Write)
-   i2c_write(Reg);               //Select register
-   i2c_stop();
-   delay_us(50);                //Requires this delay to work properly
-   i2c_start();                  //Starting Signal
-   i2c_write(MCP23016Address|1);  //I2C Address (Read)
-   Data1 = i2c_read();           //Read first value
-   Data2 = i2c_read(0);          //Read second value with NAK
-   i2c_stop();
-   delay_us(50);                //Requires this delay to work properly
-   Data=Data2;
-   Data=Data<<8;
-   Data=Data|Data1;
+   int16 Data;          //the 16bit value of both registers
+   byte Slot;
+
+   Slot=MCP23016_Read(Dev, Reg, 2);
+   Data=make16(I2CQueue[Slot].ReadData[1], I2CQueue[Slot].ReadData[0]);
+   I2C_Free(Slot);
    return (Data);
 }
 
-void MCP23016_output_high (int16 Pin)
+void MCP23016_Latch_Sync(byte Dev)
+//Refresh the RAM copy of the output latches with the values in the chip
+{
+   MCP23016_Latch[Dev]=PCF8574_Reg_Read16(Dev, OLAT0);
+   MCP23016_LatchValid[Dev]=TRUE;
+}
+
+void MCP23016_Latch_Invalidate(byte Dev)
+//The next pin update will read the output latches from the chip first
+{
+   MCP23016_LatchValid[Dev]=FALSE;
+}
+
+void MCP23016_Latch_Refresh(byte Dev)
+//Send the RAM copy of the output latches to the chip again
+{
+   if (MCP23016_LatchValid[Dev])
+      MCP23016_Reg_Write16(Dev, GP0, MCP23016_Latch[Dev]);
+}
+
+void MCP23016_output_write (byte Dev, int16 Value)
+//Write all the output pins at PortA and PortB. Skipped if nothing changes
+{
+   if (MCP23016_LatchValid[Dev] && (Value==MCP23016_Latch[Dev])) return;
+   MCP23016_Reg_Write16(Dev, GP0, Value);
+}
+
+void MCP23016_output_high (byte Dev, int16 Pin)
 //Set a pin or set of pins at PortA and PortB
 {
-   MCP23016_Reg_Write16(GP0, PCF8574_Reg_Read16(GP0)|Pin);
+   if (!MCP23016_LatchValid[Dev]) MCP23016_Latch_Sync(Dev);
+   MCP23016_output_write(Dev, MCP23016_Latch[Dev]|Pin);
 }
 
-void MCP23016_output_low (unsigned int16 Pin)
+void MCP23016_output_low (byte Dev, int16 Pin)
 //clear a pin or set of pins at PortA and PortB
 {
-   MCP23016_Reg_Write16(GP0, PCF8574_Reg_Read16(GP0)& ~Pin);
+   if (!MCP23016_LatchValid[Dev]) MCP23016_Latch_Sync(Dev);
+   MCP23016_output_write(Dev, MCP23016_Latch[Dev] & ~Pin);
 }
 
-int1 MCP23016_input(int16 Pin)
+int1 MCP23016_input(byte Dev, int16 Pin)
 //Get the value of a pin at PortA and PortB. If more than one pin is requested
 //the function return true if any of the pins is active
 {
    int16  data;
-   data=PCF8574_Reg_Read16(GP0) & Pin;
+   data=PCF8574_Reg_Read16(Dev, GP0) & Pin;
    if (data>0) return (true);
    return (false);
 }
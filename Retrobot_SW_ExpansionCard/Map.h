@@ -0,0 +1,284 @@
+/*
+Library:       Map.h
+Purpose:       Position of the robot by dead reckoning of the wheel commands
+               and occupancy grid of the room built with the sonar ranges
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+POSE:
+The robot has no encoders: the pose is estimated from what the wheels are told
+to do. Map_Move() is given the speed of each wheel (-256 to 256, 256 is
+forward at full duty) and the ticks they have run at that speed. Two
+calibration constants, kept in the data EEPROM, turn it into movement:
+Map_Speed   Distance (1/256 cm) a tick with both wheels forward at full duty
+Map_Turn    Turn (1/65536 of a turn) a tick with the wheels at full duty in
+            opposite directions (right forward: counterclockwise)
+Map_X and Map_Y are in 1/256 cm from the place of Map_Init(), X along the
+heading it had. Map_Heading is in 1/65536 of a turn, counterclockwise. The
+error grows with the distance (slip, the lag of the motors): the map is good
+for the next minutes, not for ever.
+
+GRID:
+MapSize x MapSize cells of MapCell cm, the start in the middle (32 x 16cm:
+5m x 5m). Each cell takes 2 bits, 4 cells a byte, so the default grid takes
+256 bytes of RAM:
+   MAP_FREE     0    A range has gone through it
+   MAP_UNKNOWN  1    Not seen yet
+   MAP_MAYBE    2    An echo, or a wall seen through once
+   MAP_WALL     3    Echoes
+Map_Range() folds a sonar range into the grid along the heading: the cells
+the sound has gone through go one step towards free and the cell of the echo
+two steps towards wall. The ray is walked in half cells with fixed point
+increments (a sine and a cosine from a table, then additions only). A range
+of 0 (no echo) or longer than MapRange makes the cells free up to MapRange.
+The SRF02 beam is some 55 degrees wide: the map takes it as a line, so a wall
+is only seen where the robot has looked at it.
+
+NAVIGATION:
+Map_Open(byte Angle) scores the space in a direction (Angle: 256 per turn,
+counterclockwise from the heading): 2 for each free cell and 1 for each
+unknown one, up to the first wall or the end of the grid. Map_BestTurn()
+looks at 45, 90 and 135 degrees to both sides and returns the angle with the
+most open space, so a turn goes towards where there is room, not at random.
+
+FUNCTIONS:
+Map_Init(): Pose at the origin, grid unknown, calibration from the EEPROM (or
+the defaults if it is erased)
+Map_Move(sint16 Right, sint16 Left, byte Ticks): The wheels have run Ticks
+ticks at these speeds (-256 to 256)
+Map_Range(int16 Cm): A sonar range taken now along the heading
+Map_Get(byte Cx, byte Cy): Value of a cell (MAP_UNKNOWN outside the grid)
+Map_Open(byte Angle): Open space in that direction
+Map_BestTurn(): Angle (as a signed byte: positive is left) with the most space
+Map_Calibrate(int16 Speed, int16 Turn): New calibration, saved in the EEPROM
+in the background (EE_Put() of EEPROM.h). False (not changed) if the queue of
+EEPROM.h has no room for it
+Map_Angle(): Heading in 256 steps per turn
+
+Example:
+
+   Map_Init();
+   ...
+   Map_Move(256, 256, 1);              //A tick ahead at full speed
+   Map_Range(Distance);
+   if (Map_BestTurn()>0) TurnLeft();
+
+CONFIGURATION:
+Include it after Timers.h and EEPROM.h. MapSize (a multiple of 4), MapCell and
+Map_EEBase can be defined before including it. The calibration takes 4 bytes
+of the data EEPROM from Map_EEBase, high byte first.
+*/
+
+#ifndef MapSize
+#define  MapSize          32        //Cells of a side of the grid
+#endif
+#ifndef MapCell
+#define  MapCell          16        //cm of a side of a cell
+#endif
+#ifndef Map_EEBase
+#define  Map_EEBase    0x000        //Calibration in the data EEPROM
+#endif
+#define  MapRange        320        //cm of a range folded into the grid
+#define  MapBytes   (MapSize*MapSize/4)
+#define  MapSpeedDefault  67        //20cm/s at full duty
+#define  MapTurnDefault  182        //Wheels 30cm apart
+
+//Values of a cell
+#define  MAP_FREE          0
+#define  MAP_UNKNOWN       1
+#define  MAP_MAYBE         2
+#define  MAP_WALL          3
+
+//Sine of a quarter of a turn in 64 steps, x16384
+const sint16 MapSin[65]={
+       0,   402,   804,  1205,  1606,  2006,  2404,  2801,
+    3196,  3590,  3981,  4370,  4756,  5139,  5520,  5897,
+    6270,  6639,  7005,  7366,  7723,  8076,  8423,  8765,
+    9102,  9434,  9760, 10080, 10394, 10702, 11003, 11297,
+   11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+   13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+   15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986,
+   16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+   16384};
+
+byte   Map_Grid[MapBytes];          //2 bits per cell, row after row
+sint32 Map_X=0, Map_Y=0;            //Pose: 1/256 cm from the origin
+int16  Map_Heading=0;               //1/65536 of a turn, counterclockwise
+int16  Map_Speed;                   //Calibration: 1/256 cm per tick
+int16  Map_Turn;                    //Calibration: 1/65536 turn per tick
+
+
+sint16 Map_Sin(byte Angle)
+//Sine x16384 of an angle of 256 steps per turn
+{
+   if (Angle<64) return (MapSin[Angle]);
+   if (Angle<128) return (MapSin[128-Angle]);
+   if (Angle<192) return (-MapSin[Angle-128]);
+   return (-MapSin[(byte)(256-(int16)Angle)]);
+}
+
+sint16 Map_Cos(byte Angle)
+//Cosine x16384
+{
+   return (Map_Sin((byte)(Angle+64)));
+}
+
+byte Map_Angle()
+//Heading in 256 steps per turn (rounded)
+{
+   return (make8(Map_Heading+0x80,1));
+}
+
+byte Map_Get(byte Cx, byte Cy)
+//Value of a cell
+{
+   int16 Cell;
+
+   if ((Cx>=MapSize)||(Cy>=MapSize)) return (MAP_UNKNOWN);
+   Cell=(int16)Cy*MapSize+Cx;
+   return ((Map_Grid[Cell>>2]>>((Cell&3)*2))&3);
+}
+
+void Map_Set(byte Cx, byte Cy, byte Value)
+//Change a cell (inside the grid)
+{
+   int16 Cell;
+   byte Shift;
+
+   Cell=(int16)Cy*MapSize+Cx;
+   Shift=(Cell&3)*2;
+   Map_Grid[Cell>>2]=(Map_Grid[Cell>>2]&~(3<<Shift))|(Value<<Shift);
+}
+
+int1 Map_Calibrate(int16 Speed, int16 Turn)
+//New calibration, written to the EEPROM in the background
+{
+   if (EE_Room()<4) return (FALSE);
+   Map_Speed=Speed;
+   Map_Turn=Turn;
+   EE_Put(Map_EEBase, make8(Speed,1));
+   EE_Put(Map_EEBase+1, make8(Speed,0));
+   EE_Put(Map_EEBase+2, make8(Turn,1));
+   EE_Put(Map_EEBase+3, make8(Turn,0));
+   return (TRUE);
+}
+
+void Map_Init()
+//Pose at the origin, nothing seen
+{
+   int16 n;
+
+   Map_X=0;
+   Map_Y=0;
+   Map_Heading=0;
+   for(n=0;n<MapBytes;n++) Map_Grid[n]=0x55;   //All MAP_UNKNOWN
+   Map_Speed=make16(EE_Read(Map_EEBase),EE_Read(Map_EEBase+1));
+   Map_Turn=make16(EE_Read(Map_EEBase+2),EE_Read(Map_EEBase+3));
+   if (Map_Speed==0xFFFF) Map_Speed=MapSpeedDefault;   //EEPROM erased
+   if (Map_Turn==0xFFFF) Map_Turn=MapTurnDefault;
+}
+
+void Map_Move(sint16 Right, sint16 Left, byte Ticks)
+//The wheels have run Ticks ticks at these speeds
+{
+   sint32 Distance, Turn;
+   byte Angle;
+
+   if ((Right==0)&&(Left==0)) return;
+   Distance=((sint32)(Right+Left)*(sint32)Map_Speed*Ticks)/512;
+   Turn=((sint32)(Right-Left)*(sint32)Map_Turn*Ticks)/512;
+   Angle=make8(Map_Heading+(sint16)(Turn/2)+0x80,1);   //Half way through
+   Map_X+=(Distance*Map_Cos(Angle))/16384;
+   Map_Y+=(Distance*Map_Sin(Angle))/16384;
+   Map_Heading+=(sint16)Turn;
+}
+
+sint32 Map_Start(sint32 Pos)
+//A coordinate of the pose in 1/256 of a cell from the corner of the grid
+{
+   return ((Pos+(sint32)MapSize/2*MapCell*256)/MapCell);
+}
+
+void Map_Range(int16 Cm)
+//Fold a sonar range along the heading into the grid
+{
+   sint32 Px, Py;
+   sint16 Dx, Dy;
+   byte Angle, Steps, Cx, Cy, LastX=0xFF, LastY=0xFF, Value;
+   int1 Echo=TRUE;
+
+   if ((Cm==0)||(Cm>MapRange)) {
+      Cm=MapRange;
+      Echo=FALSE;
+   }
+   Angle=Map_Angle();
+   Dx=Map_Cos(Angle)/128;                      //Half a cell, x256
+   Dy=Map_Sin(Angle)/128;
+   Px=Map_Start(Map_X);
+   Py=Map_Start(Map_Y);
+   Steps=(byte)((Cm*2)/MapCell);
+   while (TRUE) {
+      if ((Px<0)||(Py<0)) return;              //Out of the grid
+      Cx=(byte)(Px>>8);
+      Cy=(byte)(Py>>8);
+      if ((Cx>=MapSize)||(Cy>=MapSize)) return;
+      if (Steps==0) break;
+      if ((Cx!=LastX)||(Cy!=LastY)) {          //Each cell once
+         Value=Map_Get(Cx, Cy);
+         if (Value!=MAP_FREE) Map_Set(Cx, Cy, Value-1);
+         LastX=Cx;
+         LastY=Cy;
+      }
+      Px+=Dx;
+      Py+=Dy;
+      Steps--;
+   }
+   if (!Echo) return;
+   Value=Map_Get(Cx, Cy);
+   Value=(Value>=MAP_MAYBE) ? MAP_WALL : Value+2;
+   Map_Set(Cx, Cy, Value);
+}
+
+int16 Map_Open(byte Angle)
+//Open space in a direction from the heading
+{
+   sint32 Px, Py;
+   sint16 Dx, Dy;
+   byte Steps, Cx, Cy, Value;
+   int16 Score=0;
+
+   Angle+=Map_Angle();
+   Dx=Map_Cos(Angle)/128;
+   Dy=Map_Sin(Angle)/128;
+   Px=Map_Start(Map_X);
+   Py=Map_Start(Map_Y);
+   for(Steps=(MapRange*2)/MapCell;Steps>0;Steps--) {
+      Px+=Dx;
+      Py+=Dy;
+      if ((Px<0)||(Py<0)) break;
+      Cx=(byte)(Px>>8);
+      Cy=(byte)(Py>>8);
+      if ((Cx>=MapSize)||(Cy>=MapSize)) break;
+      Value=Map_Get(Cx, Cy);
+      if (Value>=MAP_MAYBE) break;
+      Score+=(Value==MAP_FREE) ? 2 : 1;
+   }
+   return (Score);
+}
+
+sint8 Map_BestTurn()
+//Turn (256 per turn, positive left) towards the most open space
+{
+   byte k;
+   sint8 Best=64;                              //Left, if nothing is better
+   int16 Score, BestScore=0;
+
+   for(k=1;k<=3;k++) {                         //45, 90, 135 degrees
+      Score=Map_Open(k*32);
+      if (Score>BestScore) { BestScore=Score; Best=k*32; }
+      Score=Map_Open((byte)(256-(int16)k*32));
+      if (Score>BestScore) { BestScore=Score; Best=-(sint8)(k*32); }
+   }
+   return (Best);
+}
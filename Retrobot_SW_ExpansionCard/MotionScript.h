@@ -0,0 +1,251 @@
+/*
+Library:       MotionScript.h
+Purpose:       Interpreter of motion scripts (choreographies of motors) stored
+               in program memory or in the data EEPROM
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+A script is a list of byte codes. The interpreter runs as a task of the
+scheduler: Script_Step() runs the codes until it finds a wait, and returns the
+ticks (13.1ms) the task must sleep. It never waits itself.
+
+Scripts are numbered. Numbers below SCRIPT_EE are scripts in program memory
+(ROM), defined by the program. Numbers from SCRIPT_EE are scripts in the data
+EEPROM (SCRIPT_EE is the first one), so new scripts can be added without
+changing the program.
+
+CODES:
+SC_END                  End of script (or return to the script that called it)
+SC_MOTORS n m1 .. mn    Change n motors at the same time. Each m is
+                        SC_M(Motor, Dir), Dir: SC_STOP, SC_FWD or SC_BACK
+SC_PWM g dH dL          Duty cycle dH*256+dL of PWM group g (1 or 2),
+                        reached with the ramp of Speed.h
+SC_WAIT t               Wait t ticks of 13.1ms (t up to 255, 3.3s)
+SC_LOOP n               Repeat n times the codes up to SC_NEXT
+SC_NEXT                 End of the codes to repeat
+SC_BRLT s v o           If Script_Sensor(s) < v jump o bytes (signed)
+SC_BRGE s v o           If Script_Sensor(s) >= v jump o bytes (signed)
+SC_JUMP o               Jump o bytes (signed)
+SC_CALL n               Run script n and come back
+SC_OUT o v              Script_Output(o, v)
+
+Jumps are counted from the code after the jump.
+
+Example:
+
+   //Turn one way and the other 4 times
+   SC_LOOP, 4,
+      SC_MOTORS, 2, SC_M(Wheel_R,SC_FWD),  SC_M(Wheel_L,SC_BACK), SC_WAIT, 76,
+      SC_MOTORS, 2, SC_M(Wheel_R,SC_BACK), SC_M(Wheel_L,SC_FWD),  SC_WAIT, 76,
+   SC_NEXT,
+   SC_MOTORS, 2, SC_M(Wheel_R,SC_STOP), SC_M(Wheel_L,SC_STOP),
+   SC_END
+
+FUNCTIONS:
+Script_Run(byte Script): Start a script (stops the one running, if any)
+Script_Stop(): Stop the script running. Motors are left as they are
+Script_Step(): Run the script until a wait. Returns the ticks to wait
+Script_Running: True while a script is running
+
+DATA EEPROM:
+From Script_EEArea: number of scripts (0xFF if none), then the address of each
+script (high byte first) counted from Script_EEArea, then the scripts. The
+area starts at Script_EEBase; Upload.h moves it to the bank of the EEPROM that
+has the last image loaded by the ZX81 (SCRIPT_NONE: no scripts in EEPROM).
+While a byte of the EEPROM is being written (EEPROM.h), a script in the
+EEPROM waits for it (4ms at most).
+
+CONFIGURATION:
+Include Speed.h, Motors.h and EEPROM.h before this library. The program must
+define these functions (after including this library):
+byte  Script_ROM(int16 Address): byte of the scripts in program memory
+int16 Script_ROMStart(byte Script): address of a script in program memory,
+      or SCRIPT_NONE if there is no such script
+byte  Script_Sensor(byte Sensor): value of a sensor for SC_BRLT and SC_BRGE
+void  Script_Output(byte Output, byte Value): set an output for SC_OUT
+*/
+
+#define  SC_END         0x00
+#define  SC_MOTORS      0x01
+#define  SC_PWM         0x02
+#define  SC_WAIT        0x03
+#define  SC_LOOP        0x04
+#define  SC_NEXT        0x05
+#define  SC_BRLT        0x06
+#define  SC_BRGE        0x07
+#define  SC_JUMP        0x08
+#define  SC_CALL        0x09
+#define  SC_OUT         0x0A
+
+//Direction of a motor in SC_MOTORS
+#define  SC_STOP           0
+#define  SC_FWD            1
+#define  SC_BACK           2
+#define  SC_M(Motor,Dir)   (((Motor)<<2)|(Dir))
+
+#define  SCRIPT_EE      0x80        //First script number in data EEPROM
+#define  SCRIPT_NONE  0xFFFF        //No script
+#define  SCRIPT_INEE  0x8000        //Address is in data EEPROM
+#define  Script_EEBase 0x100        //Scripts area in data EEPROM
+#define  Script_MaxOps    16        //Codes run in one step at most
+#define  Script_Depth      2        //Levels of SC_CALL
+#define  Script_Loops      4        //Levels of SC_LOOP
+
+byte  Script_ROM(int16 Address);
+int16 Script_ROMStart(byte Script);
+byte  Script_Sensor(byte Sensor);
+void  Script_Output(byte Output, byte Value);
+
+int1  Script_Running=FALSE;         //A script is running
+int16 ScriptPC;                     //Address of next code
+byte  ScriptCalls=0;                //Levels of SC_CALL in use
+int16 ScriptReturn[Script_Depth];   //Where to go back after SC_CALL
+byte  ScriptLoops=0;                //Levels of SC_LOOP in use
+int16 ScriptLoopPC[Script_Loops];   //Address of first code to repeat
+byte  ScriptLoopLeft[Script_Loops]; //Times left to repeat
+byte  Script_Error=0;               //Code that stopped the last script
+int16 Script_EEArea=Script_EEBase;  //Scripts in EEPROM (SCRIPT_NONE: none)
+
+
+int16 Script_Start(byte Script)
+//Address of the first code of a script
+{
+   byte Scripts;
+   int16 Entry;
+
+   if (Script<SCRIPT_EE) return (Script_ROMStart(Script));
+   if (Script_EEArea==SCRIPT_NONE) return (SCRIPT_NONE);
+   Script-=SCRIPT_EE;
+   Scripts=EE_Read(Script_EEArea);
+   if ((Scripts==0xFF)||(Script>=Scripts)) return (SCRIPT_NONE);
+   Entry=Script_EEArea+1+2*(int16)Script;
+   return (SCRIPT_INEE|
+           (Script_EEArea+make16(EE_Read(Entry),EE_Read(Entry+1))));
+}
+
+byte Script_Fetch()
+//Next byte of the script
+{
+   byte Data;
+
+   if (ScriptPC & SCRIPT_INEE) Data=EE_Read(ScriptPC & 0x03FF);
+   else Data=Script_ROM(ScriptPC);
+   ScriptPC++;
+   return (Data);
+}
+
+void Script_Jump(byte Offset)
+//Move the address of next code (Offset is signed)
+{
+   if (Offset & 0x80) ScriptPC-=(256-(int16)Offset);
+   else ScriptPC+=Offset;
+}
+
+void Script_Stop()
+//Stop the script running
+{
+   Script_Running=FALSE;
+   ScriptCalls=0;
+   ScriptLoops=0;
+}
+
+void Script_Run(byte Script)
+//Start a script
+{
+   Script_Stop();
+   ScriptPC=Script_Start(Script);
+   Script_Error=0;
+   if (ScriptPC!=SCRIPT_NONE) Script_Running=TRUE;
+}
+
+byte Script_Step()
+//Run codes until a wait. Returns the ticks to wait
+{
+   byte Ops, Code, n, a, b, c;
+   int16 Duty;
+
+   for(Ops=0;Ops<Script_MaxOps;Ops++) {
+      if (!Script_Running) return (0);
+      Code=Script_Fetch();
+      switch (Code) {
+         case SC_END:
+            if (ScriptCalls==0) {
+               Script_Stop();
+               return (0);
+            }
+            ScriptPC=ScriptReturn[--ScriptCalls];
+            break;
+         case SC_MOTORS:
+            n=Script_Fetch();
+            while (n--) {
+               a=Script_Fetch();
+               b=STOP;
+               if ((a&3)==SC_FWD) b=FORWARD;
+               if ((a&3)==SC_BACK) b=BACKWARD;
+               Motor_Stage(a>>2, b);
+            }
+            Motor_Commit();
+            break;
+         case SC_PWM:
+            a=Script_Fetch();
+            b=Script_Fetch();
+            c=Script_Fetch();
+            Duty=make16(b,c);
+            Speed_SetDuty(a, Duty);
+            break;
+         case SC_WAIT:
+            return (Script_Fetch());
+         case SC_LOOP:
+            a=Script_Fetch();
+            if (a==0) a=1;
+            if (ScriptLoops==Script_Loops) {
+               Script_Error=Code;
+               Script_Stop();
+               return (0);
+            }
+            ScriptLoopPC[ScriptLoops]=ScriptPC;
+            ScriptLoopLeft[ScriptLoops++]=a;
+            break;
+         case SC_NEXT:
+            if (ScriptLoops==0) break;
+            if (--ScriptLoopLeft[ScriptLoops-1]==0) ScriptLoops--;
+            else ScriptPC=ScriptLoopPC[ScriptLoops-1];
+            break;
+         case SC_BRLT:
+         case SC_BRGE:
+            a=Script_Sensor(Script_Fetch());
+            b=Script_Fetch();
+            c=Script_Fetch();
+            if ((a<b)==(Code==SC_BRLT)) Script_Jump(c);
+            break;
+         case SC_JUMP:
+            Script_Jump(Script_Fetch());
+            break;
+         case SC_CALL:
+            a=Script_Fetch();
+            if (ScriptCalls==Script_Depth) {
+               Script_Error=Code;
+               Script_Stop();
+               return (0);
+            }
+            ScriptReturn[ScriptCalls++]=ScriptPC;
+            ScriptPC=Script_Start(a);
+            if (ScriptPC==SCRIPT_NONE) {
+               Script_Error=Code;
+               Script_Stop();
+               return (0);
+            }
+            break;
+         case SC_OUT:
+            a=Script_Fetch();
+            Script_Output(a, Script_Fetch());
+            break;
+         default:                            //Unknown code
+            Script_Error=Code;
+            Script_Stop();
+            return (0);
+      }
+   }
+   return (0);                               //Go on in the next pass
+}
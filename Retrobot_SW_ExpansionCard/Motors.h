@@ -0,0 +1,203 @@
+/*
+Library:       Motors.h
+Purpose:       Direction control of the motors connected to the H-bridges of
+               the card through the MCP23016 I/O expander
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+Each motor is driven by an H-bridge with two control signals (S1 and S2) that
+are connected to a couple of pins of an MCP23016. The motor map tells the chip
+(MotorDev, device number of MCP23016.h) and the pins (MotorS1/MotorS2) of each
+motor. The map given in ROM is the default: Motor_MapInit() copies it to RAM,
+and Motor_Map() can change a motor there (ie. with a map read from the data
+EEPROM), so a motor moved to other pins does not need a new program. Motors
+are numbered from 1 to MotorsNumber. A chip has pins for 8 motors, so with
+several chips on the bus (up to 8) the robot can have 16, 24 or more motors.
+
+Changes of direction can be prepared (staged) for several motors and then sent
+all together (commit): a single 16 bit write for each chip that has changes,
+queued one after the other on the I2C bus. This way all the motors of the
+group change at the same time (ie. both wheels when turning), staging a motor
+is just a few operations over the RAM copy of its chip, and the commit takes
+one I2C transaction for each chip changed, not for each motor.
+
+With Speed.h, the map also tells the PWM group of each motor (MotorGroup, 1 or
+2, 0 if it has no PWM). A motor that starts or turns round makes its group
+start again from the lowest speed (Speed_Restart()) just before the commit, so
+it ramps up instead of taking a current peak. Stopping is not delayed.
+
+FUNCTIONS:
+Motor_Stage(byte MotorNum, byte Direction): Prepare the direction of a motor.
+Nothing is sent to the bus.
+Motor_Commit(): Send all the staged directions, one write for each chip. The
+chips where nothing changes are not sent anything.
+SetMotor(byte MotorNum, byte Direction): Stage the direction of one motor and
+commit it immediately.
+Motor_StopAll(): Stop all the motors of the map at once
+Motor_MapInit(): The map of ROM to RAM. Call it before using the motors
+Motor_Map(byte MotorNum, byte Dev, byte PinS1, byte PinS2, byte Group): Chip,
+pins (0 to 15: 0 is A0, 8 is B0) and PWM group of a motor. A chip that is not
+in the table of MCP23016.h (ie. MCP23016_NONE) or a group over SpeedGroups
+leaves the motor as it was, so Motor_Stage() only finds groups it can restart
+Motor_Direction(byte MotorNum): Direction the motor has now (FORWARD 255,
+BACKWARD 0 or STOP 128), from the outputs sent to its chip
+
+Direction: 128:Stop, >128:Forward, <128:Backward
+
+Examples:
+
+   //Turn: both wheels switch at the same time
+   Motor_Stage (Wheel_R, FORWARD);
+   Motor_Stage (Wheel_L, BACKWARD);
+   Motor_Commit ();
+
+   //Just one motor
+   SetMotor (Maraca, STOP);
+
+CONFIGURATION:
+Include MCP23016.h (and Speed.h, if used) before this library and add the
+chips with MCP23016_Add() and call Motor_MapInit() before using the motors.
+The MCP23016 pins used by the motors must be configured as outputs (IODIR0
+and IODIR1).
+The default map is 8 motors on the chip of the card (device 0). For more
+motors, define MotorsNumber and the map before including the library, ie. two
+chips:
+
+   #define  MotorsNumber  16
+   const byte  MotorDev[MotorsNumber]={0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1};
+   const int16 MotorS1[MotorsNumber]={MCP23016_PIN_A0, ... ,MCP23016_PIN_B6};
+   const int16 MotorS2[MotorsNumber]={MCP23016_PIN_A1, ... ,MCP23016_PIN_B7};
+   const byte  MotorGroup[MotorsNumber]={2,2,2,2,1,1,1,1,0,0,0,0,0,0,0,0};
+*/
+
+#ifndef MotorsNumber
+#define  MotorsNumber      8        //Number of motors in the table
+
+//Chip of each motor (motor 1 first)
+const byte  MotorDev[MotorsNumber]={0, 0, 0, 0, 0, 0, 0, 0};
+//Pins of the MCP23016 for S1 and S2 signals of each motor (motor 1 first)
+const int16 MotorS1[MotorsNumber]={
+   MCP23016_PIN_A0, MCP23016_PIN_A2, MCP23016_PIN_A4, MCP23016_PIN_A6,
+   MCP23016_PIN_B0, MCP23016_PIN_B2, MCP23016_PIN_B4, MCP23016_PIN_B6};
+const int16 MotorS2[MotorsNumber]={
+   MCP23016_PIN_A1, MCP23016_PIN_A3, MCP23016_PIN_A5, MCP23016_PIN_A7,
+   MCP23016_PIN_B1, MCP23016_PIN_B3, MCP23016_PIN_B5, MCP23016_PIN_B7};
+//PWM group of each motor (motor 1 first): motors 5 to 8 on PWM1
+const byte  MotorGroup[MotorsNumber]={2, 2, 2, 2, 1, 1, 1, 1};
+#endif
+
+byte  MotorMapDev[MotorsNumber];       //Map in use (RAM), motor 1 first
+int16 MotorMapS1[MotorsNumber];
+int16 MotorMapS2[MotorsNumber];
+byte  MotorMapGroup[MotorsNumber];
+int16 MotorStaged[MCP23016Devices];    //Image of the outputs of each chip
+                                       //with the staged changes
+byte  MotorPending=0;                  //Chips with staged changes to commit
+                                       //(bit n: device n)
+#ifdef SpeedGroups
+byte  MotorRestart=0;                  //PWM groups to restart before the
+                                       //commit (bit g: group g)
+#endif
+
+
+void Motor_MapInit ()
+//The default map, from ROM
+{
+   byte m;
+
+   for(m=0;m<MotorsNumber;m++) {
+      MotorMapDev[m]=MotorDev[m];
+      MotorMapS1[m]=MotorS1[m];
+      MotorMapS2[m]=MotorS2[m];
+      MotorMapGroup[m]=MotorGroup[m];
+   }
+}
+
+void Motor_Map (byte MotorNum, byte Dev, byte PinS1, byte PinS2, byte Group)
+//Another chip, pins or group for a motor. Stop it first
+{
+   if ((MotorNum<1)||(MotorNum>MotorsNumber)) return;
+   if ((Dev>=MCP23016Devices)||(PinS1>15)||(PinS2>15)) return;   //Also NONE
+#ifdef SpeedGroups
+   if (Group>SpeedGroups) return;            //No such PWM group
+#endif
+   MotorMapDev[MotorNum-1]=Dev;
+   MotorMapS1[MotorNum-1]=(int16)1<<PinS1;
+   MotorMapS2[MotorNum-1]=(int16)1<<PinS2;
+   MotorMapGroup[MotorNum-1]=Group;
+}
+
+void Motor_Stage (byte MotorNum, byte Direction)
+//Prepare the direction of a motor, to be sent with Motor_Commit()
+{
+   byte Dev;
+   int16 S1, S2, Old;
+
+   if ((MotorNum<1)||(MotorNum>MotorsNumber)) return;
+   Dev=MotorMapDev[MotorNum-1];
+   if (!bit_test(MotorPending,Dev)) {  //Start from the current outputs
+      if (!MCP23016_LatchValid[Dev]) MCP23016_Latch_Sync(Dev);
+      MotorStaged[Dev]=MCP23016_Latch[Dev];
+      bit_set(MotorPending,Dev);
+   }
+   S1=MotorMapS1[MotorNum-1];
+   S2=MotorMapS2[MotorNum-1];
+   Old=MotorStaged[Dev]&(S1|S2);
+   MotorStaged[Dev]&=~(S1|S2);   //Stop
+   if (Direction<128) MotorStaged[Dev]|=S1;
+   if (Direction>128) MotorStaged[Dev]|=S2;
+#ifdef SpeedGroups
+   if ((Direction!=128)&&((MotorStaged[Dev]&(S1|S2))!=Old))
+      bit_set(MotorRestart,MotorMapGroup[MotorNum-1]);   //Starts or turns round
+#endif
+}
+
+void Motor_Commit ()
+//Send all the staged directions, one write for each chip with changes
+{
+   byte Dev;
+
+#ifdef SpeedGroups
+   if (bit_test(MotorRestart,1)) Speed_Restart(1);   //Before the motors start
+   if (bit_test(MotorRestart,2)) Speed_Restart(2);
+   MotorRestart=0;
+#endif
+   for(Dev=0;MotorPending!=0;Dev++) {
+      if (!bit_test(MotorPending,Dev)) continue;
+      MCP23016_output_write(Dev, MotorStaged[Dev]);
+      bit_clear(MotorPending,Dev);
+   }
+}
+
+void SetMotor (byte MotorNum, byte Direction)
+//Control the direction of one motor
+//Direction 128:Stop, >128:Forward, <128:backwards
+{
+   Motor_Stage(MotorNum, Direction);
+   Motor_Commit();
+}
+
+byte Motor_Direction (byte MotorNum)
+//Direction of a motor, as the outputs of its chip are now
+{
+   int16 Outputs, S1, S2;
+
+   if ((MotorNum<1)||(MotorNum>MotorsNumber)) return (128);
+   Outputs=MCP23016_Latch[MotorMapDev[MotorNum-1]];
+   S1=Outputs & MotorMapS1[MotorNum-1];
+   S2=Outputs & MotorMapS2[MotorNum-1];
+   if (S2 && !S1) return (255);        //Forward
+   if (S1 && !S2) return (0);          //Backward
+   return (128);
+}
+
+void Motor_StopAll ()
+//Stop all the motors
+{
+   byte MotorNum;
+
+   for(MotorNum=1;MotorNum<=MotorsNumber;MotorNum++)
+      Motor_Stage(MotorNum, 128);      //Stop
+   Motor_Commit();
+}
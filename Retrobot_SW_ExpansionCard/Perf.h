@@ -0,0 +1,206 @@
+/*
+Library:       Perf.h
+Purpose:       Performance counters of the firmware: I2C traffic per device,
+               time lost waiting and histograms of the main loop period, of
+               the obstacle to wheels stopped latency and of the wake up to
+               first command latency
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The counters are always on. Each one costs a few instructions where it is
+updated, so they can stay in the program of the robot and be read from the
+ZX81 (command ZX_PERF of RetroBot.c) to see if a change made things slower.
+
+TIME:
+Perf_Now() gives the time in Timer3 counts (0.2us) as an int32: the high word
+is the tick of Timers.h (Timer3 overflows of 13.1ms) and the low word is
+Timer3. It is read with interrupts disabled and takes into account an overflow
+that has not been served yet, so it never goes back. Differences of Perf_Now()
+are valid up to 14 minutes. Timer3 must run at 0.2us per count (T3_DIV_BY_1 at
+20MHz) without being written after power on.
+
+HISTOGRAMS:
+PerfBuckets buckets of int16 (they stop at 65535). Bucket 0 counts times
+below 256 counts (51us) and each next bucket doubles the limit: 51us, 102us,
+205us, 410us, 819us, 1.6ms, 3.3ms, 6.6ms, 13ms, 26ms, 52ms. The last one
+counts everything above 52ms.
+
+FUNCTIONS:
+Perf_Now(): Current time in Timer3 counts
+Perf_I2C(byte Address, byte Bytes): Count a transaction of a device and its
+bytes on the bus (address bytes included). Called by I2CMaster.h
+Perf_Blocked(int32 Start): Add the time from Start to now to the time lost
+waiting (PerfBlockedUs)
+Perf_Delay_ms(int16 Ms): delay_ms() that counts its time as lost waiting
+Perf_Delay_us(int16 Us): The same with delay_us()
+Perf_Loop(): Call it once in each pass of the main loop
+Perf_StopStart(int32 Detected): An obstacle detected at Detected (Perf_Now())
+has made the program stop the wheels
+Perf_StopEnd(): The stop has reached the motors (nothing left on the I2C bus)
+Perf_WakeStart(): The PIC has woken up from sleep (Power.h)
+Perf_WakeEnd(): The first command after the wake up has been given. The time
+is also kept in PerfWakeLast and PerfWakeMax (counts), as it can be longer
+than the histogram
+Perf_Clear(): Put all the counters to 0
+
+Example:
+
+   Start=Perf_Now();
+   while (I2C_Busy(Slot));
+   Perf_Blocked(Start);
+
+CONFIGURATION:
+Include it after Timers.h and before I2CMaster.h and the drivers.
+*/
+
+#define  PerfDevices       4        //I2C devices counted
+#define  PerfBuckets      12        //Buckets of each histogram
+
+byte  PerfAddress[PerfDevices];     //I2C address of each device
+int32 PerfI2CTrans[PerfDevices];    //Transactions of each device (0: not used)
+int32 PerfI2CBytes[PerfDevices];    //Bytes on the bus for each device
+
+int32 PerfBlockedUs=0;              //us lost waiting (delays, I2C). Wraps
+                                    //around every 71 minutes
+int32 PerfLoops=0;                  //Passes of the main loop
+int32 PerfLoopLast=0;               //Time of the last pass
+int32 PerfLoopMax=0;                //Longest period of the main loop (counts)
+int16 PerfLoopHist[PerfBuckets];    //Histogram of the main loop period
+int16 PerfStopHist[PerfBuckets];    //Histogram of obstacle to wheels stopped
+int32 PerfStopFrom;                 //Time the obstacle was detected
+int1  PerfStopPending=FALSE;        //Waiting for the stop to reach the motors
+int16 PerfWakeHist[PerfBuckets];    //Histogram of wake up to first command
+int32 PerfWakeFrom;                 //Time of the wake up
+int32 PerfWakeLast=0;               //Last wake up to first command (counts)
+int32 PerfWakeMax=0;                //Longest one
+int1  PerfWakePending=FALSE;        //Woken up. No command yet
+
+
+int32 Perf_Now()
+//Time in Timer3 counts (0.2us)
+{
+   int16 Ticks, Count;
+
+   disable_interrupts(GLOBAL);
+   Count=get_timer3();
+   Ticks=TimerTicks;
+   if (interrupt_active(INT_TIMER3) && (Count<0x8000))
+      Ticks++;                         //Overflow not counted yet
+   enable_interrupts(GLOBAL);
+   return (make32(Ticks, Count));
+}
+
+void Perf_Hist(int16 *Hist, int32 Counts)
+//Add a time to a histogram
+{
+   byte Bucket;
+
+   Counts>>=8;
+   for(Bucket=0;(Counts!=0)&&(Bucket<PerfBuckets-1);Bucket++) Counts>>=1;
+   if (Hist[Bucket]!=0xFFFF) Hist[Bucket]++;
+}
+
+void Perf_I2C(byte Address, byte Bytes)
+//Count a transaction of a device
+{
+   byte n;
+
+   for(n=0;n<PerfDevices;n++) {
+      if (PerfI2CTrans[n]==0) PerfAddress[n]=Address;  //New device
+      if (PerfAddress[n]==Address) {
+         PerfI2CTrans[n]++;
+         PerfI2CBytes[n]+=Bytes;
+         return;
+      }
+   }
+}
+
+void Perf_Blocked(int32 Start)
+//Add the time from Start to now to the time lost waiting
+{
+   PerfBlockedUs+=(Perf_Now()-Start)/5;
+}
+
+void Perf_Delay_ms(int16 Ms)
+//Wait some ms, counting them as time lost
+{
+   delay_ms(Ms);
+   PerfBlockedUs+=(int32)Ms*1000;
+}
+
+void Perf_Delay_us(int16 Us)
+//Wait some us, counting them as time lost
+{
+   delay_us(Us);
+   PerfBlockedUs+=Us;
+}
+
+void Perf_Loop()
+//One more pass of the main loop
+{
+   int32 Now, Period;
+
+   Now=Perf_Now();
+   if (PerfLoops!=0) {
+      Period=Now-PerfLoopLast;
+      if (Period>PerfLoopMax) PerfLoopMax=Period;
+      Perf_Hist(PerfLoopHist, Period);
+   }
+   PerfLoopLast=Now;
+   PerfLoops++;
+}
+
+void Perf_StopStart(int32 Detected)
+//The wheels are being stopped because of an obstacle seen at Detected
+{
+   PerfStopFrom=Detected;
+   PerfStopPending=TRUE;
+}
+
+void Perf_StopEnd()
+//The stop of the wheels has been sent to the motors
+{
+   Perf_Hist(PerfStopHist, Perf_Now()-PerfStopFrom);
+   PerfStopPending=FALSE;
+}
+
+void Perf_WakeStart()
+//The PIC has woken up
+{
+   PerfWakeFrom=Perf_Now();
+   PerfWakePending=TRUE;
+}
+
+void Perf_WakeEnd()
+//First command after the wake up
+{
+   PerfWakeLast=Perf_Now()-PerfWakeFrom;
+   if (PerfWakeLast>PerfWakeMax) PerfWakeMax=PerfWakeLast;
+   Perf_Hist(PerfWakeHist, PerfWakeLast);
+   PerfWakePending=FALSE;
+}
+
+void Perf_Clear()
+//All counters to 0
+{
+   byte n;
+
+   for(n=0;n<PerfDevices;n++) {
+      PerfAddress[n]=0;
+      PerfI2CTrans[n]=0;
+      PerfI2CBytes[n]=0;
+   }
+   for(n=0;n<PerfBuckets;n++) {
+      PerfLoopHist[n]=0;
+      PerfStopHist[n]=0;
+      PerfWakeHist[n]=0;
+   }
+   PerfBlockedUs=0;
+   PerfLoops=0;
+   PerfLoopMax=0;
+   PerfStopPending=FALSE;
+   PerfWakeLast=0;
+   PerfWakeMax=0;
+   PerfWakePending=FALSE;
+}
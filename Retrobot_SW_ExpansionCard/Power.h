@@ -0,0 +1,73 @@
+/*
+Library:       Power.h
+Purpose:       Sleep mode of the PIC18F2620, woken up by INT0 (the ZX81) or by
+               the watchdog
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+In Sleep the oscillator stops: the CPU, Timer3 (the tick of Timers.h), Timer0,
+the PWM and the MSSP stop, and the PIC takes a few uA. INT0 and the watchdog
+(it has its own oscillator) go on. A watchdog timeout during Sleep does not
+reset the PIC, it wakes it up. This way the program can look every watchdog
+period (512ms with WDT128) at inputs that have no interrupt, like the PIR on
+RA5, and sleep again if nothing has happened. INT0 wakes the PIC at once.
+The oscillator needs 1024 cycles (205us at 20MHz) to start again, so the byte
+of the transfer that wakes the PIC is lost: the Z80 does not wait that long.
+The ZX81 must wake the card with one byte that is not ZX81_SYNC_IN (ie.
+ZX81_EMPTY) and wait 1ms before sending the frame. The frame receiver of
+ZX81Link.h ignores it when the card is awake.
+
+Time stops while sleeping: TimerTicks and Perf_Now() do not count the time
+slept, so the timers of Timers.h are delayed by it. Power_WdtWakes tells how
+long the PIC has slept (in watchdog periods).
+
+FUNCTIONS:
+Power_Sleep(): Wait until there is nothing left on the I2C bus and sleep until
+INT0 or the watchdog wakes the PIC up. Returns POWER_WAKE_INT0 or
+POWER_WAKE_WDT
+
+Example:
+
+   //Outputs off, then sleep until the PIR sees someone or the ZX81 calls
+   do {
+      Wake=Power_Sleep();
+   } while ((Wake==POWER_WAKE_WDT) && !input(PIR));
+
+CONFIGURATION:
+Include I2CMaster.h before this library. The WDT fuse must be on (it is the
+wake up for the inputs without interrupt) and INT0 enabled (ZX81_Init()) for
+the ZX81 to wake the PIC. The outputs keep their level while sleeping: the
+program must stop the motors and the PWM before calling Power_Sleep().
+*/
+
+#ifdef __PCH__
+#bit  Power_TO     = 0xFD0.3          //RCON. 0: watchdog timeout
+#bit  Power_IDLEN  = 0xFD3.7          //OSCCON. 0: SLEEP stops the oscillator
+#endif
+
+//Wake up causes
+#define  POWER_WAKE_INT0   0          //The ZX81 asked for a transfer
+#define  POWER_WAKE_WDT    1          //Watchdog period over
+
+int16 Power_Sleeps=0;                 //Times the PIC has gone to sleep
+int32 Power_WdtWakes=0;               //Wake ups by the watchdog
+int16 Power_Int0Wakes=0;              //Wake ups by INT0
+
+
+byte Power_Sleep()
+//Sleep until INT0 or the watchdog. Returns the cause of the wake up
+{
+   while (!I2C_Idle()) I2C_Check();   //A Stop cut by Sleep could hang the bus
+   Power_IDLEN=0;                     //Sleep, not Idle
+   Power_Sleeps++;
+   restart_wdt();                     //A whole watchdog period. Sets TO
+   sleep();
+   delay_cycles(1);                   //The instruction after SLEEP runs first
+   if (!Power_TO) {
+      Power_WdtWakes++;
+      return (POWER_WAKE_WDT);
+   }
+   Power_Int0Wakes++;
+   return (POWER_WAKE_INT0);
+}
@@ -52,244 +52,1241 @@ B7    OUT   S2M8
 */
 // LIBRARIES
 #include "RetroBot.h"
+
+//Timers
+#define  TimersNumber    6     //Number of software timers
+#define  TimerNavFwd     0     //Time allowed for forward movement
+#define  TimerDance      1     //Time between dances
+#define  TimerSleep      2     //Time with nobody around before sleeping
+#define  TimerMove       3     //Step of the manoeuvre of a behaviour
+#define  TimerRemote     4     //Wheels left to the ZX81 after a command
+#define  TimerLed        5     //Blinks of the status code
+
+#define  MaxAutoNavFwd   381     //x13.1= 5s aprox
+#define  MaxDance        763     //x13.1= 10s aprox
+#define  SleepAfter     4580     //x13.1= 60s aprox
+#define  RemoteHold      153     //x13.1= 2s aprox
+
+#ifndef I2C_TraceSize
+#define  I2C_TraceSize   256     //Bytes of the trace of the I2C bus
+#endif
+
+#define  MaxDuty 800     //Maximum value of Duty Cycle (100%)
+#define  MinDuty 200     //Duty were the motor stops for sure
+
+#define  ZX81_MaxData     24     //Data of a frame: a block of ZX_UPLOAD
+
+#include "Timers.h"           //Timer3 tick and software timers
+#include "EEPROM.h"           //Writes of the data EEPROM in the background
+#include "Speed.h"            //Speed ramps of the PWM groups of motors
+#include "Thermal.h"          //Duty of the motors limited by the temperature
+#include "Perf.h"             //Performance counters
+#include "I2CMaster.h"        //Interrupt driven I2C bus
 #include "LM75.h"             //Library for LM75 I2C Temperature Sensor 
 #include "MCP23016.h"         //MCP23016 Chip (16 bit IO expander via I2C)
 #include "SRF02.h"            //SRF02 Device (Sonar via I2C)
+#include "Motors.h"           //Motors driven through the MCP23016
+#include "Map.h"              //Dead reckoning and occupancy grid of the room
+#include "Filter.h"           //Outliers, median and closing speed of the sonar
+#include "ZX81Link.h"         //Transfers with the ZX81 through its data bus
+#include "Power.h"            //Sleep, woken up by the ZX81 or the watchdog
 
-//I2C address
-#DEFINE  LM75Address      0x9E  //Temperature sensor
-#DEFINE  SRF02Address     0xE0  //Sonar sensor
+//I2C address (defaults of the configuration)
+#define  LM75Address      0x9E  //Temperature sensor
+#define  SRF02Address     0xE0  //Sonar sensor
 
 //Pins assignment
-#DEFINE  ZX81_WAIT       PIN_A1   //Active low. stop ZX81 clock during a transfer
-#DEFINE  ZX81_DIR        PIN_A2   //Data dir. 1:ZX81->ExpCard, 0:ExpCard->ZX81
-#DEFINE  Relay           PIN_A3   //Relay control
-#DEFINE  PIR             PIN_A5   //PIR signal
-#DEFINE  ZX81_READY      PIN_B0   //Indicate ZX81 is ready for a read or write
-#DEFINE  DataLine0       PIN_C5   //Data line 0
-#DEFINE  LED             PIN_C6   //Test led
+#define  ZX81_WAIT       PIN_A1   //Active low. stop ZX81 clock during a transfer
+#define  ZX81_DIR        PIN_A2   //Data dir. 1:ZX81->ExpCard, 0:ExpCard->ZX81
+#define  Relay           PIN_A3   //Relay control
+#define  PIR             PIN_A5   //PIR signal
+#define  PWM2            PIN_C1   //PWM2 for motors
+#define  PWM1            PIN_C2   //PWM1 for motors
+#define  ZX81_READY      PIN_B0   //Indicate ZX81 is ready for a read or write
+#define  DataLine0       PIN_C5   //Data line 0
+#define  LED             PIN_C6   //Test led
 
 //Motors control
-#DEFINE  FORWARD         255      //Forward for motors
-#DEFINE  BACKWARD          0      //Backward for motors
-#DEFINE  STOP            128      //Stop for motors
-#DEFINE  ACTIVATE          0      //ACTIVATE for motors
-#DEFINE  OPEN            255      //OPEN for motors
-#DEFINE  CLOSE             0      //CLOSE for motors
-#DEFINE  UP              255      //Move up for motors
-#DEFINE  DOWN              0      //Move down for motors
-
-#DEFINE  MaxDuty 800     //Maximum value of Duty Cycle (100%)
-#DEFINE  MinDuty 200     //Duty were the motor stops for sure
+#define  FORWARD         255      //Forward for motors
+#define  BACKWARD          0      //Backward for motors
+#define  STOP            128      //Stop for motors
+#define  ACTIVATE          0      //ACTIVATE for motors
+#define  OPEN            255      //OPEN for motors
+#define  CLOSE             0      //CLOSE for motors
+#define  UP              255      //Move up for motors
+#define  DOWN              0      //Move down for motors
+
+//Speed of the motors (Speed.h): 0 stopped, 255 full
+#define  WheelsGroup       1      //PWM group of the wheels and shoulders
+#define  ArmsGroup         2      //PWM group of maraca, hand, arm and light
+#define  WheelsFull  Config[CFG_WHEELS_FULL]   //Going ahead and turning
+#define  WheelsBack  Config[CFG_WHEELS_BACK]   //Backing up, seeing nothing
+#define  ArmsSpeed   Config[CFG_ARMS_SPEED]    //Maraca, hand, arm and light
+
+#define  CardIO            0      //MCP23016 of the card (device number)
+
+//Configuration (Config.h). Data EEPROM: 0x000 calibration of the map (Map.h),
+//0x010 and 0x040 the two copies of the configuration, 0x100 and 0x280 the two
+//banks of motion scripts (MotionScript.h, Upload.h). A configuration written
+//by the ZX81 (ZX_CONFIG, ZX_UPLOAD) is used from the next power on
+#define  ConfigSize       41
+#define  CFG_IO_ADDR       0      //MCP23016 of the card
+#define  CFG_SONAR_ADDR    1      //Front SRF02
+#define  CFG_TEMP_ADDR     2      //LM75
+#define  CFG_WHEELS_FULL   3      //Speed of the wheels: ahead and turning
+#define  CFG_WHEELS_BACK   4      //  backing up
+#define  CFG_ARMS_SPEED    5      //Speed of the group of the arms
+#define  CFG_RAMP          6      //Duty counts per tick of the ramps (Speed.h)
+#define  CFG_ESCAPE_CM     7      //Closer than this: back up
+#define  CFG_AVOID_CM      8      //Closer than this: turn
+#define  CFG_MOTORS        9      //Motor map, 4 bytes a motor from motor 1:
+                                  //device, pin S1, pin S2 (0 to 15) and PWM
+                                  //group (Motors.h). Device 0xFF: the map of
+                                  //Motors.h for that motor
+#define  CFG_DEFAULT_MAP 0xFF, 0, 0, 0
+
+const byte ConfigDefault[ConfigSize]={
+   MCP23016Address, SRF02Address, LM75Address,
+   255, 160, 128,                    //Speeds (128: duty 500)
+   SpeedAccel,
+   25, 50,                           //cm
+   CFG_DEFAULT_MAP, CFG_DEFAULT_MAP, CFG_DEFAULT_MAP, CFG_DEFAULT_MAP,
+   CFG_DEFAULT_MAP, CFG_DEFAULT_MAP, CFG_DEFAULT_MAP, CFG_DEFAULT_MAP};
+
+#include "Config.h"           //Configuration in the data EEPROM
+
+//Boot: chips looked for on the bus (Boot_Devices). The led blinks
+//Boot_Status&7 + 1 times: 1 all there, 2 no MCP23016, 3 no SRF02, 5 no LM75,
+//and the sums (4: neither the MCP23016 nor the SRF02 ...)
+#define  BOOT_NO_IO     0x01      //No MCP23016: the motors do not move
+#define  BOOT_NO_SONAR  0x02      //No SRF02: escape keeps the wheels stopped
+#define  BOOT_NO_TEMP   0x04      //No LM75: temperature not sampled
+#define  BOOT_MOVED     0x08      //A chip answered at another address
+#define  BOOT_DEFAULTS  0x10      //No configuration in the EEPROM
+#define  BootWait          4      //x13.1= 52ms for chips still powering up
+#define  LedBlinkTicks    15      //x13.1= 200ms on, 200ms off
 
 //Motor assignment
-#DEFINE  Maraca            1      //Motor assigned to Maraca
-#DEFINE  Hand_R            2      //Motor assigned to Hand of right arm
-#DEFINE  Arm_R             3      //Motor assigned to right arm
-#DEFINE  Light_R           4      //Motor assigned to light of right arm
-#DEFINE  Wheel_R           5      //Motor assigned to right wheel
-#DEFINE  Wheel_L           6      //Motor assigned to left wheel
-#DEFINE  Shoulder_R        7      //Motor assigned to shoulder of right arm
-#DEFINE  Shoulder_L        8      //Motor assigned to shoulder of left arm
+#define  Maraca            1      //Motor assigned to Maraca
+#define  Hand_R            2      //Motor assigned to Hand of right arm
+#define  Arm_R             3      //Motor assigned to right arm
+#define  Light_R           4      //Motor assigned to light of right arm
+#define  Wheel_R           5      //Motor assigned to right wheel
+#define  Wheel_L           6      //Motor assigned to left wheel
+#define  Shoulder_R        7      //Motor assigned to shoulder of right arm
+#define  Shoulder_L        8      //Motor assigned to shoulder of left arm
+
+//Sensors and outputs used by motion scripts (SC_BRLT, SC_BRGE and SC_OUT)
+#define  SENS_DISTANCE     0      //Sonar distance in cm
+#define  SENS_PIR          1      //PIR status (0 or 1)
+#define  SENS_TEMP         2      //Temperature of the card
+#define  OUT_RELAY         0      //Relay (audio cassette). 0 off, 1 on
+#define  OUT_LED           1      //Test led. 0 off, 1 on
+
+#include "MotionScript.h"     //Interpreter of motion scripts
+#include "Scripts.h"          //Motion scripts in program memory
+
+#define  UploadBlock (ZX81_MaxData-4)   //Data of ZX_UPLOAD after Op, Block, CRC
+#include "Upload.h"           //Scripts and configuration sent by the ZX81
+
+
+//Tasks
+#define  SchedTasks      7     //Number of tasks of the scheduler
+#define  TaskSense       0     //Read sensors
+#define  TaskNav         1     //Behaviours: who drives the wheels
+#define  TaskDance       2     //Dance with maraca
+#define  TaskZX81        3     //Commands from the ZX81
+#define  TaskScript      4     //Motion script running
+#define  TaskPower       5     //Sleep while nobody is around
+#define  TaskUpload      6     //Upload of the ZX81 to the data EEPROM
 
+#define  Ticks100ms      8     //x13.1= 105ms
+#define  MaxSonarFails   3     //Rangings lost in a row before stopping
+#define  Ticks1s        76     //x13.1= 996ms
+#define  BehaviourEvery  4     //x13.1= 52ms. Behaviours run at least this often
 
-//Counters
-#DEFINE  MaxCounters    2     //Number of multipurpose counters
-#DEFINE  AutoNavFwd     0     //counter for allowing forward movement
-#DEFINE  Dance          1     //counter for dance times
+//Sensors, highest priority first (Sensors.h): period and maximum age of
+//their values in ticks
+#define  SensorsNumber   3
+#define  SENSOR_SONAR    0     //Front sonar: Distance
+#define  SENSOR_PIR      1     //PIR: PIRStatus
+#define  SENSOR_TEMP     2     //LM75: Temperature
+#define  SonarEvery      0     //As fast as it ranges (70ms)
+#define  SonarMaxAge    20     //x13.1= 262ms. Older: blind
+#define  SonarFar      600     //cm taken for a ranging without echo
+#define  SonarLeadMs   200     //Ahead of the range: the wheels stop this late
 
-#DEFINE  MaxAutoNavFwd   381     //x13.1= 5s aprox
-#DEFINE  MaxDance        763     //x13.1= 10s aprox
+//Filtered sensors (Filter.h)
+#define  FILTER_FRONT    0     //Front sonar: Range
+#define  PIREvery        8     //x13.1= 105ms
+#define  PIRMaxAge      76     //x13.1= 1s
+#define  TempEvery      76     //x13.1= 1s
+#define  TempMaxAge    229     //x13.1= 3s
+
+//Behaviours, highest priority first (Behaviours.h)
+#define  BehavioursNumber 5
+#define  BEH_ESCAPE      0     //Too close: back up. Sonar lost or old: stop
+#define  BEH_REMOTE      1     //The ZX81 has moved the wheels or runs a script
+#define  BEH_DANCE       2     //Script SCRIPT_DANCE moves the wheels
+#define  BEH_AVOID       3     //Obstacle ahead: turn until the way is clear
+#define  BEH_WANDER      4     //Go ahead, and turn a bit now and then
+
+#define  EscapeCm      Config[CFG_ESCAPE_CM]   //Closer than this: back up
+#define  EscapeClearCm (EscapeCm+10)           //  until this far
+#define  AvoidCm       Config[CFG_AVOID_CM]    //Closer than this: turn
+#define  AvoidClearCm  (AvoidCm+20)            //  until this far
+#define  AvoidMinTurn    38    //x13.1= 0.5s. The sonar only looks ahead: a
+                               //shorter turn can leave a wall at the side
+#define  WanderMaxTurn  229    //x13.1= 3s. Longest turn to the open space
+#define  TurnNear         3    //Turn done this near the heading (x1.4 deg)
+#define  PoseDriveLag     3    //2^3 ticks (0.1s): a wheel gets to its speed
+#define  PoseCoastLag     4    //2^4 ticks (0.2s): a free wheel slows down
+#define  PoseMaxTicks    76    //1s. Longest time the pose is moved at once
+
+//Steps of the manoeuvres of avoid and wander (TaskStep[TaskNav])
+#define  NAV_PAUSE       0     //Stopped for TimerMove (and a fresh range)
+#define  NAV_FORWARD     1     //Going ahead while there is no obstacle
+#define  NAV_TURN        2     //Turning
+#define  NAV_BRAKE       3     //Slowing down before turning
+
+//Steps of dance task
+#define  DANCE_WAIT      0     //Waiting for the time of the dance
+#define  DANCE_RUN       1     //Script SCRIPT_DANCE running
+
+//Commands of the ZX81 (frames of ZX81Link.h)
+#define  ZX_PING      0x01     //Answer: version of the program
+#define  ZX_MOTORS    0x10     //Data: couples Motor,Direction. All changed at once
+#define  ZX_SENSORS   0x20     //Answer: Distance,Temperature,PIR,Motors(2 bytes)
+#define  ZX_AUTONAV   0x30     //Data: 1 auto navigation on, 0 off
+#define  ZX_SCRIPT   0x40     //Data: number of script to run (none: stop it).
+                              //It drives the wheels as BEH_REMOTE: it ends a
+                              //dance, and it is not run (answer 0) while
+                              //escape has the wheels
+#define  ZX_PERF     0x50     //Data: page of performance counters (Perf.h)
+#define  ZX_TRACE    0x60     //Trace of the I2C bus (I2CMaster.h). Data: 1
+                              //start (empties it), 0 stop. Answer: transactions
+                              //dropped(2). No data: answer the oldest whole
+                              //transactions, up to TraceChunk bytes
+#define  ZX_SPEED    0x70     //Data: PWM group, Speed (0 to 255), Ramp (duty
+                              //counts per tick, optional). The wheels take
+                              //the speed with the next ZX_MOTORS
+#define  ZX_CONFIG   0x90     //No data: answer Boot status, ConfigSize. Data:
+                              //Offset, answer up to 8 bytes of the
+                              //configuration from there. Data: Offset, Bytes:
+                              //write them, saved in the background (speeds
+                              //and distances at once, the rest from the
+                              //next power on). Data: CONFIG_DEFAULTS: save
+                              //the defaults. No answer while an upload is
+                              //being written (Upload.h). A write or
+                              //CONFIG_DEFAULTS after a ZX_UPLOAD of the
+                              //configuration, until the next power on, is
+                              //refused: answer UPLOAD_BUSY (1 byte)
+#define  CONFIG_DEFAULTS 0xFF
+#define  ZX_MAP      0x80     //No data: answer X cm(2), Y cm(2), Heading (256
+                              //per turn). Data: row n of the grid, answer its
+                              //MapSize/4 bytes (Map.h). Data: MAP_CALIBRATE,
+                              //Speed(2), Turn(2): new calibration, saved in
+                              //the background (no answer: try again)
+#define  MAP_CALIBRATE 0xFF
+#define  ZX_UPLOAD   0xA0     //Upload of an image (Upload.h). Data: Op, then
+                              //UP_BEGIN: Target, Length(2). Answer: Status,
+                              //  block size
+                              //UP_BLOCK: Block, CRC(2), Data. Answer: Status,
+                              //  block expected
+                              //UP_END: CRC(2) of the image. Answer: Status.
+                              //  The image is written in the background (a
+                              //  configuration is used from the next power
+                              //  on)
+                              //UP_STATUS: answer Status of the last Op, State,
+                              //  Bank of the scripts (0, 1 or 0xFF none), Seq,
+                              //  bytes written(2)
+                              //UP_ABORT: answer Status
+#define  UP_BEGIN         0
+#define  UP_BLOCK         1
+#define  UP_END           2
+#define  UP_STATUS        3
+#define  UP_ABORT         4
+
+//Pages of ZX_PERF. Values of more than one byte are sent high byte first
+#define  PERF_I2C        0     //Data[1]: device n. Address, Transactions(4),
+                               //Bytes(4)
+#define  PERF_TIME       1     //Blocked us(4), Loops(4), Max loop period us(4)
+#define  PERF_LOOP       2     //Histogram of main loop period (12 x 2 bytes)
+#define  PERF_STOP       3     //Histogram of obstacle to wheels stopped
+#define  PERF_ERRORS     4     //I2C bus clears(2), then for each device with
+                               //errors: Address, Failed transactions(2)
+#define  PERF_WAKE       5     //Histogram of wake up to first command
+#define  PERF_POWER      6     //Sleeps(2), Wakes by watchdog(4) and by
+                               //ZX81(2), Wake up to first command: last us(4),
+                               //max us(4)
+#define  PERF_BEHAVIOURS 7     //Data[1]: behaviour n. Owners taken over(2),
+                               //Times n took the wheels(2), Ticks(4)
+#define  PERF_SENSORS    8     //Data[1]: sensor n. Samples(2), Failed(2),
+                               //Values too old(2), Longest start after due
+                               //(ticks, 2), Age of the value (ticks, 2)
+#define  PERF_THERMAL    9     //Temperature, Peak (0x80: none read yet,
+                               //ThermalNone), Throttles(2), Seconds
+                               //derated(2), Duty limit now(2), Lowest(2)
+#define  PERF_CLEAR   0xFF     //All counters to 0. No data
+
+//Snapshot read by the ZX81 in one burst (see ZX81Link.h), published after
+//each sonar ranging: Distance, Temperature, PIR, Motors(2 bytes, as
+//ZX_SENSORS), AutoNavMode, Behaviour driving the wheels, Script running, Sonar
+//rangings lost in a row, TimerTicks(2), I2C bus clears(2), ZX81 frame errors,
+//ZX81 bytes lost, Version. Values of two bytes are sent high byte first,
+//except Motors
+
+#define  Version      0x01     //Version of the program sent to the ZX81
+#define  TraceChunk     24     //Bytes of trace in an answer to ZX_TRACE
+#define  ConfigChunk     8     //Bytes of configuration in an answer
+
+#include "Scheduler.h"        //Cooperative scheduler of tasks
+#include "Behaviours.h"       //Behaviours that take the wheels by priority
+#include "Sensors.h"          //Sampling of the sensors, each at its rate
 
 
 byte  Temperature=0;             //Temperature of the card
-byte  Distance=0;                //Value in cm of distance to obstacle 8bit
+byte  Distance=0;                //Range in 8 bit (255: that or farther)
+int16 Range=SonarFar;            //Filtered range in cm (Filter.h)
+int1  DistanceNew=FALSE;         //A new value of Distance has been read
+int32 DistanceAt;                //Time Distance was read (Perf_Now())
+int16 MotorErrors[MCP23016Devices]; //I2C errors of each MCP23016 seen
 int1  PIRStatus=FALSE;           //Status of PIR sensor
+byte  TempSlot;                  //I2C read of the temperature in progress
+int16 PoseTick;                  //Tick the pose was last moved to
+sint16 PoseWheel[2];             //Speed of the right and left wheels now
+byte  NavTarget;                 //Heading a turn goes to (Map_Angle())
+int1  NavLeft;                   //The turn is to the left
 
 int1  AutoNavMode=FALSE;      //Indicate if auto navigation mode is active
-int16 Counter[MaxCounters];         //Multipurpose counters incremented by interrupt
-
-int16  i;                            //Used for local FOR loops
+byte  RemoteSpeed;            //Speed of the wheels moved by the ZX81
+int1  RemoteScript=FALSE;     //The script running is of ZX_SCRIPT (BEH_REMOTE)
+byte  Boot_Status=0;          //BOOT_NO_IO ... found at power on
+byte  LedHalves=0;            //Halves of blinks left of the status code
+byte  UploadStatus=UPLOAD_IDLE; //Status of the last ZX_UPLOAD
 
 
 
+#ifdef __PCH__
 #INT_TIMER3
-//Timer3 Interrupt. Used for several multipurpose counters Counter[]
-//overflows every 13.1ms incrementing all counters by 1
+#endif
+//Timer3 Interrupt. Overflows every 13.1ms. One tick of the time of the
+//program (Timers.h). The timers expire in Timer_Service()
 void Timer3_isr() 
 {
-   byte NumCounter;
+   Timer_Tick();
+   Speed_Tick();                 //A step of the speed ramps
+}
+
+
+void Led_Step ()
+//Next half of a blink of the status code
+{
+   if (LedHalves==0) return;
+   LedHalves--;
+   if (LedHalves & 1) output_high(LED);
+   else output_low(LED);
+   Timer_Start(TimerLed, LedBlinkTicks);
+}
 
-   for(NumCounter=0;NumCounter<MaxCounters;NumCounter++)
-      Counter[NumCounter]++;
+void Led_Show (byte Blinks)
+//Blink the led some times, without waiting
+{
+   LedHalves=Blinks*2;
+   Led_Step();
 }
 
 
-void InitGeneralPurposeCounters() 
-//Put all general purpose counters to 0
+void Timer_Expired (byte Timer)
+//A timer has expired (called by Timer_Service from the main loop)
 {
-   byte NumCounter;
+   switch (Timer) {
+      case TimerDance:
+         Sched_Resume(TaskDance);            //Time to dance
+         break;
+      case TimerSleep:
+         Sched_Resume(TaskPower);            //Nobody around
+         break;
+      case TimerMove:
+      case TimerRemote:
+         Sched_Sleep(TaskNav, 0);            //Next step of the behaviours
+         break;
+      case TimerLed:
+         Led_Step();
+         break;
+   }
+}
 
-   for(NumCounter=0;NumCounter<MaxCounters;NumCounter++)
-      Counter[NumCounter]=0;
-}   
+byte Boot_Find (byte Address, byte First, byte Last)
+//Address of a chip: the one configured, or the first of its range that
+//answers (0 if none)
+{
+   byte Found;
+
+   if (I2C_Probe(Address)) return (Address);
+   Found=I2C_Scan(First, Last);
+   if (Found!=0) Boot_Status|=BOOT_MOVED;
+   return (Found);
+}
 
-void Blink (byte blinks)
-//Blinks card led
+void Boot_Devices ()
+//Look for the chips of the card. The addresses found go to Config[] (not
+//saved). Waits BootWait at most for a chip that does not answer
 {
-   byte i;
-   for(i=1;i<=blinks;i++) {
-      output_high(LED);
-      delay_ms(100);
-      output_low(LED);
-      delay_ms(100);              
+   byte IO=0, Sonar=0, Temp=0;
+   int16 Start;
+
+   Start=Timer_Now();
+   do {
+      if (IO==0) IO=Boot_Find(Config[CFG_IO_ADDR], 0x40, 0x4E);
+      if (Sonar==0) Sonar=Boot_Find(Config[CFG_SONAR_ADDR], 0xE0, 0xFE);
+      if (Temp==0) Temp=Boot_Find(Config[CFG_TEMP_ADDR], 0x90, 0x9E);
+      restart_wdt();
+   } while (((IO==0)||(Sonar==0)||(Temp==0))&&(Timer_Now()-Start<BootWait));
+   if (IO!=0) Config[CFG_IO_ADDR]=IO;
+   else Boot_Status|=BOOT_NO_IO;
+   if (Sonar!=0) Config[CFG_SONAR_ADDR]=Sonar;
+   else Boot_Status|=BOOT_NO_SONAR;
+   if (Temp!=0) Config[CFG_TEMP_ADDR]=Temp;
+   else Boot_Status|=BOOT_NO_TEMP;
+}
+
+void Boot_Motors ()
+//Motor map: Motors.h, with the motors the configuration changes
+{
+   byte m, n;
+
+   Motor_MapInit();
+   for(m=0;m<MotorsNumber;m++) {
+      n=CFG_MOTORS+m*4;
+      if (Config[n]!=0xFF)
+         Motor_Map(m+1, Config[n], Config[n+1], Config[n+2], Config[n+3]);
    }
 }
 
 
-void SetMotor (byte MotorNum, Direction)
-//Control the direction of the 8 motors
-//Direction 128:Stop, >128:Forward, <128:backwards
+void SetWheels (byte Right, byte Left, byte Speed)
+//Direction of both wheels, changed at the same time, and their speed. A wheel
+//that starts or turns round starts slow and ramps up to Speed (Motors.h).
+//Stopping is immediate and keeps the speed for the next start
 {
-   switch (MotorNum) {
-      case 1:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_A0);
-            MCP23016_output_low  (MCP23016_PIN_A1);
-         }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_A0);
-            MCP23016_output_high (MCP23016_PIN_A1);
-         }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_A0|MCP23016_PIN_A1);         
-         }
+   if ((Right!=STOP)||(Left!=STOP)) Speed_Set(WheelsGroup, Speed);
+   Motor_Stage (Wheel_R, Right);
+   Motor_Stage (Wheel_L, Left);
+   Motor_Commit ();
+   if (PerfWakePending && ((Right!=STOP)||(Left!=STOP)))
+      Perf_WakeEnd();                        //Moving again after sleeping
+}
+
+
+void PWM_On ()
+//PWM 1 & 2 aprox 25KHz for the motors
+{
+   setup_ccp1(CCP_PWM);
+   setup_ccp2(CCP_PWM);
+   Speed_Write();                //Duties of the groups (Speed.h)
+}
+
+
+void PWM_Off ()
+//PWM outputs off and low, so the H-bridges take no current
+{
+   setup_ccp1(CCP_OFF);
+   setup_ccp2(CCP_OFF);
+   output_low(PWM1);
+   output_low(PWM2);
+}
+
+
+byte Script_Sensor (byte Sensor)
+//Value of a sensor for the motion scripts
+{
+   switch (Sensor) {
+      case SENS_DISTANCE:  return (Distance);
+      case SENS_PIR:       return (PIRStatus);
+      case SENS_TEMP:      return (Temperature);
+   }
+   return (0);
+}
+
+void Script_Output (byte Output, byte Value)
+//Set an output from the motion scripts
+{
+   switch (Output) {
+      case OUT_RELAY:
+         if (Value) output_high(Relay);      //Relay (Casete) signal on
+         else output_low(Relay);
          break;
-      case 2:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_A2);
-            MCP23016_output_low  (MCP23016_PIN_A3);
-         }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_A2);
-            MCP23016_output_high (MCP23016_PIN_A3);
-         }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_A2|MCP23016_PIN_A3);         
-         }
+      case OUT_LED:
+         if (Value) output_high(LED);
+         else output_low(LED);
          break;
-      case 3:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_A4);
-            MCP23016_output_low  (MCP23016_PIN_A5);
-         }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_A4);
-            MCP23016_output_high (MCP23016_PIN_A5);
-         }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_A4|MCP23016_PIN_A5);         
+   }
+}
+
+void RunScript (byte Script)
+//Start a motion script (stops the one running)
+{
+   Speed_Set(WheelsGroup, WheelsFull);      //Other speeds with SC_PWM
+   Script_Run(Script);
+   Sched_Resume(TaskScript);
+}
+
+void StopScript ()
+//Stop the motion script, the motors it moves but the wheels (their new owner
+//sets them) and the relay
+{
+   byte m;
+
+   Script_Stop();
+   for(m=1;m<=MotorsNumber;m++)
+      if ((m!=Wheel_R)&&(m!=Wheel_L)) Motor_Stage (m, STOP);
+   Motor_Commit ();
+   output_low(Relay);
+}
+
+void Dance_End ()
+//The dance is over or taken over: wait for the next one
+{
+   Timer_Start(TimerDance, MaxDance);
+   Sched_Suspend(TaskDance);
+   TaskStep[TaskDance]=DANCE_WAIT;
+}
+
+
+void Snapshot ()
+//Publish the state for the ZX81. Skipped if it is still reading the old one
+{
+   if (!ZX81_SnapStart()) return;
+   ZX81_SnapByte(Distance);
+   ZX81_SnapByte(Temperature);
+   ZX81_SnapByte(PIRStatus);
+   ZX81_SnapByte(make8(MCP23016_Latch[CardIO],0));
+   ZX81_SnapByte(make8(MCP23016_Latch[CardIO],1));
+   ZX81_SnapByte(AutoNavMode);
+   ZX81_SnapByte(Behaviour_Owner);
+   ZX81_SnapByte(Script_Running);
+   ZX81_SnapByte(SRF02_Fails[0]);
+   ZX81_SnapByte(make8(TimerTicks,1));
+   ZX81_SnapByte(make8(TimerTicks,0));
+   ZX81_SnapByte(make8(I2C_Recoveries,1));
+   ZX81_SnapByte(make8(I2C_Recoveries,0));
+   ZX81_SnapByte(ZX81_Errors);
+   ZX81_SnapByte(ZX81_Overruns);
+   ZX81_SnapByte(Version);
+   ZX81_SnapPublish();
+}
+
+
+sint16 WheelDrive (byte Motor, sint16 Speed)
+//Speed a wheel is driven at, from its direction now
+{
+   switch (Motor_Direction(Motor)) {
+      case FORWARD:  return (Speed);
+      case BACKWARD: return (-Speed);
+   }
+   return (0);
+}
+
+void WheelLag (byte w, sint16 Drive)
+//A tick of the speed of a wheel: the motor does not get to the speed it is
+//driven at at once, and a wheel left free goes on for a while
+{
+   if (Drive!=0) PoseWheel[w]+=(Drive-PoseWheel[w])>>PoseDriveLag;
+   else PoseWheel[w]-=PoseWheel[w]>>PoseCoastLag;
+}
+
+void Pose ()
+//Move the pose (Map.h) with what the wheels have done since the last call.
+//Not moved if the chip of the wheels is missing or a write to it has failed
+//since the last call: its outputs are not known
+{
+   int16 Now, Ticks, Speed;
+   sint16 Right, Left;
+   byte Dev;
+
+   Now=Timer_Now();
+   Ticks=Now-PoseTick;
+   if (Ticks==0) return;
+   if (Ticks>PoseMaxTicks) Ticks=PoseMaxTicks;   //After sleeping
+   PoseTick=Now;
+   Dev=MotorMapDev[Wheel_R-1];
+   if ((Boot_Status & BOOT_NO_IO)||
+       (I2C_Errors(MCP23016_Address[Dev])!=MotorErrors[Dev])) return;
+   Speed=(int16)(((int32)Speed_Now(WheelsGroup)*256)/MaxDuty);
+   Right=WheelDrive(Wheel_R, (sint16)Speed);
+   Left=WheelDrive(Wheel_L, (sint16)Speed);
+   while (Ticks-->0) {
+      WheelLag(0, Right);
+      WheelLag(1, Left);
+      Map_Move(PoseWheel[0], PoseWheel[1], 1);
+   }
+}
+
+
+byte Sensor_Sample (byte S, int1 First)
+//A step of the sample of a sensor (Sensors.h). Never waits
+{
+   int16 Raw;
+
+   switch (S) {
+      case SENSOR_SONAR:
+         if (First) {
+            if (SRF02_State==SRF02_IDLE) SRF02_StartAll(TRUE);  //Ping all
+            return (SENSOR_BUSY);
          }
-         break;
-      case 4:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_A6);
-            MCP23016_output_low  (MCP23016_PIN_A7);
+         if (SRF02_State==SRF02_IDLE) return (SENSOR_FAIL);   //Discarded
+         if (!SRF02_Ready()) return (SENSOR_BUSY);
+         Raw=SRF02_Collect_16();                //Get Sonar range
+         if (SRF02_Fails[0]!=0) {
+            Snapshot();
+            return (SENSOR_FAIL);
          }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_A6);
-            MCP23016_output_high (MCP23016_PIN_A7);
+         if (Raw==0) Raw=SonarFar;              //No echo: nothing in range
+         DistanceAt=Perf_Now();
+         if (Filter_Put(FILTER_FRONT, Raw, DistanceAt))
+            Map_Range(SRF02_Range);             //Into the grid, if it is good
+         Range=Filter_Value[FILTER_FRONT];
+         Distance=(Range>255) ? 255 : (byte)Range;
+         DistanceNew=TRUE;
+         Sched_Sleep(TaskNav, 0);               //React to it in this pass
+         Snapshot();
+         Sensor_Put(S, Range);
+         return (SENSOR_DONE);
+      case SENSOR_PIR:
+         PIRStatus=input(PIR);
+         if (PIRStatus) Timer_Start(TimerSleep, SleepAfter);   //Someone around
+         Sensor_Put(S, PIRStatus);
+         return (SENSOR_DONE);
+      case SENSOR_TEMP:
+         if (First) {
+            TempSlot=LM75_TempStart(Config[CFG_TEMP_ADDR]);
+            return (SENSOR_BUSY);
          }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_A6|MCP23016_PIN_A7);         
+         if (I2C_Busy(TempSlot)) return (SENSOR_BUSY);
+         Temperature=LM75_TempCollect(TempSlot);
+         if (LM75_Failed) return (SENSOR_FAIL);
+         Thermal_Update(Temperature);           //Duty limit of the motors
+         Sensor_Put(S, Temperature);
+         return (SENSOR_DONE);
+   }
+   return (SENSOR_FAIL);
+}
+
+
+void SenseTask ()
+//Sample the sensors, each one at its rate. The sonar ranging and the I2C
+//reads go on while other tasks run
+{
+   byte Dev;
+
+   Pose();                                   //Before the new ranges
+   Sensor_Service();
+   for(Dev=0;Dev<MCP23016_Count;Dev++)
+      if (I2C_Errors(MCP23016_Address[Dev])!=MotorErrors[Dev]) {
+         MotorErrors[Dev]=I2C_Errors(MCP23016_Address[Dev]);
+         MCP23016_Latch_Refresh(Dev);         //A write could be lost
+      }
+   Sched_Sleep(TaskSense, 0);          //Each pass: the sonars are polled
+}
+
+
+int1 Sonar_Blind ()
+//True if the sonar has stopped answering or its range is too old
+{
+   return ((SRF02_Fails[0]>=MaxSonarFails)||!Sensor_Fresh(SENSOR_SONAR));
+}
+
+
+int16 Sonar_Ahead ()
+//Range the wheels will stop at: the filtered range less what the obstacle
+//closes in before they react
+{
+   sint16 Ahead;
+   int16 Ms;
+
+   Ms=(int16)((Perf_Now()-DistanceAt)/5000)+SonarLeadMs;
+   Ahead=Filter_Predict(FILTER_FRONT, Ms);
+   if (Ahead<0) return (0);
+   if (Ahead>(sint16)Range) return (Range);  //Going away: not farther
+   return ((int16)Ahead);
+}
+
+void Sonar_Brake ()
+//Call it before stopping the wheels or backing up. If they were going ahead or
+//turning with an obstacle in front (Sonar_Ahead, as escape and avoid see it),
+//time how long the stop takes to get to the motors (PerfStopHist)
+{
+   byte R, L;
+
+   if (PerfStopPending || Sonar_Blind()) return;   //Timing one already
+   R=Motor_Direction(Wheel_R);
+   L=Motor_Direction(Wheel_L);
+   if ((R==STOP)&&(L==STOP)) return;               //Stopped already
+   if ((R==BACKWARD)&&(L==BACKWARD)) return;       //Going away
+   if (Sonar_Ahead()<AvoidCm) Perf_StopStart(DistanceAt);
+}
+
+
+int1 Behaviour_Wants (byte B)
+//True if the behaviour wants the wheels now (Behaviour_Arbitrate)
+{
+   int1 Owner=(Behaviour_Owner==B);          //Going on: looser limits
+
+   switch (B) {
+      case BEH_ESCAPE:
+         if (!AutoNavMode) return (FALSE);
+         if (Sonar_Blind()) return (TRUE);
+         if (Owner) return (Range<EscapeClearCm);
+         return (Sonar_Ahead()<EscapeCm);
+      case BEH_REMOTE:
+         return (Timer_Running(TimerRemote)||RemoteScript);
+      case BEH_DANCE:
+         return (TaskStep[TaskDance]==DANCE_RUN);
+      case BEH_AVOID:
+         if (!AutoNavMode) return (FALSE);
+         if (Owner && ((TaskStep[TaskNav]!=NAV_TURN)||!Timer_Fired(TimerMove)))
+            return (TRUE);                   //Turn at least AvoidMinTurn
+         if (Owner) return (Range<AvoidClearCm);   //Turning: no closing speed
+         return (Sonar_Ahead()<AvoidCm);
+      case BEH_WANDER:
+         return (AutoNavMode);
+   }
+   return (FALSE);
+}
+
+void Nav_Pause (byte Ticks)
+//Stop the wheels for a while before the next manoeuvre
+{
+   SetWheels (STOP, STOP, 0);
+   Timer_Start(TimerMove, Ticks);
+   TaskStep[TaskNav]=NAV_PAUSE;
+}
+
+void Nav_Turn (sint8 Turn)
+//Turn on the spot (positive: left) towards a heading
+{
+   NavLeft=(Turn>0);
+   NavTarget=Map_Angle()+(byte)Turn;
+   if (NavLeft) SetWheels (FORWARD, BACKWARD, WheelsFull);
+   else SetWheels (BACKWARD, FORWARD, WheelsFull);
+   TaskStep[TaskNav]=NAV_TURN;
+}
+
+int1 Nav_Turned ()
+//True if the turn has got to its heading
+{
+   sint8 Left;
+
+   Left=(sint8)(NavTarget-Map_Angle());     //Still to turn
+   if (NavLeft) return (Left<=TurnNear);
+   return (Left>=-TurnNear);
+}
+
+void Behaviour_Run (byte B, int1 First)
+//The behaviour owns the wheels. First: it has just taken them
+{
+   switch (B) {
+      case BEH_ESCAPE:
+         if (Sonar_Blind()) {
+            SetWheels (STOP, STOP, 0);       //Blind
+            break;
          }
+         Sonar_Brake();
+         SetWheels (BACKWARD, BACKWARD, WheelsBack);
          break;
-      case 5:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_B0);
-            MCP23016_output_low  (MCP23016_PIN_B1);
-         }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_B0);
-            MCP23016_output_high (MCP23016_PIN_B1);
-         }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_B0|MCP23016_PIN_B1);         
-         }
+      case BEH_REMOTE:
+         if (First && RemoteScript)          //From still: the script of the
+            SetWheels (STOP, STOP, 0);       //ZX81 moves them
          break;
-      case 6:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_B2);
-            MCP23016_output_low  (MCP23016_PIN_B3);
-         }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_B2);
-            MCP23016_output_high (MCP23016_PIN_B3);
-         }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_B2|MCP23016_PIN_B3);         
+      case BEH_AVOID:
+         if (First) {                        //Stop, then turn while the
+            Sonar_Brake();                   //sonar goes on ranging
+            Nav_Pause(Ticks100ms);
+            break;
          }
+         if ((TaskStep[TaskNav]!=NAV_PAUSE)||!Timer_Fired(TimerMove)) break;
+         Nav_Turn(Map_BestTurn());           //To the open side, until the
+         Timer_Start(TimerMove, AvoidMinTurn);   //way is clear
          break;
-      case 7:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_B4);
-            MCP23016_output_low  (MCP23016_PIN_B5);
-         }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_B4);
-            MCP23016_output_high (MCP23016_PIN_B5);
+      case BEH_WANDER:
+         if (First) {
+            if ((Motor_Direction(Wheel_R)==STOP)&&
+                (Motor_Direction(Wheel_L)==STOP)) {
+               Nav_Pause(0);                 //Stopped already (ie. power on):
+               break;                        //the last range is good
+            }
+            Sonar_Brake();
+            Nav_Pause(Ticks100ms);
+            DistanceNew=FALSE;               //Go on with a fresh range
+            break;
          }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_B4|MCP23016_PIN_B5);         
+         switch (TaskStep[TaskNav]) {
+            case NAV_PAUSE:
+               if (!Timer_Fired(TimerMove) || !DistanceNew) break;
+               SetWheels (FORWARD, FORWARD, WheelsFull);
+               Timer_Start(TimerNavFwd, MaxAutoNavFwd);
+               TaskStep[TaskNav]=NAV_FORWARD;
+               break;
+            case NAV_FORWARD:
+               if (!Timer_Fired(TimerNavFwd)) break;
+               Speed_Set(WheelsGroup, 0);       //Ahead for too long: ramp
+               TaskStep[TaskNav]=NAV_BRAKE;     //down, then turn
+               break;
+            case NAV_BRAKE:
+               if (!Speed_Reached(WheelsGroup)) break;
+               Nav_Turn(Map_BestTurn());     //To the most open space
+               Timer_Start(TimerMove, WanderMaxTurn);
+               break;
+            case NAV_TURN:
+               if (!Timer_Fired(TimerMove) && !Nav_Turned()) break;
+               Nav_Pause(Ticks100ms);
+               DistanceNew=FALSE;
+               break;
          }
          break;
-      case 8:
-         if(Direction<128){
-            MCP23016_output_high (MCP23016_PIN_B6);
-            MCP23016_output_low  (MCP23016_PIN_B7);
+   }
+}
+
+void Behaviour_Stop (byte B)
+//The behaviour has lost the wheels. The new owner sets them
+{
+   if (B==BEH_DANCE) {                       //Dance taken over: end it
+      StopScript();
+      Dance_End();
+   }
+   else if ((B==BEH_REMOTE)&&RemoteScript) {
+      StopScript();                          //Script of the ZX81 taken over
+      RemoteScript=FALSE;
+   }
+}
+
+
+void NavTask ()
+//Give the wheels to the behaviour of highest priority that wants them. Runs
+//on each new sonar range and at least every BehaviourEvery ticks
+{
+   Behaviour_Arbitrate();
+   Sched_Sleep(TaskNav, BehaviourEvery);
+}
+
+
+void DanceTask ()
+// Activate audio cassette and dance with maraca (script SCRIPT_DANCE)
+{
+   switch (TaskStep[TaskDance]) {
+      case DANCE_WAIT:                       //Resumed by TimerDance
+         if (RemoteScript) {                 //The ZX81 runs one: not now
+            Dance_End();
+            return;
          }
-         if(Direction>128){
-            MCP23016_output_low  (MCP23016_PIN_B6);
-            MCP23016_output_high (MCP23016_PIN_B7);
+         RunScript(SCRIPT_DANCE);
+         TaskStep[TaskDance]=DANCE_RUN;
+         Sched_Sleep(TaskNav, 0);            //BEH_DANCE takes the wheels
+         break;
+      case DANCE_RUN:
+         if (Script_Running) break;
+         Dance_End();
+         Sched_Sleep(TaskNav, 0);            //Back to the other behaviours
+         return;
+   }
+   Sched_Every(TaskDance, 1);
+}
+
+
+void PowerTask ()
+//Nobody around for a while: stop everything and sleep until the PIR sees
+//someone or the ZX81 calls
+{
+   byte Wake;
+
+   if (Script_Running || Upload_Busy() || EE_Pending()) {
+      Sched_Sleep(TaskPower, Ticks1s);       //Moving or writing. Try again
+      return;
+   }
+   Sched_Suspend(TaskPower);
+   Sched_Suspend(TaskNav);
+   Behaviour_Release();
+   Timer_Stop(TimerDance);
+   Motor_StopAll();
+   PWM_Off();
+   output_low(Relay);
+   output_low(LED);
+   SRF02_Discard();
+   do {
+      Wake=Power_Sleep();
+   } while ((Wake==POWER_WAKE_WDT) && !input(PIR));
+   Perf_WakeStart();                         //Awake: all as before
+   Sensor_Reset();                           //Values from before sleeping
+   Filter_Reset(FILTER_FRONT);
+   PWM_On();
+   Timer_Start(TimerDance, MaxDance);
+   Timer_Start(TimerSleep, SleepAfter);
+   Sched_Resume(TaskNav);                    //Wander waits for a fresh range
+}
+
+
+void UploadTask ()
+//Write the upload of the ZX81 to the EEPROM, a byte each pass
+{
+   if (Upload_Step()) Sched_Sleep(TaskUpload, 0);
+   else Sched_Suspend(TaskUpload);           //Until more blocks or UP_END
+}
+
+
+void ScriptTask ()
+//Run the motion script until its next wait
+{
+   if (!Script_Running) {
+      Sched_Suspend(TaskScript);
+      if (RemoteScript) Sched_Sleep(TaskNav, 0);   //BEH_REMOTE lets go
+      RemoteScript=FALSE;
+      return;
+   }
+   Sched_Sleep(TaskScript, Script_Step());
+}
+
+
+
+void ReplyInt32 (int32 Value)
+//Add 4 bytes to the frame for the ZX81, high byte first
+{
+   ZX81_ReplyByte(make8(Value,3));
+   ZX81_ReplyByte(make8(Value,2));
+   ZX81_ReplyByte(make8(Value,1));
+   ZX81_ReplyByte(make8(Value,0));
+}
+
+void PerfReply (byte Page, byte Device)
+//Answer ZX_PERF with a page of performance counters
+{
+   byte n;
+   int16 Count;
+
+   switch (Page) {
+      case PERF_I2C:
+         if (Device>=PerfDevices) Device=0;
+         if (!ZX81_ReplyStart(ZX_PERF, 9)) return;
+         ZX81_ReplyByte(PerfAddress[Device]);
+         ReplyInt32(PerfI2CTrans[Device]);
+         ReplyInt32(PerfI2CBytes[Device]);
+         break;
+      case PERF_TIME:
+         if (!ZX81_ReplyStart(ZX_PERF, 12)) return;
+         ReplyInt32(PerfBlockedUs);
+         ReplyInt32(PerfLoops);
+         ReplyInt32(PerfLoopMax/5);
+         break;
+      case PERF_LOOP:
+      case PERF_STOP:
+      case PERF_WAKE:
+         if (!ZX81_ReplyStart(ZX_PERF, 2*PerfBuckets)) return;
+         for(n=0;n<PerfBuckets;n++) {
+            if (Page==PERF_LOOP) Count=PerfLoopHist[n];
+            else if (Page==PERF_STOP) Count=PerfStopHist[n];
+            else Count=PerfWakeHist[n];
+            ZX81_ReplyByte(make8(Count,1));
+            ZX81_ReplyByte(make8(Count,0));
          }
-         if(Direction==128){
-            MCP23016_output_low (MCP23016_PIN_B6|MCP23016_PIN_B7);         
+         break;
+      case PERF_ERRORS:
+         if (!ZX81_ReplyStart(ZX_PERF, 2+3*I2C_ErrDevices)) return;
+         ZX81_ReplyByte(make8(I2C_Recoveries,1));
+         ZX81_ReplyByte(make8(I2C_Recoveries,0));
+         for(n=0;n<I2C_ErrDevices;n++) {
+            ZX81_ReplyByte(I2C_ErrAddress[n]);
+            ZX81_ReplyByte(make8(I2C_ErrCount[n],1));
+            ZX81_ReplyByte(make8(I2C_ErrCount[n],0));
          }
          break;
+      case PERF_POWER:
+         if (!ZX81_ReplyStart(ZX_PERF, 16)) return;
+         ZX81_ReplyByte(make8(Power_Sleeps,1));
+         ZX81_ReplyByte(make8(Power_Sleeps,0));
+         ReplyInt32(Power_WdtWakes);
+         ZX81_ReplyByte(make8(Power_Int0Wakes,1));
+         ZX81_ReplyByte(make8(Power_Int0Wakes,0));
+         ReplyInt32(PerfWakeLast/5);
+         ReplyInt32(PerfWakeMax/5);
+         break;
+      case PERF_BEHAVIOURS:
+         if (Device>=BehavioursNumber) Device=0;
+         if (!ZX81_ReplyStart(ZX_PERF, 8)) return;
+         ZX81_ReplyByte(make8(Behaviour_Preempts,1));
+         ZX81_ReplyByte(make8(Behaviour_Preempts,0));
+         ZX81_ReplyByte(make8(Behaviour_Wins[Device],1));
+         ZX81_ReplyByte(make8(Behaviour_Wins[Device],0));
+         ReplyInt32(Behaviour_Ticks[Device]);
+         break;
+      case PERF_SENSORS:
+         if (Device>=SensorsNumber) Device=0;
+         if (!ZX81_ReplyStart(ZX_PERF, 10)) return;
+         ZX81_ReplyByte(make8(Sensor_Samples[Device],1));
+         ZX81_ReplyByte(make8(Sensor_Samples[Device],0));
+         ZX81_ReplyByte(make8(Sensor_Fails[Device],1));
+         ZX81_ReplyByte(make8(Sensor_Fails[Device],0));
+         ZX81_ReplyByte(make8(Sensor_Stale[Device],1));
+         ZX81_ReplyByte(make8(Sensor_Stale[Device],0));
+         ZX81_ReplyByte(make8(Sensor_LateMax[Device],1));
+         ZX81_ReplyByte(make8(Sensor_LateMax[Device],0));
+         Count=Sensor_Age(Device);
+         ZX81_ReplyByte(make8(Count,1));
+         ZX81_ReplyByte(make8(Count,0));
+         break;
+      case PERF_THERMAL:
+         if (!ZX81_ReplyStart(ZX_PERF, 10)) return;
+         ZX81_ReplyByte(Temperature);
+         ZX81_ReplyByte(Thermal_Peak);
+         ZX81_ReplyByte(make8(Thermal_Throttles,1));
+         ZX81_ReplyByte(make8(Thermal_Throttles,0));
+         ZX81_ReplyByte(make8(Thermal_Derated,1));
+         ZX81_ReplyByte(make8(Thermal_Derated,0));
+         ZX81_ReplyByte(make8(Thermal_Limit,1));
+         ZX81_ReplyByte(make8(Thermal_Limit,0));
+         ZX81_ReplyByte(make8(Thermal_Lowest,1));
+         ZX81_ReplyByte(make8(Thermal_Lowest,0));
+         break;
+      case PERF_CLEAR:
+         Perf_Clear();
+         Thermal_Clear();
+         if (!ZX81_ReplyStart(ZX_PERF, 0)) return;
+         break;
       default:
-         break; 
+         return;                             //Unknown page. No answer
    }
+   ZX81_ReplyEnd();
 }
 
-void Dancer ()
-// Activate audio cassette and dance with maraca
-{
-
-   Output_high(RELAY);            //Relay (Casete) signal on 
-   SetMotor (Maraca, ACTIVATE);    //Activate maraca
-   for (i=1;i<=8;++i) {
-      SetMotor (Wheel_R, FORWARD);   
-      SetMotor (Wheel_L, BACKWARD);   
-      delay_ms (1000);  //Time of turn. Then stop
-      SetMotor (Wheel_R, STOP);   
-      SetMotor (Wheel_L, STOP);   
-      delay_ms (1000);  //Time of turn. Then stop
-      SetMotor (Wheel_R, BACKWARD);   
-      SetMotor (Wheel_L, FORWARD);   
-      delay_ms (1000);  //Time of turn. Then stop
-      SetMotor (Wheel_R, STOP);   
-      SetMotor (Wheel_L, STOP);   
+
+void TraceReply ()
+//Answer ZX_TRACE: start or stop the trace, or send a piece of it
+{
+   byte Chunk[TraceChunk];
+   byte Len, n;
+
+   if (ZX81_Len>0) {
+      if (ZX81_Data[0]) I2C_TraceStart();
+      else I2C_Tracing=FALSE;
+      if (!ZX81_ReplyStart(ZX_TRACE, 2)) return;
+      ZX81_ReplyByte(make8(I2C_TraceLost,1));
+      ZX81_ReplyByte(make8(I2C_TraceLost,0));
+      ZX81_ReplyEnd();
+      return;
+   }
+   if (ZX81_TxFree()<TraceChunk+4) return;   //Try again
+   Len=I2C_TraceTake(Chunk, TraceChunk);
+   ZX81_ReplyStart(ZX_TRACE, Len);
+   for(n=0;n<Len;n++) ZX81_ReplyByte(Chunk[n]);
+   ZX81_ReplyEnd();
+}
+
+
+void ConfigReply ()
+//Answer ZX_CONFIG: status of the boot, or read or write the configuration
+{
+   byte Offset, n;
+
+   if (Upload_State==UPLOAD_COMMIT) return;  //No answer: try again
+   if (ZX81_Len==0) {
+      if (!ZX81_ReplyStart(ZX_CONFIG, 2)) return;
+      ZX81_ReplyByte(Boot_Status);
+      ZX81_ReplyByte(ConfigSize);
+      ZX81_ReplyEnd();
+      return;
+   }
+   Offset=ZX81_Data[0];
+   if (((ZX81_Len>1)||(Offset==CONFIG_DEFAULTS))&&Upload_ConfigWaiting) {
+      if (!ZX81_ReplyStart(ZX_CONFIG, 1)) return;   //Would write over the
+      ZX81_ReplyByte(UPLOAD_BUSY);                  //uploaded one
+      ZX81_ReplyEnd();
+      return;
+   }
+   if ((ZX81_Len==1)&&(Offset==CONFIG_DEFAULTS)) {
+      Config_Default();
+      Upload_Save();
+   }
+   else if (Offset>=ConfigSize) return;      //No answer
+   else if (ZX81_Len==1) {
+      n=ConfigSize-Offset;
+      if (n>ConfigChunk) n=ConfigChunk;
+      if (!ZX81_ReplyStart(ZX_CONFIG, n)) return;
+      for(;n>0;n--) ZX81_ReplyByte(Config[Offset++]);
+      ZX81_ReplyEnd();
+      return;
+   }
+   else {
+      for(n=1;(n<ZX81_Len)&&(Offset<ConfigSize);n++)
+         Config[Offset++]=ZX81_Data[n];
+      Upload_Save();                          //Used from the next power on
+   }
+   Sched_Resume(TaskUpload);                  //Written in the background
+   if (!ZX81_ReplyStart(ZX_CONFIG, 0)) return;
+   ZX81_ReplyEnd();
+}
+
+
+void MapReply ()
+//Answer ZX_MAP: the pose, a row of the grid or a new calibration
+{
+   byte Row, n;
+
+   if ((ZX81_Len>=5)&&(ZX81_Data[0]==MAP_CALIBRATE)) {
+      if (!Map_Calibrate(make16(ZX81_Data[1],ZX81_Data[2]),
+                         make16(ZX81_Data[3],ZX81_Data[4])))
+         return;                             //Queue full. No answer
+   }
+   else if (ZX81_Len>0) {
+      Row=ZX81_Data[0];
+      if (Row>=MapSize) return;              //No such row. No answer
+      if (!ZX81_ReplyStart(ZX_MAP, MapSize/4)) return;
+      for(n=0;n<MapSize/4;n++)
+         ZX81_ReplyByte(Map_Grid[(int16)Row*(MapSize/4)+n]);
+      ZX81_ReplyEnd();
+      return;
+   }
+   if (!ZX81_ReplyStart(ZX_MAP, 5)) return;
+   ZX81_ReplyByte(make8(Map_X>>8,1));        //cm
+   ZX81_ReplyByte(make8(Map_X>>8,0));
+   ZX81_ReplyByte(make8(Map_Y>>8,1));
+   ZX81_ReplyByte(make8(Map_Y>>8,0));
+   ZX81_ReplyByte(Map_Angle());
+   ZX81_ReplyEnd();
+}
+
+
+void UploadReply ()
+//Answer ZX_UPLOAD: a step of the upload of an image
+{
+   byte Op;
+
+   if (ZX81_Len==0) return;                  //No answer
+   Op=ZX81_Data[0];
+   switch (Op) {
+      case UP_BEGIN:
+         if (ZX81_Len<4) return;
+         UploadStatus=Upload_Begin(ZX81_Data[1],
+                                   make16(ZX81_Data[2],ZX81_Data[3]));
+         if (!ZX81_ReplyStart(ZX_UPLOAD, 2)) return;
+         ZX81_ReplyByte(UploadStatus);
+         ZX81_ReplyByte(UploadBlock);
+         break;
+      case UP_BLOCK:
+         if (ZX81_Len<4) return;
+         UploadStatus=Upload_Block(ZX81_Data[1],
+                                   make16(ZX81_Data[2],ZX81_Data[3]),
+                                   ZX81_Data+4, ZX81_Len-4);
+         if (!ZX81_ReplyStart(ZX_UPLOAD, 2)) return;
+         ZX81_ReplyByte(UploadStatus);
+         ZX81_ReplyByte(Upload_Next);
+         break;
+      case UP_END:
+         if (ZX81_Len<3) return;
+         UploadStatus=Upload_End(make16(ZX81_Data[1],ZX81_Data[2]));
+         if (!ZX81_ReplyStart(ZX_UPLOAD, 1)) return;
+         ZX81_ReplyByte(UploadStatus);
+         break;
+      case UP_STATUS:
+         if (!ZX81_ReplyStart(ZX_UPLOAD, 6)) return;
+         ZX81_ReplyByte(UploadStatus);
+         ZX81_ReplyByte(Upload_State);
+         if (Upload_Bank==Upload_BankA) ZX81_ReplyByte(0);
+         else if (Upload_Bank==Upload_BankB) ZX81_ReplyByte(1);
+         else ZX81_ReplyByte(0xFF);
+         ZX81_ReplyByte(Upload_Seq);
+         ZX81_ReplyByte(make8(Upload_Written,1));
+         ZX81_ReplyByte(make8(Upload_Written,0));
+         break;
+      case UP_ABORT:
+         Upload_Abort();
+         UploadStatus=UPLOAD_IDLE;
+         if (!ZX81_ReplyStart(ZX_UPLOAD, 1)) return;
+         ZX81_ReplyByte(UPLOAD_OK);
+         break;
+      default:
+         return;                             //Unknown. No answer
+   }
+   ZX81_ReplyEnd();
+   Sched_Resume(TaskUpload);                 //Bytes to write, maybe
+}
+
+
+void ZX81Task ()
+//Run the commands received from the ZX81
+{
+   byte n;
+
+   Sched_Sleep(TaskZX81, 0);                 //Run on every pass
+   if (!ZX81_Receive()) return;
+   Timer_Start(TimerSleep, SleepAfter);      //Someone is using the robot
+   if (PerfWakePending) Perf_WakeEnd();
+   switch (ZX81_Cmd) {
+      case ZX_PING:
+         if (!ZX81_ReplyStart(ZX_PING, 1)) return;
+         ZX81_ReplyByte(Version);
+         break;
+      case ZX_MOTORS:
+         for(n=0;n+1<ZX81_Len;n+=2) {
+            Motor_Stage(ZX81_Data[n], ZX81_Data[n+1]);
+            if ((ZX81_Data[n]==Wheel_R)||(ZX81_Data[n]==Wheel_L)) {
+               Timer_Start(TimerRemote, RemoteHold);   //BEH_REMOTE
+               Speed_Set(WheelsGroup, RemoteSpeed);
+            }
+         }
+         Motor_Commit();
+         if (!ZX81_ReplyStart(ZX_MOTORS, 0)) return;
+         break;
+      case ZX_SENSORS:
+         if (!ZX81_ReplyStart(ZX_SENSORS, 5)) return;
+         ZX81_ReplyByte(Distance);
+         ZX81_ReplyByte(Temperature);
+         ZX81_ReplyByte(PIRStatus);
+         ZX81_ReplyByte(make8(MCP23016_Latch[CardIO],0));
+         ZX81_ReplyByte(make8(MCP23016_Latch[CardIO],1));
+         break;
+      case ZX_AUTONAV:
+         AutoNavMode=(ZX81_Len>0)&&(ZX81_Data[0]!=0);
+         if (!AutoNavMode) SetWheels (STOP, STOP, 0);
+         Sched_Sleep(TaskNav, 0);             //Behaviours of the new mode
+         if (!ZX81_ReplyStart(ZX_AUTONAV, 0)) return;
+         break;
+      case ZX_SCRIPT:
+         if (ZX81_Len>0) {
+            RemoteScript=TRUE;                //BEH_REMOTE wants the wheels
+            if (Behaviour_Arbitrate()==BEH_REMOTE) RunScript(ZX81_Data[0]);
+            else RemoteScript=FALSE;          //Escape has them: not run
+         }
+         else Script_Stop();
+         if (!ZX81_ReplyStart(ZX_SCRIPT, 1)) return;
+         ZX81_ReplyByte(Script_Running);     //0 if there is no such script
+         break;
+      case ZX_SPEED:
+         if ((ZX81_Len<2)||(ZX81_Data[0]<1)||(ZX81_Data[0]>SpeedGroups))
+            return;
+         if (ZX81_Len>2) Speed_Accel[ZX81_Data[0]-1]=ZX81_Data[2];
+         if (ZX81_Data[0]==WheelsGroup) RemoteSpeed=ZX81_Data[1];
+         else Speed_Set(ZX81_Data[0], ZX81_Data[1]);
+         if (!ZX81_ReplyStart(ZX_SPEED, 0)) return;
+         break;
+      case ZX_PERF:
+         PerfReply(ZX81_Len>0 ? ZX81_Data[0] : PERF_TIME,
+                   ZX81_Len>1 ? ZX81_Data[1] : 0);
+         return;
+      case ZX_TRACE:
+         TraceReply();
+         return;
+      case ZX_MAP:
+         MapReply();
+         return;
+      case ZX_CONFIG:
+         ConfigReply();
+         return;
+      case ZX_UPLOAD:
+         UploadReply();
+         return;
+      default:
+         return;                             //Unknown. No answer
    }
-   Output_low(RELAY);            //Relay (Casete) signal off 
-   SetMotor (Maraca, STOP);    //Activate maraca
-   //Arm
-   SetMotor (Arm_R, FORWARD);    //Extend Arm_R
-   delay_ms(1000);
-   SetMotor (Arm_R, STOP);    //Stop Arm_R
-   delay_ms(1000);
-   SetMotor (Arm_R, BACKWARD);    //Compress Arm_R
-   delay_ms(1000);
-   SetMotor (Arm_R, STOP);    //Stop Arm_R
+   ZX81_ReplyEnd();
 }
 
 
@@ -308,10 +1305,14 @@ void main()
    set_tris_b (0b11111111);        //configure port B (See comments at header)
    set_tris_c (0b10100001);        //configure port C (See comments at header)
    
-   Output_low(RELAY);            //Relay signal off 
-   Output_low(LED);              //Led off
-   Output_high(ZX81_WAIT);       //Non wait (Active low)
+   output_low(Relay);            //Relay signal off 
+   output_low(LED);              //Led off
+   output_high(ZX81_WAIT);       //Non wait (Active low)
 
+   //Addresses, motor map and tuning values
+   if (!Config_Init()) Boot_Status=BOOT_DEFAULTS;
+   Upload_Init();                             //Bank of the motion scripts
+   RemoteSpeed=WheelsFull;
 
    //TIMERS CONFIGURATION
    setup_timer_3(T3_INTERNAL|T3_DIV_BY_1);   //Timer for multipurpose counters
@@ -319,13 +1320,22 @@ void main()
 
    //PWM generation
    setup_timer_2(T2_DIV_BY_1,199,1);          // PWM 1 & 2 aprox 25KHz
-   setup_ccp1(CCP_PWM);                      
-   setup_ccp2(CCP_PWM);
-   set_pwm1_duty(800);         
-   set_pwm2_duty(500);         
+   Speed_Init();                              //Both groups stopped
+   Thermal_Init();                            //Cool until read
+   Speed_Accel[0]=Config[CFG_RAMP];
+   Speed_Accel[1]=Config[CFG_RAMP];
+   PWM_On();
 
-   //General Purpose counters
-   InitGeneralPurposeCounters();
+   //Timers and tasks
+   Timer_Init();
+   Sched_Init();
+   Perf_Clear();
+
+   //I2C bus
+   I2C_Init();
+
+   //ZX81 data bus
+   ZX81_Init();
 
    //ENABLE INTERRUPTS
    enable_interrupts(INT_TIMER3);   //Timer3 overflow
@@ -334,114 +1344,57 @@ void main()
 
    //OTHER INITIAL SETUPS --------------------------------
 
-   Blink(10);
+   Boot_Devices();                        //Chips on the bus, 1ms if all there
 
    //I/O Espander port config . Do not move.
-   MCP23016_Reg_Write(IODIR0, 0b00000000);
-   MCP23016_Reg_Write(IODIR1, 0b00000000);
-   
+   if (MCP23016_Add(Config[CFG_IO_ADDR])!=CardIO)   //Chip of the card
+      Boot_Status|=BOOT_NO_IO;                      //Not in the table
+   MotorErrors[CardIO]=0;
+   MCP23016_Reg_Write(CardIO, IODIR0, 0b00000000);
+   MCP23016_Reg_Write(CardIO, IODIR1, 0b00000000);
+   MCP23016_Reg_Write16(CardIO, OLAT0, 0x0000);   //All motors stopped (also
+                                                  //after a watchdog reset)
+   if (SRF02_Add(Config[CFG_SONAR_ADDR])==SRF02_NONE)   //Front sonar (number 0,
+      Boot_Status|=BOOT_NO_SONAR;                       //gives Distance)
+   Boot_Motors();
+   Led_Show((Boot_Status & 7)+1);       //Status code, while it goes on
 
-//   set_pwm1_duty(800);           //Duty cycle of Group 1 of motors 
+   Speed_Set(WheelsGroup, WheelsFull);    //Speed of each group of motors
+   Speed_Set(ArmsGroup, ArmsSpeed);
 
-AutoNavMode=TRUE;
-//Output_high(RELAY);
+   AutoNavMode=TRUE;                   //Wander from power on (ZX_AUTONAV)
+   Behaviour_Init();                   //Nobody drives the wheels yet
+   Sensor_Init();
+   if (!(Boot_Status & BOOT_NO_SONAR))   //Else blind: escape stops
+      Sensor_Config(SENSOR_SONAR, SonarEvery, SonarMaxAge);
+   Sensor_Config(SENSOR_PIR, PIREvery, PIRMaxAge);
+   if (!(Boot_Status & BOOT_NO_TEMP))
+      Sensor_Config(SENSOR_TEMP, TempEvery, TempMaxAge);
+   Map_Init();                         //The room is where it starts
+   Filter_Init();                      //No range filtered yet
+   PoseTick=Timer_Now();
+   Sched_Suspend(TaskScript);          //No script running
+   Sched_Suspend(TaskDance);           //Until TimerDance expires
+   Sched_Suspend(TaskPower);           //Until TimerSleep expires
+   Sched_Suspend(TaskUpload);          //Until the ZX81 sends an upload
+   Timer_Start(TimerDance, MaxDance);
+   Timer_Start(TimerSleep, SleepAfter);
+   Snapshot();                         //The ZX81 can read it from now on
 
    while (TRUE) { //MAIN LOOP
-
-//      Temperature=LM75_TempRead(LM75Address);   //Get temperature
-//      PIRStatus=Input(PIR);                     //Get PIR status
-      Distance=SRF02_Distance_8(SRF02Address);         //Get Sonar range
-
-/*delay_ms(1000);
-
-If (Distance!=0) Blink(2);
-*/
-//If (PIRStatus) Blink(2);
-
-   //Arm
-/*   SetMotor (Shoulder_L, UP);    //Move up Shoulder_L
-   delay_ms(6000);
-   SetMotor (Shoulder_L, STOP);    //Stop Shoulder_L
-   delay_ms(1000);
-   SetMotor (Shoulder_L, DOWN);    //Move down Shoulder_L
-   delay_ms(3000);
-   SetMotor (Shoulder_L, STOP);    //Stop Shoulder_L
-   delay_ms(2000);
-
-*/
-
-
-/*
-
-            SetMotor (Wheel_R, FORWARD);   
-            SetMotor (Wheel_L, FORWARD);   
-            delay_ms (1000);  //Time of turn. Then stop
-            SetMotor (Wheel_R, STOP);   
-            SetMotor (Wheel_L, STOP);   
-
-
-   //Arm
-   SetMotor (Arm_R, FORWARD);    //Extend Arm_R
-   delay_ms(1000);
-   SetMotor (Arm_R, STOP);    //Stop Arm_R
-   delay_ms(1000);
-   SetMotor (Arm_R, BACKWARD);    //Compress Arm_R
-   delay_ms(1000);
-   SetMotor (Arm_R, STOP);    //Stop Arm_R
-   delay_ms(1000);
-
-   //Hand
-   SetMotor (Hand_R, OPEN);    //Open hand
-   delay_ms(1000);
-   SetMotor (Hand_R, STOP);    //Stop hand
-   delay_ms(1000);
-   SetMotor (Light_R, ACTIVATE);    //Activate Light right arm
-   delay_ms(1000);
-   SetMotor (Light_R, STOP);    //STOP Light right arm
-   SetMotor (Hand_R, CLOSE);    //Close hand
-   delay_ms(1000);
-   SetMotor (Hand_R, STOP);    //Stop hand
-   delay_ms(1000);
-
-   //Maraca
-   SetMotor (Maraca, ACTIVATE);    //Activate maraca
-   delay_ms(2000);
-   SetMotor (Maraca, STOP);    //Stop maraca
-   delay_ms(4000);
-*/
-      //Activacin audio
-/*      SetRelay(TRUE);
-      delay_ms(2000);
-      SetRelay(FALSE);
-      delay_ms(4000);
-*/     
-
-//Counter[Dance]=0;
-
-      if (Counter[Dance]>MaxDance){
-         Dancer ();
-         Counter[Dance]=0;
-      }
-
-      if(AutoNavMode) {
-         if(((Distance<50)&&(Distance>0))||(Counter[AutoNavFwd]>MaxAutoNavFwd)) { 
-         //Obstacle in front or too much time going ahead. Turn a bit
-            SetMotor (Wheel_R, STOP);   
-            SetMotor (Wheel_L, STOP);   
-            delay_ms (100);
-            SetMotor (Wheel_R, FORWARD);   
-            SetMotor (Wheel_L, BACKWARD);   
-            delay_ms (1000);  //Time of turn. Then stop
-            SetMotor (Wheel_R, STOP);   
-            SetMotor (Wheel_L, STOP);   
-            Counter[AutoNavFwd]=0;
-         }
-         else {                             //No obstacle. Go forward
-            SetMotor (Wheel_R, FORWARD);   
-            SetMotor (Wheel_L, FORWARD);   
-         }
-      }
-
+      restart_wdt();
+      Perf_Loop();                           //Period of the main loop
+      I2C_Check();                           //Clear the I2C bus if stuck
+      Timer_Service();                       //Timers that have expired
+      EE_Service();                          //Writes queued in the EEPROM
+      if (PerfStopPending && I2C_Idle()) Perf_StopEnd();   //Wheels stopped
+      if (Sched_Due(TaskSense)) SenseTask();
+      if (Sched_Due(TaskDance)) DanceTask();
+      if (Sched_Due(TaskNav))   NavTask();
+      if (Sched_Due(TaskZX81))  ZX81Task();
+      if (Sched_Due(TaskScript)) ScriptTask();
+      if (Sched_Due(TaskPower)) PowerTask();
+      if (Sched_Due(TaskUpload)) UploadTask();
    } //End While MAIN LOOP
 
 }  //End Program
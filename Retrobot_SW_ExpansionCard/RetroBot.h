@@ -1,8 +1,10 @@
+#ifdef __PCH__
 #include <18F2620.h>
 #device adc=8
+#device HIGH_INTS=TRUE          //ZX81 transfers (INT0) as high priority
 
-#FUSES NOWDT                    //No Watch Dog Timer
-#FUSES WDT128                   //Watch Dog Timer uses 1:128 Postscale
+#FUSES WDT                      //Watch Dog Timer. Restarted by the main loop
+#FUSES WDT128                   //Watch Dog Timer uses 1:128 Postscale (512ms)
 #FUSES HS                       //High speed Osc (> 4mhz)
 #FUSES NOPROTECT                //Code not protected from reading
 #FUSES IESO                     //Internal External Switch Over mode enabled
@@ -26,6 +28,12 @@
 #FUSES LPT1OSC                  //Timer1 configured for low-power operation
 #FUSES MCLR                     //Master Clear pin enabled
 
-#use delay(clock=20000000)
-#use i2c(Master,Slow,sda=PIN_C4,scl=PIN_C3)
+#use delay(clock=20000000, restart_wdt)   //Long delays restart the WDT
+//I2C bus managed by MSSP interrupt. See I2CMaster.h
 
+typedef signed int8  sint8;     //Signed types, same names in the PC build
+typedef signed int16 sint16;
+typedef signed int32 sint32;
+#else
+//PC build (Retrobot_SW_Host). Types and built-ins come from HostHAL.h
+#endif
@@ -11,56 +11,316 @@ obstacle in the selected SRF02 device in int16 format
 -SRF02_Distance_8(byte SRF02Address) returns the distance in cm to the
 obstacle in the selected SRF02 device in byte format
 
+Both functions above wait until the ranging is done. To go on working
+while the SRF02 is ranging, use the following functions instead:
+
+-SRF02_Start(byte SRF02Address) starts a ranging in cm and returns at once
+-SRF02_Ready() returns true when the ranging has finished and the result has
+been read from the device. When it is time to poll the sonar, it queues the
+read of the result on the I2C bus and returns false, so call it again later
+(as often as possible while SRF02_State is not SRF02_IDLE or SRF02_READY)
+-SRF02_Collect_16() returns the result of the last ranging in int16 format
+-SRF02_Collect_8() returns the result of the last ranging in byte format
+-SRF02_Discard() forgets the result of the ranging in progress (or finished
+and not collected). Use it when the reading is no longer valid, ie. after the
+robot has turned.
+
+Example:
+
+   if (SRF02_State==SRF02_IDLE) SRF02_Start(SRF02Address);
+   ...                                 //Do other things while ranging
+   if (SRF02_Ready()) Distance=SRF02_Collect_8();
+
+END OF THE RANGING:
+The SRF02 does not answer on the I2C bus while it is ranging (65ms in the
+datasheet), so it is polled: from SRF02_PollFrom us after the command, the
+read of the result is sent every SRF02_PollEvery us until the sonar
+acknowledges it (I2C_POLL, so the NAKs are not errors of the device). The
+result is there as soon as the ranging is done, not at a fixed time. A sonar
+that has not answered after SRF02_PollTo us has failed.
+
+SEVERAL SONARS:
+The sonars are kept in a table (up to SRF02_MaxSonars), each one with the
+result of its last ranging (SRF02_Ranges[]) and the tick of Timers.h it was
+read (SRF02_Stamps[]). A sonar goes into the table with SRF02_Add() or the
+first time it is used with SRF02_Start().
+
+-SRF02_Add(byte SRF02Address) puts a sonar in the table and returns its number
+(SRF02_NONE, 0xFF, if the table is full and it is not there). SRF02_Start()
+does not range a sonar that does not fit in the table
+-SRF02_StartAll(int1 Broadcast) starts a ranging in all the sonars of the table
+at the same time. With Broadcast, a single command is sent to the general call
+address (0x00), that every SRF02 obeys. Without it, the commands are sent to
+each sonar one after the other (staggered by one I2C transaction, 0.4ms),
+for buses with other devices that must not see the general call.
+When SRF02_Ready() is true the results of all of them are in the table, so a
+full scan takes one ranging time (65ms) and not one for each sonar.
+
+   SRF02_Add(0xE0);                    //Front
+   SRF02_Add(0xE2);                    //Back
+   ...
+   if (SRF02_State==SRF02_IDLE) SRF02_StartAll(TRUE);
+   if (SRF02_Ready()) {
+      Front=SRF02_Ranges[0];
+      Back=SRF02_Ranges[1];
+      SRF02_Collect_16();              //Ready for the next scan
+   }
+
+If the result of a sonar cannot be read (the I2C transaction fails), its range
+and stamp are kept and SRF02_Fails[] of the sonar counts one more (up to 255).
+It goes back to 0 with the next good reading, so the program can tell a sonar
+that has stopped answering (ie. to stop the wheels).
+
+Only one ranging (of one sonar or of all of them) can be in progress at a time.
+SRF02_Collect_16() and SRF02_Collect_8() give the result of the first sonar of
+the ranging. The sonars must be far enough or looking to different sides, as
+they all listen at the same time and could hear the ping of another one.
+
+CONFIGURATION:
+Include Timers.h, Perf.h and I2CMaster.h before this library. The times of
+the polling can be changed defining SRF02_PollFrom, SRF02_PollEvery and
+SRF02_PollTo before including it.
+
 */
 
 
+//Ranging states (SRF02_State)
+#define  SRF02_IDLE         0     //No ranging in progress
+#define  SRF02_RANGING      1     //Ranging in progress
+#define  SRF02_DONE         2     //Time to poll. Result not read yet
+#define  SRF02_READING      3     //Polling: reading the result
+#define  SRF02_READY        4     //Result ready to be collected
+
+#ifndef SRF02_PollFrom
+#define  SRF02_PollFrom 64000     //us from the command to the first poll
+#endif
+#ifndef SRF02_PollEvery
+#define  SRF02_PollEvery 1000     //us between polls
+#endif
+#ifndef SRF02_PollTo
+#define  SRF02_PollTo  100000     //us to give up a sonar that does not answer
+#endif
+#define  SRF02_MaxSonars    4     //Sonars in the table (8 at most)
+#define  SRF02_NONE      0xFF     //SRF02_Add(): the table is full
+#define  SRF02_GeneralCall  0x00  //Address obeyed by all SRF02
+
+byte  SRF02_State=SRF02_IDLE;    //State of the ranging
+int32 SRF02_Started;             //Perf_Now() of the command
+int32 SRF02_PollAt;              //Time of the next poll (counts from start)
+int1  SRF02_Stale=FALSE;         //Result of the ranging must be discarded
+int16 SRF02_Range;               //Result of the last ranging in cm
+
+byte  SRF02_Sonars=0;                     //Sonars in the table
+byte  SRF02_Address[SRF02_MaxSonars];     //Address of each sonar
+int16 SRF02_Ranges[SRF02_MaxSonars];      //Last range of each sonar in cm
+int16 SRF02_Stamps[SRF02_MaxSonars];      //Tick each range was read
+byte  SRF02_Slots[SRF02_MaxSonars];       //I2C transaction reading each one
+byte  SRF02_Ranging=0;                    //Sonars of the ranging (bit n: n)
+byte  SRF02_Pending;                      //Sonars of it not read yet
+byte  SRF02_Fails[SRF02_MaxSonars];       //Rangings lost in a row by each one
+
+
+void SRF02_Command(byte DeviceAddress)
+//Send the command to start a ranging in cm
+{
+   byte Slot;
+
+   Slot=I2C_New(DeviceAddress, 2, 0);
+   I2CQueue[Slot].WriteData[0]=0x00;   // Register for commands
+   I2CQueue[Slot].WriteData[1]=0x51;   // Start measure un cm
+   I2CQueue[Slot].Options=I2C_AUTOFREE;
+   I2C_Submit(Slot);
+}
+
+byte SRF02_Read(byte DeviceAddress)
+//Queue the read of the result of the last ranging. Returns the I2C slot. It
+//finishes with I2C_NAK while the sonar is ranging
+{
+   byte Slot;
+
+   Slot=I2C_New(DeviceAddress, 1, 2);
+   I2CQueue[Slot].WriteData[0]=0x02;   // Register to start reading
+   I2CQueue[Slot].Options=I2C_POLL;
+   I2C_Submit(Slot);
+   return (Slot);
+}
+
+int16 SRF02_Value(byte Slot)
+//Range in cm read by the I2C slot. The slot is freed
+{
+   int16 Distance;                     //Value measured in cm
+
+   Distance=make16(I2CQueue[Slot].ReadData[0], I2CQueue[Slot].ReadData[1]);
+   I2C_Free(Slot);
+   return (Distance);
+}
+
+int16 SRF02_Result(byte DeviceAddress)
+//Poll the sonar until the ranging is done and read the result in cm (0 if it
+//does not answer)
+{
+   byte Slot, Status;
+   int32 Start;
+
+   Start=Perf_Now();
+   Perf_Delay_ms(SRF02_PollFrom/1000);
+   while (TRUE) {
+      Slot=SRF02_Read(DeviceAddress);
+      Status=I2C_Wait(Slot);
+      if (Status==I2C_DONE) return (SRF02_Value(Slot));
+      I2C_Free(Slot);
+      if ((Status!=I2C_NAK)||(Perf_Now()-Start>=(int32)SRF02_PollTo*5))
+         return (0);
+      Perf_Delay_us(SRF02_PollEvery);
+   }
+}
+
+byte SRF02_To8(int16 Distance)
+//Distance as a byte (mx 255cm)
+{
+   if (Distance>255) return (255);
+   return ((byte)Distance);
+}
+
 int16 SRF02_Distance_16(byte DeviceAddress)       
 //Read the Distance in cm and return it in int16 format
 {
-   byte DataHigh=0, DataLow=0;         //Bytes read
-   int16 Distance;                      //Value measured in cm
-   
-   i2c_start();
-   i2c_write(DeviceAddress);
-   i2c_write(0x00);                    // Register for commands
-   i2c_write(0x51);                    // Start measure un cm
-   i2c_stop();
-   delay_ms(70);                       // Time for SRF02 to calculate distance
-   i2c_start();
-   i2c_write(DeviceAddress);
-   i2c_write(0x02);                    // Register to start reading
-   i2c_start();
-   i2c_write(DeviceAddress|1);
-   DataHigh = i2c_read();              // with ACK
-   DataLow = i2c_read(0);              // with NAK
-   i2c_stop();
-   Distance = (DataHigh<<8);           // Calculate the range
-   Distance += DataLow;
-   return (Distance);
+   SRF02_Command(DeviceAddress);
+   return (SRF02_Result(DeviceAddress));
 }
 
 byte SRF02_Distance_8(byte DeviceAddress)       //
 //Return the Distance in cm as a byte (mx 255cm)
 {
-   byte DataHigh=0, DataLow=0;         //Bytes read
-   byte Distance;                      //Value measured in cm
-   
-   i2c_start();
-   i2c_write(DeviceAddress);
-   i2c_write(0x00);                    // Register for commands
-   i2c_write(0x51);                    // Start measure un cm
-   i2c_stop();
-   delay_ms(70);                       // Time for SRF02 to calculate distance
-   i2c_start();
-   i2c_write(DeviceAddress);
-   i2c_write(0x02);                    // Register to start reading
-   i2c_start();
-   i2c_write(DeviceAddress|1);
-   DataHigh = i2c_read();              // with ACK
-   DataLow = i2c_read(0);              // with NAK
-   i2c_stop();
-   if (DataHigh>0) Distance=255;
-   else Distance=DataLow;
-   return (Distance);
+   return (SRF02_To8(SRF02_Distance_16(DeviceAddress)));
+}
+
+byte SRF02_Add(byte DeviceAddress)
+//Number of the sonar in the table. It is added if it is not there
+{
+   byte Sonar;
+
+   for(Sonar=0;Sonar<SRF02_Sonars;Sonar++)
+      if (SRF02_Address[Sonar]==DeviceAddress) return (Sonar);
+   if (SRF02_Sonars==SRF02_MaxSonars) return (SRF02_NONE);   //Full
+   SRF02_Address[Sonar]=DeviceAddress;
+   SRF02_Ranges[Sonar]=0;
+   SRF02_Fails[Sonar]=0;
+   SRF02_Stamps[Sonar]=Timer_Now();
+   SRF02_Sonars++;
+   return (Sonar);
+}
+
+void SRF02_Ranging_Start(byte Sonars)
+//The sonars have been commanded. Wait for the time of the ranging
+{
+   SRF02_Ranging=Sonars;
+   SRF02_Pending=Sonars;
+   SRF02_Stale=FALSE;
+   SRF02_Started=Perf_Now();
+   SRF02_PollAt=(int32)SRF02_PollFrom*5;
+   SRF02_State=SRF02_RANGING;
+}
+
+void SRF02_Start(byte DeviceAddress)
+//Start a ranging and return without waiting for the result
+{
+   byte Sonar;
+
+   Sonar=SRF02_Add(DeviceAddress);
+   if (Sonar==SRF02_NONE) return;      //Not in the table: no place for it
+   SRF02_Command(DeviceAddress);
+   SRF02_Ranging_Start(1<<Sonar);
 }
 
+void SRF02_StartAll(int1 Broadcast)
+//Start a ranging in all the sonars of the table at the same time
+{
+   byte Sonar;
+
+   if (SRF02_Sonars==0) return;
+   if (Broadcast) SRF02_Command(SRF02_GeneralCall);
+   else for(Sonar=0;Sonar<SRF02_Sonars;Sonar++)
+      SRF02_Command(SRF02_Address[Sonar]);
+   SRF02_Ranging_Start((1<<SRF02_Sonars)-1);
+}
+
+int1 SRF02_Ready()
+//True if the ranging is finished and the result can be collected
+{
+   byte Sonar, Status;
+   int1 First;
+   int32 Elapsed;
+
+   Elapsed=Perf_Now()-SRF02_Started;              //Time of the ranging
+   if ((SRF02_State==SRF02_RANGING)&&(Elapsed>=SRF02_PollAt))
+      SRF02_State=SRF02_DONE;
+   if (SRF02_State==SRF02_DONE) {                  //Poll the sonars
+      for(Sonar=0;Sonar<SRF02_Sonars;Sonar++)
+         if (bit_test(SRF02_Pending,Sonar))
+            SRF02_Slots[Sonar]=SRF02_Read(SRF02_Address[Sonar]);
+      SRF02_State=SRF02_READING;
+   }
+   if (SRF02_State==SRF02_READING) {
+      for(Sonar=0;Sonar<SRF02_Sonars;Sonar++)
+         if (bit_test(SRF02_Pending,Sonar) && I2C_Busy(SRF02_Slots[Sonar]))
+            return (false);                        //Not read yet
+      for(Sonar=0;Sonar<SRF02_Sonars;Sonar++) {
+         if (!bit_test(SRF02_Pending,Sonar)) continue;
+         Status=I2CQueue[SRF02_Slots[Sonar]].Status;
+         if ((Status==I2C_NAK)&&(Elapsed<(int32)SRF02_PollTo*5)) {
+            I2C_Free(SRF02_Slots[Sonar]);          //Still ranging
+            continue;
+         }
+         bit_clear(SRF02_Pending,Sonar);
+         if (SRF02_Stale)                          //Not valid. Keep the old
+            I2C_Free(SRF02_Slots[Sonar]);
+         else if (Status!=I2C_DONE) {
+            I2C_Free(SRF02_Slots[Sonar]);          //No answer. Keep the old
+            if (SRF02_Fails[Sonar]!=0xFF) SRF02_Fails[Sonar]++;
+         }
+         else {
+            SRF02_Ranges[Sonar]=SRF02_Value(SRF02_Slots[Sonar]);
+            SRF02_Stamps[Sonar]=Timer_Now();
+            SRF02_Fails[Sonar]=0;
+         }
+      }
+      if (SRF02_Pending!=0) {                      //Poll again later
+         SRF02_PollAt=Elapsed+(int32)SRF02_PollEvery*5;
+         SRF02_State=SRF02_RANGING;
+         return (false);
+      }
+      First=TRUE;
+      for(Sonar=0;Sonar<SRF02_Sonars;Sonar++) {
+         if (!bit_test(SRF02_Ranging,Sonar)) continue;
+         if (First) SRF02_Range=SRF02_Ranges[Sonar];
+         First=FALSE;
+      }
+      SRF02_State=SRF02_READY;
+   }
+   if ((SRF02_State==SRF02_READY)&&SRF02_Stale) {  //Nobody wants it
+      SRF02_State=SRF02_IDLE;
+      SRF02_Stale=FALSE;
+   }
+   return (SRF02_State==SRF02_READY);
+}
+
+int16 SRF02_Collect_16()
+//Result of the ranging in int16 format
+{
+   SRF02_State=SRF02_IDLE;
+   return (SRF02_Range);
+}
+
+byte SRF02_Collect_8()
+//Result of the ranging in byte format
+{
+   return (SRF02_To8(SRF02_Collect_16()));
+}
+
+void SRF02_Discard()
+//Forget the result of the ranging in progress or not yet collected
+{
+   if (SRF02_State==SRF02_READY) SRF02_State=SRF02_IDLE;
+   else if (SRF02_State!=SRF02_IDLE) SRF02_Stale=TRUE;
+}
@@ -0,0 +1,110 @@
+/*
+Library:       Scheduler.h
+Purpose:       Cooperative scheduler of tasks based on the Timer3 tick
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The program is divided in tasks. A task is a function that does a short piece
+of work and returns (it never waits with delay_ms). When it needs to wait, it
+tells the scheduler when it wants to run again (its wake-up deadline) and
+returns. Tasks that have to do a sequence of steps keep the step they are in at
+TaskStep[] (state machine).
+
+Time is measured in ticks of Timer3 (13.1ms), the tick of Timers.h. It wraps
+around every 65536 ticks (14 minutes), so deadlines are compared using the
+difference with the current time.
+
+FUNCTIONS:
+Sched_Now(): Returns the current tick (Timer_Now() of Timers.h)
+Sched_Due(byte Task): True if the task is active and its deadline has arrived
+Sched_Sleep(byte Task, int16 Ticks): The task will run again after Ticks ticks
+from now. Sched_Sleep(Task,0) makes the task run in the next pass.
+Sched_Every(byte Task, int16 Ticks): The task will run again Ticks ticks after
+its last deadline. Use it for periodic tasks, so the period does not drift
+Sched_Suspend(byte Task): The task will not run until it is resumed
+Sched_Resume(byte Task): The task will run in the next pass
+
+Example:
+
+   #DEFINE  SchedTasks  2              //Before including this library
+   #DEFINE  TaskSense   0
+   #DEFINE  TaskBlink   1
+   ...
+   while (TRUE) {
+      if (Sched_Due(TaskSense)) SenseTask();
+      if (Sched_Due(TaskBlink)) BlinkTask();
+   }
+
+   void BlinkTask()
+   {
+      output_toggle(LED);
+      Sched_Every(TaskBlink, 38);      //Every 0.5s
+   }
+
+CONFIGURATION:
+Define SchedTasks (number of tasks) before including the library. Tasks are
+numbered from 0 to SchedTasks-1 and all of them start active and due. Include
+Timers.h before this library.
+*/
+
+#ifndef SchedTasks
+#define  SchedTasks        4        //Number of tasks
+#endif
+
+int16 TaskWake[SchedTasks];         //Wake-up deadline of each task
+byte  TaskStep[SchedTasks];         //Step of the state machine of each task
+int1  TaskActive[SchedTasks];       //FALSE if the task is suspended
+
+
+int16 Sched_Now()
+//Current tick
+{
+   return (Timer_Now());
+}
+
+void Sched_Init()
+//All tasks active, due and at step 0
+{
+   byte Task;
+
+   for(Task=0;Task<SchedTasks;Task++) {
+      TaskWake[Task]=0;
+      TaskStep[Task]=0;
+      TaskActive[Task]=TRUE;
+   }
+}
+
+int1 Sched_Due(byte Task)
+//True if the task must run now
+{
+   if (!TaskActive[Task]) return (false);
+   return ((sint16)(Sched_Now()-TaskWake[Task])>=0);
+}
+
+void Sched_Sleep(byte Task, int16 Ticks)
+//Run the task again after some ticks from now
+{
+   TaskWake[Task]=Sched_Now()+Ticks;
+}
+
+void Sched_Every(byte Task, int16 Ticks)
+//Run the task again some ticks after its last deadline (periodic tasks)
+{
+   TaskWake[Task]+=Ticks;
+   if ((sint16)(Sched_Now()-TaskWake[Task])>(sint16)Ticks)
+      TaskWake[Task]=Sched_Now();   //Too late. Do not try to catch up
+}
+
+void Sched_Suspend(byte Task)
+//Stop running the task
+{
+   TaskActive[Task]=FALSE;
+}
+
+void Sched_Resume(byte Task)
+//Run the task again from the next pass
+{
+   TaskWake[Task]=Sched_Now();
+   TaskActive[Task]=TRUE;
+}
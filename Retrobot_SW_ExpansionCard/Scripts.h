@@ -0,0 +1,95 @@
+/*
+Library:       Scripts.h
+Purpose:       Motion scripts of RetroBot stored in program memory
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+Scripts for MotionScript.h. ScriptROM has all the scripts one after the other
+and ScriptROMStart the address where each one starts. Times are in ticks of
+13.1ms (76 ticks = 1s).
+
+SCRIPTS:
+SCRIPT_DANCE      Turn one way and the other 8 times with the maraca and the
+                  audio cassette on, then extend and compress the right arm
+SCRIPT_SHOULDER   Move up and down the left shoulder
+SCRIPT_ARM        Extend and compress the right arm
+SCRIPT_HAND       Open and close the right hand, with the light of the arm
+SCRIPT_MARACA     Shake the maraca for 2s
+SCRIPT_FORWARD    Go forward for 1s
+SCRIPT_AUDIO      Play the audio cassette for 2s
+
+Include it after MotionScript.h and the motor assignment of the program.
+*/
+
+#define  SCRIPT_DANCE       0
+#define  SCRIPT_SHOULDER    1
+#define  SCRIPT_ARM         2
+#define  SCRIPT_HAND        3
+#define  SCRIPT_MARACA      4
+#define  SCRIPT_FORWARD     5
+#define  SCRIPT_AUDIO       6
+#define  ScriptsInROM       7
+
+const byte ScriptROM[]={
+//SCRIPT_DANCE (address 0)
+   SC_OUT, OUT_RELAY, 1,                              //Audio cassette on
+   SC_MOTORS, 1, SC_M(Maraca,SC_BACK),                //Activate maraca
+   SC_LOOP, 8,
+      SC_MOTORS, 2, SC_M(Wheel_R,SC_FWD),  SC_M(Wheel_L,SC_BACK), SC_WAIT, 76,
+      SC_MOTORS, 2, SC_M(Wheel_R,SC_STOP), SC_M(Wheel_L,SC_STOP), SC_WAIT, 76,
+      SC_MOTORS, 2, SC_M(Wheel_R,SC_BACK), SC_M(Wheel_L,SC_FWD),  SC_WAIT, 76,
+      SC_MOTORS, 2, SC_M(Wheel_R,SC_STOP), SC_M(Wheel_L,SC_STOP),
+   SC_NEXT,
+   SC_OUT, OUT_RELAY, 0,                              //Audio cassette off
+   SC_MOTORS, 1, SC_M(Maraca,SC_STOP),
+   SC_CALL, SCRIPT_ARM,
+   SC_END,
+//SCRIPT_SHOULDER (address 40)
+   SC_MOTORS, 1, SC_M(Shoulder_L,SC_FWD),  SC_WAIT, 229, SC_WAIT, 229,  //6s
+   SC_MOTORS, 1, SC_M(Shoulder_L,SC_STOP), SC_WAIT, 76,
+   SC_MOTORS, 1, SC_M(Shoulder_L,SC_BACK), SC_WAIT, 229,               //3s
+   SC_MOTORS, 1, SC_M(Shoulder_L,SC_STOP), SC_WAIT, 153,
+   SC_END,
+//SCRIPT_ARM (address 63)
+   SC_MOTORS, 1, SC_M(Arm_R,SC_FWD),  SC_WAIT, 76,    //Extend
+   SC_MOTORS, 1, SC_M(Arm_R,SC_STOP), SC_WAIT, 76,
+   SC_MOTORS, 1, SC_M(Arm_R,SC_BACK), SC_WAIT, 76,    //Compress
+   SC_MOTORS, 1, SC_M(Arm_R,SC_STOP),
+   SC_END,
+//SCRIPT_HAND (address 82)
+   SC_MOTORS, 1, SC_M(Hand_R,SC_FWD),  SC_WAIT, 76,   //Open
+   SC_MOTORS, 1, SC_M(Hand_R,SC_STOP), SC_WAIT, 76,
+   SC_MOTORS, 1, SC_M(Light_R,SC_BACK), SC_WAIT, 76,  //Light on
+   SC_MOTORS, 2, SC_M(Light_R,SC_STOP), SC_M(Hand_R,SC_BACK), SC_WAIT, 76,
+   SC_MOTORS, 1, SC_M(Hand_R,SC_STOP), SC_WAIT, 76,
+   SC_END,
+//SCRIPT_MARACA (address 109)
+   SC_MOTORS, 1, SC_M(Maraca,SC_BACK), SC_WAIT, 153,
+   SC_MOTORS, 1, SC_M(Maraca,SC_STOP), SC_WAIT, 153, SC_WAIT, 152,
+   SC_END,
+//SCRIPT_FORWARD (address 122)
+   SC_MOTORS, 2, SC_M(Wheel_R,SC_FWD),  SC_M(Wheel_L,SC_FWD), SC_WAIT, 76,
+   SC_MOTORS, 2, SC_M(Wheel_R,SC_STOP), SC_M(Wheel_L,SC_STOP),
+   SC_END,
+//SCRIPT_AUDIO (address 133)
+   SC_OUT, OUT_RELAY, 1, SC_WAIT, 153,
+   SC_OUT, OUT_RELAY, 0, SC_WAIT, 153, SC_WAIT, 152,
+   SC_END
+};
+
+const int16 ScriptROMStart[ScriptsInROM]={0, 40, 63, 82, 109, 122, 133};
+
+
+byte Script_ROM(int16 Address)
+//Byte of the scripts in program memory
+{
+   return (ScriptROM[Address]);
+}
+
+int16 Script_ROMStart(byte Script)
+//Address of a script in program memory
+{
+   if (Script>=ScriptsInROM) return (SCRIPT_NONE);
+   return (ScriptROMStart[Script]);
+}
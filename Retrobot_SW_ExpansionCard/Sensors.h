@@ -0,0 +1,211 @@
+/*
+Library:       Sensors.h
+Purpose:       Sampling of the sensors, each one at its own rate, without
+               waiting for any of them
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The program has several sensors (ie. sonar, temperature, PIR, ADC channels),
+numbered by priority: 0 is the highest. Each one has a period (ticks from the
+start of a sample to the start of the next one, 0: as fast as it can) and a
+maximum age (ticks a value is still good for). Sensor_Service(), called on
+every pass of the main loop, does a step of the samples in progress and starts
+the sensor of highest priority that is due, only one for each call, so a pass
+never has to wait for several sensors at once. Sensor_Sample() is called with
+First true to start the sample (ie. queue an I2C read, start a conversion) and
+then once in each pass until it is finished. It never waits for the hardware:
+it returns SENSOR_BUSY and looks again in the next pass.
+
+A sample that finishes is published with Sensor_Put(): the value and the time
+(Perf_Now()) it was taken. Sensor_Fresh() tells if the last value is still good
+for its maximum age, so a consumer does not act on an old value when a sensor
+has stopped answering.
+
+Counters (never cleared but by Sensor_Init()):
+Sensor_Samples[s]    Samples of sensor s published
+Sensor_Fails[s]      Samples that failed
+Sensor_Stale[s]      Values that got older than the maximum age before the
+                     next one came
+Sensor_LateMax[s]    Longest delay (ticks) from due to started, because higher
+                     sensors were started first
+
+FUNCTIONS:
+Sensor_Init(): No sensor configured (none is sampled). Counters to 0
+Sensor_Config(byte S, int16 Period, int16 MaxAge): Sample sensor S every Period
+ticks. Its values are good for MaxAge ticks. The first sample is due at once
+Sensor_Service(): A step of the sampling. Call it on every pass
+Sensor_Put(byte S, int16 Value): From Sensor_Sample(): the value of a sample
+Sensor_Fresh(byte S): True if the last value of S is not older than its
+maximum age
+Sensor_Age(byte S): Ticks since the last value of S (0xFFFF if there is none)
+Sensor_Reset(): The values are old (ie. after sleeping, when Timer3 has
+stopped) and all the sensors are due. Samples in progress go on
+Sensor_Value[s]: Last value of sensor s
+Sensor_At[s]: Perf_Now() it was taken
+
+Example:
+
+   #define  SensorsNumber  2           //Before including this library
+   #define  SENSOR_PIR     0
+   #define  SENSOR_TEMP    1
+   ...
+   Sensor_Config(SENSOR_PIR, 8, 76);   //105ms, good for 1s
+   Sensor_Config(SENSOR_TEMP, 76, 229);   //1s, good for 3s
+   while (TRUE) {
+      Sensor_Service();
+      ...
+   }
+
+   byte Sensor_Sample (byte S, int1 First)
+   {
+      if (S==SENSOR_PIR) {
+         Sensor_Put(S, input(PIR));
+         return (SENSOR_DONE);
+      }
+      if (First) {
+         Slot=LM75_TempStart(0x9E);
+         return (SENSOR_BUSY);
+      }
+      if (I2C_Busy(Slot)) return (SENSOR_BUSY);
+      Temperature=LM75_TempCollect(Slot);
+      if (LM75_Failed) return (SENSOR_FAIL);
+      Sensor_Put(S, Temperature);
+      return (SENSOR_DONE);
+   }
+
+An ADC channel is sampled the same way: set_adc_channel() and
+read_adc(ADC_START_ONLY) with First, then SENSOR_BUSY until adc_done().
+
+CONFIGURATION:
+Define SensorsNumber before including the library. Include Timers.h and Perf.h
+before this library. The program must define this function (after including
+this library):
+byte Sensor_Sample(byte S, int1 First): a step of the sample of sensor S.
+     Returns SENSOR_BUSY, SENSOR_DONE (after Sensor_Put()) or SENSOR_FAIL
+*/
+
+#ifndef SensorsNumber
+#define  SensorsNumber     4        //Number of sensors
+#endif
+
+//Results of Sensor_Sample()
+#define  SENSOR_BUSY       0        //Not finished. Call again in the next pass
+#define  SENSOR_DONE       1        //Finished. Value published
+#define  SENSOR_FAIL       2        //Finished without a value
+
+#define  SENSOR_NONE    0xFFFF      //Period of a sensor not configured
+#define  SENSOR_OLD     0xFFFF      //Age of a sensor without value
+
+byte Sensor_Sample(byte S, int1 First);
+
+int16 Sensor_Period[SensorsNumber];    //Ticks between samples
+int16 Sensor_MaxAge[SensorsNumber];    //Ticks a value is good for
+int16 Sensor_Due[SensorsNumber];       //Tick the next sample is due
+int1  Sensor_Busy[SensorsNumber];      //Sample in progress
+int1  Sensor_Valid[SensorsNumber];     //There is a value
+int16 Sensor_Value[SensorsNumber];     //Last value
+int32 Sensor_At[SensorsNumber];        //Perf_Now() of the last value
+int16 Sensor_Samples[SensorsNumber];   //Values published
+int16 Sensor_Fails[SensorsNumber];     //Samples failed
+int16 Sensor_Stale[SensorsNumber];     //Values that got too old
+int16 Sensor_LateMax[SensorsNumber];   //Longest start after due (ticks)
+
+
+void Sensor_Init()
+//No sensor configured. Counters to 0
+{
+   byte S;
+
+   for(S=0;S<SensorsNumber;S++) {
+      Sensor_Period[S]=SENSOR_NONE;
+      Sensor_Busy[S]=FALSE;
+      Sensor_Valid[S]=FALSE;
+      Sensor_Samples[S]=0;
+      Sensor_Fails[S]=0;
+      Sensor_Stale[S]=0;
+      Sensor_LateMax[S]=0;
+   }
+}
+
+void Sensor_Config(byte S, int16 Period, int16 MaxAge)
+//Period and maximum age of a sensor. Its first sample is due now
+{
+   Sensor_Period[S]=Period;
+   Sensor_MaxAge[S]=MaxAge;
+   Sensor_Due[S]=Timer_Now();
+}
+
+int16 Sensor_Age(byte S)
+//Ticks since the last value of a sensor
+{
+   int32 Age;
+
+   if (!Sensor_Valid[S]) return (SENSOR_OLD);
+   Age=(Perf_Now()-Sensor_At[S])>>16;
+   if (Age>=SENSOR_OLD) return (SENSOR_OLD);
+   return ((int16)Age);
+}
+
+int1 Sensor_Fresh(byte S)
+//True if the last value is good
+{
+   return (Sensor_Age(S)<=Sensor_MaxAge[S]);
+}
+
+void Sensor_Put(byte S, int16 Value)
+//Publish the value of a sample, taken now
+{
+   if (Sensor_Valid[S] && !Sensor_Fresh(S)) Sensor_Stale[S]++;
+   Sensor_Value[S]=Value;
+   Sensor_At[S]=Perf_Now();
+   Sensor_Valid[S]=TRUE;
+   Sensor_Samples[S]++;
+}
+
+void Sensor_Reset()
+//Values old and all the sensors due
+{
+   byte S;
+   int16 Now;
+
+   Now=Timer_Now();
+   for(S=0;S<SensorsNumber;S++) {
+      Sensor_Valid[S]=FALSE;
+      Sensor_Due[S]=Now;
+   }
+}
+
+void Sensor_Step(byte S, int1 First)
+//A step of the sample of a sensor
+{
+   byte Result;
+
+   Result=Sensor_Sample(S, First);
+   Sensor_Busy[S]=(Result==SENSOR_BUSY);
+   if (Result==SENSOR_FAIL) Sensor_Fails[S]++;
+   if (!Sensor_Busy[S] && (Sensor_Period[S]==0))
+      Sensor_Due[S]=Timer_Now();              //Again as soon as it can
+}
+
+void Sensor_Service()
+//Go on with the samples in progress and start the highest sensor due
+{
+   byte S;
+   int16 Now, Late;
+
+   for(S=0;S<SensorsNumber;S++)
+      if (Sensor_Busy[S]) Sensor_Step(S, FALSE);
+   Now=Timer_Now();
+   for(S=0;S<SensorsNumber;S++) {
+      if (Sensor_Busy[S] || (Sensor_Period[S]==SENSOR_NONE)) continue;
+      Late=Now-Sensor_Due[S];
+      if (Late & 0x8000) continue;           //Not due yet
+      if (Late>Sensor_LateMax[S]) Sensor_LateMax[S]=Late;
+      Sensor_Due[S]+=Sensor_Period[S];       //Periodic, without drift
+      if ((int16)(Now-Sensor_Due[S]) < 0x8000)
+         Sensor_Due[S]=Now+Sensor_Period[S];    //Too late: from now
+      Sensor_Step(S, TRUE);
+      return;                                //One start for each call
+   }
+}
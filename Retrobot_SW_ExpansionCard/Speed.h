@@ -0,0 +1,194 @@
+/*
+Library:       Speed.h
+Purpose:       Speed of the two groups of motors (PWM1 and PWM2 of the card),
+               changed with acceleration ramps a step every tick of Timer3
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The H-bridges of the motors take their enable from PWM1 or PWM2, so all the
+motors of a group go at the same speed. A new speed is not written at once:
+Speed_Tick(), from the Timer3 interrupt, moves the duty of each group towards
+its target by Speed_Accel counts every tick (13.1ms), up and down. A change of
+speed is a trapezoid: ramp, constant speed, ramp.
+
+Speed goes from 0 (stopped) to 255 (full speed). 1 is MinDuty, below it the
+motors do not move, so the ramps skip that part: a group starts from MinDuty
+and a group that slows down below MinDuty goes to 0.
+
+A motor that starts or turns round takes the highest current of all (stall
+current, twice that when turning round at full speed) and can make the wheels
+slip. Speed_Restart() takes its group back to MinDuty before the motor is
+switched on, and the ramp takes it up to its speed again. Motors.h calls it for
+the motors that start or turn round when its motor map has groups.
+
+Stopping a motor (both signals of its H-bridge low) is done at once, whatever
+the speed of its group: it is what the program does when there is an obstacle.
+
+Each group also has a limit (MaxDuty after Speed_Init()): the ramp goes to the
+speed set or to the limit, whichever is lower, so the program can cap the
+duty (ie. Thermal.h when the card is hot) without changing the speeds it
+sets. When the limit goes up again, the group ramps up to its speed.
+
+FUNCTIONS:
+Speed_Init(): Both groups stopped, with the SpeedAccel ramp. Call it before
+enabling interrupts
+Speed_Set(byte Group, byte Speed): Speed (0 to 255) for group 1 or 2. The
+ramp gets there
+Speed_SetDuty(byte Group, int16 Duty): The same with the duty (0 to MaxDuty)
+Speed_Restart(byte Group): The group starts again from MinDuty (if it was
+faster) and ramps up to its speed
+Speed_SetLimit(byte Group, int16 Duty): Highest duty of the group (MinDuty
+to MaxDuty). The ramp takes it down or up
+Speed_Reached(byte Group): True if the group is at its speed (ramp done)
+Speed_Now(byte Group): Duty of the group now
+Speed_Tick(): Must be called from the Timer3 interrupt
+Speed_Write(): Write the duty of both groups to the PWM now (ie. after turning
+the CCP modules on again)
+Speed_Accel[g]: Duty counts per tick of group g+1. 0: no ramp
+
+Example:
+
+   SetMotor (Wheel_R, FORWARD);        //Starts at MinDuty
+   Speed_Set (1, 255);                 //Full speed in 0.3s
+
+CONFIGURATION:
+Define MaxDuty and MinDuty before including the library if the PWM period is
+not the one of RetroBot.c (Timer2 period 199: 800 counts is 100%). SpeedAccel
+is the ramp of both groups after Speed_Init(). Include it before Motors.h and
+MotionScript.h, and call Speed_Tick() from the Timer3 interrupt.
+*/
+
+#ifndef MaxDuty
+#define  MaxDuty         800        //Duty of full speed (100%)
+#endif
+#ifndef MinDuty
+#define  MinDuty         200        //Duty below which the motors do not move
+#endif
+#ifndef SpeedAccel
+#define  SpeedAccel       26        //Duty counts per tick: MinDuty to MaxDuty
+#endif                              //in 23 ticks (0.3s)
+
+#define  SpeedGroups       2        //PWM1 and PWM2
+
+int16 Speed_Target[SpeedGroups];    //Duty the group goes to
+int16 Speed_Limit[SpeedGroups];     //Highest duty of the group
+int16 Speed_Duty[SpeedGroups];      //Duty of the group now
+byte  Speed_Accel[SpeedGroups];     //Duty counts per tick (up and down)
+
+
+void Speed_Write()
+//Duty of both groups to the PWM
+{
+   set_pwm1_duty(Speed_Duty[0]);
+   set_pwm2_duty(Speed_Duty[1]);
+}
+
+void Speed_Init()
+//Both groups stopped, default ramp
+{
+   byte g;
+
+   for(g=0;g<SpeedGroups;g++) {
+      Speed_Target[g]=0;
+      Speed_Limit[g]=MaxDuty;
+      Speed_Duty[g]=0;
+      Speed_Accel[g]=SpeedAccel;
+   }
+   Speed_Write();
+}
+
+void Speed_SetDuty(byte Group, int16 Duty)
+//Duty for group 1 or 2, reached with the ramp
+{
+   if ((Group<1)||(Group>SpeedGroups)) return;
+   if (Duty>MaxDuty) Duty=MaxDuty;
+   disable_interrupts(INT_TIMER3);     //Speed_Tick() reads both bytes
+   Speed_Target[Group-1]=Duty;
+   enable_interrupts(INT_TIMER3);
+}
+
+void Speed_Set(byte Group, byte Speed)
+//Speed (0 stopped, 255 full) for group 1 or 2
+{
+   int16 Duty=0;
+
+   if (Speed!=0) Duty=MinDuty+(int16)(((int32)(MaxDuty-MinDuty)*Speed)/255);
+   Speed_SetDuty(Group, Duty);
+}
+
+void Speed_SetLimit(byte Group, int16 Duty)
+//Highest duty of group 1 or 2, reached with the ramp
+{
+   if ((Group<1)||(Group>SpeedGroups)) return;
+   if (Duty>MaxDuty) Duty=MaxDuty;
+   if (Duty<MinDuty) Duty=MinDuty;     //Slower does not move
+   disable_interrupts(INT_TIMER3);
+   Speed_Limit[Group-1]=Duty;
+   enable_interrupts(INT_TIMER3);
+}
+
+void Speed_Restart(byte Group)
+//Back to MinDuty, so a motor of the group can start without a current peak
+{
+   if ((Group<1)||(Group>SpeedGroups)) return;
+   disable_interrupts(INT_TIMER3);
+   if (Speed_Duty[Group-1]>MinDuty) {
+      Speed_Duty[Group-1]=MinDuty;
+      if (Group==1) set_pwm1_duty(MinDuty);
+      else set_pwm2_duty(MinDuty);
+   }
+   enable_interrupts(INT_TIMER3);
+}
+
+int1 Speed_Reached(byte Group)
+//True if the ramp of the group is over
+{
+   int1 Done;
+   int16 Target;
+
+   if ((Group<1)||(Group>SpeedGroups)) return (TRUE);
+   disable_interrupts(INT_TIMER3);
+   Target=Speed_Target[Group-1];
+   if (Target>Speed_Limit[Group-1]) Target=Speed_Limit[Group-1];
+   Done=(Speed_Duty[Group-1]==Target);
+   enable_interrupts(INT_TIMER3);
+   return (Done);
+}
+
+int16 Speed_Now(byte Group)
+//Duty of the group now (in the middle of the ramp)
+{
+   int16 Duty;
+
+   if ((Group<1)||(Group>SpeedGroups)) return (0);
+   disable_interrupts(INT_TIMER3);
+   Duty=Speed_Duty[Group-1];
+   enable_interrupts(INT_TIMER3);
+   return (Duty);
+}
+
+void Speed_Tick()
+//A step of the ramps. From the Timer3 interrupt
+{
+   byte g;
+   int16 Duty, Target;
+
+   for(g=0;g<SpeedGroups;g++) {
+      Duty=Speed_Duty[g];
+      Target=Speed_Target[g];
+      if (Target>Speed_Limit[g]) Target=Speed_Limit[g];
+      if (Duty==Target) continue;
+      if ((Speed_Accel[g]==0)||(Target==0 && Duty<=MinDuty)) Duty=Target;
+      else if (Duty<Target) {
+         if (Duty<MinDuty) Duty=MinDuty;     //Nothing moves below it
+         else if (Target-Duty>Speed_Accel[g]) Duty+=Speed_Accel[g];
+         else Duty=Target;
+      }
+      else if (Duty-Target>Speed_Accel[g]) Duty-=Speed_Accel[g];
+      else Duty=Target;
+      Speed_Duty[g]=Duty;
+      if (g==0) set_pwm1_duty(Duty);
+      else set_pwm2_duty(Duty);
+   }
+}
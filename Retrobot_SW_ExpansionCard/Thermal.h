@@ -0,0 +1,127 @@
+/*
+Library:       Thermal.h
+Purpose:       Governor of the duty of the motors by the temperature of the
+               card (LM75), with a log of the peak and the throttles
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The eight H-bridges are on the card, and in a long session at full duty they
+heat it up to their thermal shutdown: the motors stop at random until they
+cool down. The program gives each temperature read to Thermal_Update() (ie.
+once a second) and the governor sets the limit of the duty of the PWM groups
+(Speed_SetLimit() of Speed.h):
+
+   up to ThermalStart      MaxDuty: all the speed
+   ThermalStart to Max     from MaxDuty down to MinDuty, a step each degree
+   ThermalMax and over     MinDuty: the motors still move, slowly
+
+The limit goes down as soon as the card gets hotter, but it only goes up
+again when the card has cooled ThermalHyst degrees below the temperature
+that set it, so a reading that goes one degree up and down does not make the
+speed go up and down. The ramps of Speed.h make the changes smooth.
+
+Log (never cleared but by Thermal_Init() or Thermal_Clear()):
+Thermal_Peak         Highest temperature read. ThermalNone (-128, 0x80 as a
+                     byte) until the first reading: LM75.h reads 0 to 150
+                     (0 below 0 degrees), so it is never a temperature
+Thermal_Throttles    Times the limit has gone below MaxDuty (from all speed)
+Thermal_Derated      Readings taken with the limit below MaxDuty (seconds,
+                     with a reading each second)
+Thermal_Lowest       Lowest limit set
+
+FUNCTIONS:
+Thermal_Init(): All speed, log cleared. Call it after Speed_Init()
+Thermal_Update(signed int Celsius): A temperature read. Sets the limit of the
+groups
+Thermal_Clear(): Log cleared (the limit in use goes on)
+Thermal_Limit: Limit of the duty set now
+
+Example:
+
+   Temperature=LM75_TempCollect(Slot);
+   if (!LM75_Failed) Thermal_Update(Temperature);
+
+CONFIGURATION:
+Include Speed.h before this library. ThermalStart, ThermalMax and ThermalHyst
+(degrees C) can be defined before including it. ThermalGroups tells the
+groups limited (bit g: group g, default both).
+*/
+
+#ifndef ThermalStart
+#define  ThermalStart     60        //Degrees: from here the duty goes down
+#endif
+#ifndef ThermalMax
+#define  ThermalMax       80        //Degrees: MinDuty from here
+#endif
+#ifndef ThermalHyst
+#define  ThermalHyst       3        //Degrees to cool before speeding up
+#endif
+#ifndef ThermalGroups
+#define  ThermalGroups  0x06        //Groups 1 and 2
+#endif
+#define  ThermalNone    -128        //Thermal_Peak: nothing read yet
+
+int16 Thermal_Limit;                //Limit of the duty now
+signed int Thermal_SetAt;           //Temperature that set the limit
+signed int Thermal_Peak;            //ThermalNone: no reading
+int16 Thermal_Throttles;
+int16 Thermal_Derated;
+int16 Thermal_Lowest;
+
+
+void Thermal_Clear()
+//Log cleared
+{
+   Thermal_Peak=ThermalNone;
+   Thermal_Throttles=0;
+   Thermal_Derated=0;
+   Thermal_Lowest=MaxDuty;
+}
+
+void Thermal_Set(int16 Limit)
+//Limit of the duty of the groups
+{
+   byte g;
+
+   Thermal_Limit=Limit;
+   for(g=1;g<=SpeedGroups;g++)
+      if (bit_test(ThermalGroups,g)) Speed_SetLimit(g, Limit);
+}
+
+void Thermal_Init()
+//All speed, log cleared
+{
+   Thermal_Clear();
+   Thermal_SetAt=-128;
+   Thermal_Set(MaxDuty);
+}
+
+int16 Thermal_DutyAt(signed int Celsius)
+//Limit of the duty at a temperature
+{
+   if (Celsius<=ThermalStart) return (MaxDuty);
+   if (Celsius>=ThermalMax) return (MinDuty);
+   return (MaxDuty-(int16)(((int32)(MaxDuty-MinDuty)*(Celsius-ThermalStart))/
+                           (ThermalMax-ThermalStart)));
+}
+
+void Thermal_Update(signed int Celsius)
+//A temperature read: limit of the duty
+{
+   int16 Limit;
+
+   if (Celsius>Thermal_Peak) Thermal_Peak=Celsius;
+   Limit=Thermal_DutyAt(Celsius);
+   if (Limit<Thermal_Limit) {                //Hotter: down at once
+      if (Thermal_Limit==MaxDuty) Thermal_Throttles++;
+      Thermal_SetAt=Celsius;
+      Thermal_Set(Limit);
+   }
+   else if ((Limit>Thermal_Limit)&&(Celsius<=Thermal_SetAt-ThermalHyst)) {
+      Thermal_SetAt=Celsius;                 //Cool enough: up
+      Thermal_Set(Limit);
+   }
+   if (Thermal_Limit<Thermal_Lowest) Thermal_Lowest=Thermal_Limit;
+   if (Thermal_Limit<MaxDuty) Thermal_Derated++;
+}
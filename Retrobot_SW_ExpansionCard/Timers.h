@@ -0,0 +1,184 @@
+/*
+Library:       Timers.h
+Purpose:       Time base of the program (Timer3 tick) and software timers with
+               deadlines kept in a timer wheel
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The Timer3 interrupt only counts one tick (13.1ms) in TimerTicks, so it takes
+the same time whatever the number of timers is. Everything else is done by
+Timer_Service(), called from the main loop.
+
+A timer has a deadline (the tick it expires). Running timers are kept in the
+wheel: TimerWheelSize lists, one for each value of the low bits of the
+deadline. For each tick that has passed, Timer_Service() only looks at the
+list of that tick, so the work does not grow with the number of timers either.
+When a timer expires it is taken out of the wheel, Timer_Fired() becomes true
+and Timer_Expired(Timer) is called (from the main loop, not from the
+interrupt, so it can use the I2C bus or the scheduler).
+
+TimerTicks wraps around every 65536 ticks (14 minutes): timers can be up to
+32767 ticks (7 minutes) long, and times are compared using differences.
+
+FUNCTIONS:
+Timer_Tick(): Must be called from the Timer3 interrupt
+Timer_Now(): Current tick. Interrupts are disabled while it is read, so both
+bytes belong to the same tick
+Timer_Init(): All timers stopped
+Timer_Start(byte Timer, int16 Ticks): The timer expires Ticks ticks from now
+(at least 1). If it was running, it starts again
+Timer_Stop(byte Timer): The timer will not expire
+Timer_Running(byte Timer): True while the timer has not expired
+Timer_Fired(byte Timer): True once the timer has expired (until started again)
+Timer_Left(byte Timer): Ticks left for the timer to expire (0 if not running)
+Timer_Service(): Expire the timers of the ticks passed since the last call
+
+Example:
+
+   #define  TimersNumber  1            //Before including this library
+   #define  TimerBlink    0
+   ...
+   Timer_Start(TimerBlink, 38);        //0.5s
+   while (TRUE) {
+      Timer_Service();
+      ...
+   }
+
+   void Timer_Expired (byte Timer)
+   {
+      if (Timer==TimerBlink) {
+         output_toggle(LED);
+         Timer_Start(TimerBlink, 38);
+      }
+   }
+
+CONFIGURATION:
+Define TimersNumber (up to 254 timers) before including the library. The
+program must define the function void Timer_Expired(byte Timer) (after
+including this library). Call Timer_Init() before enabling interrupts.
+*/
+
+#ifndef TimersNumber
+#define  TimersNumber      4        //Number of timers
+#endif
+
+#define  TimerWheelSize   16        //Lists of the wheel (power of 2)
+#define  TIMER_NONE     0xFF        //End of a list
+
+void Timer_Expired(byte Timer);
+
+int16 TimerTicks=0;                 //Ticks of Timer3 since power on
+int16 TimerServiced=0;              //Last tick done by Timer_Service()
+byte  TimerWheel[TimerWheelSize];   //First timer of each list
+byte  TimerNext[TimersNumber];      //Next timer in the same list
+int16 TimerDeadline[TimersNumber];  //Tick the timer expires
+int1  TimerOn[TimersNumber];        //In the wheel
+int1  TimerDone[TimersNumber];      //Expired
+
+
+void Timer_Tick()
+//Count one tick. Call it from Timer3 interrupt
+{
+   TimerTicks++;
+}
+
+int16 Timer_Now()
+//Current tick. Interrupts are disabled so both bytes belong to the same tick
+{
+   int16 Now;
+
+   disable_interrupts(GLOBAL);
+   Now=TimerTicks;
+   enable_interrupts(GLOBAL);
+   return (Now);
+}
+
+void Timer_Init()
+//All timers stopped
+{
+   byte n;
+
+   for(n=0;n<TimerWheelSize;n++) TimerWheel[n]=TIMER_NONE;
+   for(n=0;n<TimersNumber;n++) {
+      TimerOn[n]=FALSE;
+      TimerDone[n]=FALSE;
+   }
+   TimerServiced=Timer_Now();
+}
+
+void Timer_Stop(byte Timer)
+//Take the timer out of the wheel
+{
+   byte List, n;
+
+   if (!TimerOn[Timer]) return;
+   TimerOn[Timer]=FALSE;
+   List=TimerDeadline[Timer] & (TimerWheelSize-1);
+   if (TimerWheel[List]==Timer) {
+      TimerWheel[List]=TimerNext[Timer];
+      return;
+   }
+   for(n=TimerWheel[List];TimerNext[n]!=Timer;n=TimerNext[n]);
+   TimerNext[n]=TimerNext[Timer];
+}
+
+void Timer_Start(byte Timer, int16 Ticks)
+//The timer will expire some ticks from now
+{
+   byte List;
+   int16 Deadline;
+
+   Timer_Stop(Timer);
+   Deadline=Timer_Now()+Ticks;
+   if ((sint16)(Deadline-TimerServiced)<=0) Deadline=TimerServiced+1;
+   TimerDeadline[Timer]=Deadline;
+   List=Deadline & (TimerWheelSize-1);
+   TimerNext[Timer]=TimerWheel[List];
+   TimerWheel[List]=Timer;
+   TimerOn[Timer]=TRUE;
+   TimerDone[Timer]=FALSE;
+}
+
+int1 Timer_Running(byte Timer)
+//True while the timer has not expired
+{
+   return (TimerOn[Timer]);
+}
+
+int1 Timer_Fired(byte Timer)
+//True if the timer has expired
+{
+   return (TimerDone[Timer]);
+}
+
+int16 Timer_Left(byte Timer)
+//Ticks left for the timer to expire
+{
+   if (!TimerOn[Timer]) return (0);
+   return (TimerDeadline[Timer]-TimerServiced);
+}
+
+void Timer_Service()
+//Expire the timers whose deadline has passed
+{
+   int16 Now;
+   byte List, Timer;
+
+   Now=Timer_Now();
+   while (TimerServiced!=Now) {
+      TimerServiced++;
+      List=TimerServiced & (TimerWheelSize-1);
+      Timer=TimerWheel[List];
+      while (Timer!=TIMER_NONE) {
+         if (TimerDeadline[Timer]!=TimerServiced) {   //Not this turn
+            Timer=TimerNext[Timer];
+            continue;
+         }
+         Timer_Stop(Timer);
+         TimerDone[Timer]=TRUE;
+         Timer_Expired(Timer);
+         Timer=TimerWheel[List];    //The list may have been changed
+      }
+   }
+}
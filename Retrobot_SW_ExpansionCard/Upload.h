@@ -0,0 +1,391 @@
+/*
+Library:       Upload.h
+Purpose:       Bulk upload of the motion scripts or the configuration from the
+               ZX81, in blocks with a CRC, written to the data EEPROM in the
+               background and taken into use when it is all there
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+Without it, a new motion script or a new configuration means programming
+RetroBot.hex again. The ZX81 sends a whole image (all the scripts, or all the
+configuration) in blocks of UploadBlock bytes:
+
+   Upload_Begin()    Target and length of the image
+   Upload_Block()    Each block in order, with the CRC of its data. A block
+                     with a wrong CRC or out of order is refused and the ZX81
+                     sends it again; the block before the one expected is
+                     accepted again (its answer was lost)
+   Upload_End()      CRC of the whole image. The scripts are taken into use
+                     at once, the configuration at the next power on
+
+The blocks go to a staging buffer in RAM (Upload_Buffer), never straight to
+the EEPROM, so the ZX81 is never stopped by the 4ms of each byte of the
+EEPROM: the transfer goes as fast as the Z80 sends. Upload_Step(), called by
+the program each pass of its main loop, writes the buffer to the EEPROM
+behind it, a byte at a time with EE_Start() (EEPROM.h), only the bytes that
+change.
+
+SCRIPTS:
+There are two banks of Upload_BankSize bytes for the scripts in the data
+EEPROM (Upload_BankA and Upload_BankB). Each one has a header and an image of
+the area of MotionScript.h (number of scripts, table, scripts, with the
+addresses of the table counted from the start of the image):
+
+   Seq         Goes up by one with each image uploaded
+   Len(2)      Bytes of the image
+   CRC(2)      CRC of the image
+   Image[Len]
+
+The upload writes the image to the bank not in use while the blocks arrive,
+and the header last, after Upload_End(): Script_EEArea moves to the new bank
+only when the header is written. Upload_Init() takes the good bank with the
+highest Seq, so if the power is lost while uploading, the scripts are the old
+ones (the new image or its header fail the CRC) or the new ones, never a
+mix. A script in the EEPROM that was started before the upload goes on in the
+old bank. Upload_Begin() answers UPLOAD_BUSY while a script runs from the bank
+to be written (the ZX81 starts again later).
+
+CONFIGURATION:
+An image of ConfigSize bytes. Upload_End() writes it to both copies of
+Config.h in the background, as Config_Save() but without stopping the
+program: the second copy, then the first one. Config[] is not changed, as the
+program may have changed it at power on (ie. the addresses of the devices it
+found), so the whole image is used from the next power on. Until then
+Config[] is the configuration in use and Upload_ConfigWaiting is true.
+Upload_Save() writes Config[] the same way (ie. after the ZX81 has changed a
+value): the 88 bytes of Config_Save() would stop the main loop for 350ms. It
+answers UPLOAD_BUSY while Upload_ConfigWaiting, as Config[] would be written
+over the uploaded image: the program must not change Config[] meanwhile.
+
+CRC-16-CCITT (polynomial 0x1021, starting at 0xFFFF), high byte first.
+
+FUNCTIONS:
+Upload_Init(): Bank of the scripts in use. Call it at power on, after
+Config_Init()
+Upload_Begin(byte Target, int16 Len): Start an upload of UPLOAD_SCRIPTS or
+UPLOAD_CONFIG. Returns the status
+Upload_Block(byte Block, int16 CRC, byte *Data, byte Len): A block of the
+image. Returns the status
+Upload_End(int16 CRC): End of the image. Returns the status, and if it is
+UPLOAD_OK the image is being written
+Upload_Abort(): Forget the upload (the image in use stays)
+Upload_Save(): Write Config[] to the EEPROM in the background. UPLOAD_BUSY
+(nothing is saved) while an upload is being written or an uploaded
+configuration waits for the next power on. An upload still receiving is
+forgotten
+Upload_Step(): Write the next byte to the EEPROM. Returns false when there is
+nothing more to write until the next block or Upload_End()
+Upload_Busy(): True while there are bytes to write to the EEPROM
+Upload_CRC(int16 CRC, byte Data): CRC with one more byte
+Upload_State: UPLOAD_NONE, UPLOAD_RECEIVE or UPLOAD_COMMIT
+Upload_Next: Block expected
+Upload_Bank: Bank of the scripts in use (SCRIPT_NONE: none)
+Upload_Seq: Its Seq
+Upload_Written: Bytes written to the EEPROM by the last upload
+Upload_ConfigWaiting: A configuration has been uploaded. It is used from the
+next power on
+
+Example:
+
+   Status=Upload_Begin(UPLOAD_SCRIPTS, Len);
+   ...
+   Status=Upload_Block(Block, CRC, Data, Bytes);
+   ...
+   if (Upload_End(CRC)==UPLOAD_OK)
+      while (Upload_Step());           //Or a step each pass of the main loop
+
+CONFIGURATION:
+Include EEPROM.h, Config.h and MotionScript.h before this library.
+UploadBlock (bytes of data of a block) can be defined before including it.
+Upload_BankA is Script_EEBase, and the two banks take 2*Upload_BankSize bytes
+from there.
+*/
+
+#ifndef UploadBlock
+#define  UploadBlock      20           //Data bytes of a block
+#endif
+#define  Upload_BankSize 0x180         //Bytes of a bank of scripts
+#define  Upload_BankA    Script_EEBase
+#define  Upload_BankB    (Script_EEBase+Upload_BankSize)
+#define  UploadHeader      5           //Seq, Len(2), CRC(2)
+#define  UploadMaxImage  (Upload_BankSize-UploadHeader)
+#define  UploadRuns        6           //Pieces of the buffer to write at most
+#define  UploadScan       16           //Bytes compared in a step at most
+
+//Targets
+#define  UPLOAD_SCRIPTS    0
+#define  UPLOAD_CONFIG     1
+
+//Status
+#define  UPLOAD_OK         0
+#define  UPLOAD_BUSY       1           //Writing the last one, or a script
+                                       //runs from the bank. Try again. Also
+                                       //Upload_Save() of Upload_ConfigWaiting
+#define  UPLOAD_SIZE       2           //Wrong target or length
+#define  UPLOAD_CRC        3           //Wrong CRC. Send it again
+#define  UPLOAD_ORDER      4           //Not the block expected (Upload_Next)
+#define  UPLOAD_IDLE       5           //No upload started
+#define  UPLOAD_SHORT      6           //Upload_End() before the last block
+
+//Upload_State
+#define  UPLOAD_NONE       0           //No upload
+#define  UPLOAD_RECEIVE    1           //Blocks arriving
+#define  UPLOAD_COMMIT     2           //Image complete, being written
+
+byte  Upload_Buffer[Upload_BankSize];  //Staging buffer
+byte  Upload_State=UPLOAD_NONE;
+byte  Upload_Target;
+int16 Upload_Len;                      //Bytes of the image
+int16 Upload_Base;                     //Where the image goes in the buffer
+int16 Upload_Filled;                   //End of the bytes in the buffer
+byte  Upload_Next;                     //Block expected
+int16 Upload_Dest;                     //Bank being written
+int16 Upload_Bank=SCRIPT_NONE;         //Bank of the scripts in use
+byte  Upload_Seq=0;                    //Seq of that bank
+int16 Upload_Written=0;                //Bytes written by the last upload
+int1  Upload_ConfigWaiting=FALSE;      //Uploaded configuration not in use yet
+
+int16 Upload_RunEE[UploadRuns];        //Pieces of the buffer to write: address
+int16 Upload_RunAt[UploadRuns];        //in the EEPROM, place in the buffer
+int16 Upload_RunLen[UploadRuns];       //and bytes
+byte  Upload_Runs;                     //Pieces
+byte  Upload_Run;                      //Piece being written
+int16 Upload_Pos;                      //Next byte of that piece
+
+
+int16 Upload_CRC(int16 CRC, byte Data)
+//CRC-16-CCITT with one more byte
+{
+   byte n;
+
+   CRC^=(int16)Data<<8;
+   for(n=0;n<8;n++) {
+      if (CRC & 0x8000) CRC=(CRC<<1)^0x1021;
+      else CRC<<=1;
+   }
+   return (CRC);
+}
+
+int1 Upload_BankGood(int16 Bank)
+//True if the header and the image of a bank agree
+{
+   int16 Len, CRC, n;
+
+   Len=make16(EE_Read(Bank+1),EE_Read(Bank+2));
+   if ((Len==0)||(Len>UploadMaxImage)) return (FALSE);
+   CRC=0xFFFF;
+   for(n=0;n<Len;n++) CRC=Upload_CRC(CRC, EE_Read(Bank+UploadHeader+n));
+   return (CRC==make16(EE_Read(Bank+3),EE_Read(Bank+4)));
+}
+
+void Upload_Use(int16 Bank)
+//Scripts from a bank (SCRIPT_NONE: none)
+{
+   Upload_Bank=Bank;
+   if (Bank==SCRIPT_NONE) {
+      Script_EEArea=SCRIPT_NONE;
+      return;
+   }
+   Upload_Seq=EE_Read(Bank);
+   Script_EEArea=Bank+UploadHeader;
+}
+
+void Upload_Init()
+//Good bank with the highest Seq
+{
+   int1 A, B;
+
+   Upload_State=UPLOAD_NONE;
+   Upload_Written=0;
+   Upload_ConfigWaiting=FALSE;
+   A=Upload_BankGood(Upload_BankA);
+   B=Upload_BankGood(Upload_BankB);
+   if (A && B) {
+      if ((sint8)(EE_Read(Upload_BankB)-EE_Read(Upload_BankA))>0)
+         A=FALSE;
+   }
+   if (A) Upload_Use(Upload_BankA);
+   else if (B) Upload_Use(Upload_BankB);
+   else Upload_Use(SCRIPT_NONE);
+}
+
+void Upload_AddRun(int16 EE, int16 At, int16 Len)
+//A piece of the buffer to write
+{
+   Upload_RunEE[Upload_Runs]=EE;
+   Upload_RunAt[Upload_Runs]=At;
+   Upload_RunLen[Upload_Runs]=Len;
+   Upload_Runs++;
+}
+
+int1 Upload_Busy()
+//True while there are bytes to write
+{
+   if (EE_Busy()) return (TRUE);
+   if (Upload_State==UPLOAD_COMMIT) return (TRUE);
+   if (Upload_State==UPLOAD_NONE) return (FALSE);
+   return ((Upload_Run<Upload_Runs)&&
+           (Upload_RunAt[Upload_Run]+Upload_Pos<Upload_Filled));
+}
+
+void Upload_Abort()
+//Forget the upload
+{
+   Upload_State=UPLOAD_NONE;
+}
+
+int1 Upload_InBank(int16 Address)
+//True if an address of a script is in the bank to be written
+{
+   if (!(Address & SCRIPT_INEE)) return (FALSE);
+   Address&=0x03FF;
+   return ((Address>=Upload_Dest)&&(Address<Upload_Dest+Upload_BankSize));
+}
+
+void Upload_ConfigRuns()
+//Both copies of the configuration in the buffer (from 1) to be written
+{
+   byte n, Sum;
+
+   Sum=ConfigSize;
+   for(n=0;n<ConfigSize;n++) Sum+=Upload_Buffer[1+n];
+   Upload_Buffer[0]=ConfigSize;
+   Upload_Buffer[1+ConfigSize]=~Sum;          //Check of Config.h
+   Upload_Buffer[2+ConfigSize]=Sum;           //Bad check
+   Upload_AddRun(Config_EECopy+1+ConfigSize, 2+ConfigSize, 1);
+   Upload_AddRun(Config_EECopy, 0, 1+ConfigSize);
+   Upload_AddRun(Config_EECopy+1+ConfigSize, 1+ConfigSize, 1);
+   Upload_AddRun(Config_EEBase+1+ConfigSize, 2+ConfigSize, 1);
+   Upload_AddRun(Config_EEBase, 0, 1+ConfigSize);
+   Upload_AddRun(Config_EEBase+1+ConfigSize, 1+ConfigSize, 1);
+   Upload_Filled=3+ConfigSize;
+}
+
+byte Upload_Save()
+//Config[] to the EEPROM in the background
+{
+   byte n;
+
+   if (Upload_State==UPLOAD_COMMIT) return (UPLOAD_BUSY);
+   if (Upload_ConfigWaiting) return (UPLOAD_BUSY);   //Not over the upload
+   for(n=0;n<ConfigSize;n++) Upload_Buffer[1+n]=Config[n];
+   Upload_Target=UPLOAD_CONFIG;
+   Upload_Runs=0;
+   Upload_Run=0;
+   Upload_Pos=0;
+   Upload_Written=0;
+   Upload_ConfigRuns();
+   Upload_State=UPLOAD_COMMIT;
+   return (UPLOAD_OK);
+}
+
+byte Upload_Begin(byte Target, int16 Len)
+//Start an upload
+{
+   byte n;
+
+   if (Upload_State==UPLOAD_COMMIT) return (UPLOAD_BUSY);
+   Upload_State=UPLOAD_NONE;
+   Upload_Runs=0;
+   Upload_Run=0;
+   Upload_Pos=0;
+   Upload_Written=0;
+   Upload_Next=0;
+   if ((Target==UPLOAD_SCRIPTS)&&(Len>0)&&(Len<=UploadMaxImage)) {
+      Upload_Dest=(Upload_Bank==Upload_BankA) ? Upload_BankB : Upload_BankA;
+      if (Script_Running) {                   //Not from the bank it writes
+         if (Upload_InBank(ScriptPC)) return (UPLOAD_BUSY);
+         for(n=0;n<ScriptCalls;n++)
+            if (Upload_InBank(ScriptReturn[n])) return (UPLOAD_BUSY);
+      }
+      Upload_Base=UploadHeader;
+      Upload_AddRun(Upload_Dest+UploadHeader, UploadHeader, Len);   //As it
+   }                                                                 //arrives
+   else if ((Target==UPLOAD_CONFIG)&&(Len==ConfigSize))
+      Upload_Base=1;                          //After Size
+   else return (UPLOAD_SIZE);
+   Upload_Target=Target;
+   Upload_Len=Len;
+   Upload_Filled=Upload_Base;
+   Upload_State=UPLOAD_RECEIVE;
+   return (UPLOAD_OK);
+}
+
+byte Upload_Block(byte Block, int16 CRC, byte *Data, byte Len)
+//A block of the image
+{
+   int16 Sum, Left;
+   byte n;
+
+   if (Upload_State!=UPLOAD_RECEIVE) return (UPLOAD_IDLE);
+   if ((byte)(Block+1)==Upload_Next) return (UPLOAD_OK);   //Again: answer lost
+   if (Block!=Upload_Next) return (UPLOAD_ORDER);
+   Left=Upload_Base+Upload_Len-Upload_Filled;
+   if ((Len==0)||(Len>Left)) return (UPLOAD_SIZE);
+   if ((Len!=UploadBlock)&&(Len!=Left)) return (UPLOAD_SIZE);
+   Sum=0xFFFF;
+   for(n=0;n<Len;n++) Sum=Upload_CRC(Sum, Data[n]);
+   if (Sum!=CRC) return (UPLOAD_CRC);
+   for(n=0;n<Len;n++) Upload_Buffer[Upload_Filled++]=Data[n];
+   Upload_Next++;
+   return (UPLOAD_OK);
+}
+
+byte Upload_End(int16 CRC)
+//End of the image: write it (the scripts are used once written, the
+//configuration from the next power on)
+{
+   int16 Sum, n;
+
+   if (Upload_State!=UPLOAD_RECEIVE) return (UPLOAD_IDLE);
+   if (Upload_Filled!=Upload_Base+Upload_Len) return (UPLOAD_SHORT);
+   Sum=0xFFFF;
+   for(n=0;n<Upload_Len;n++) Sum=Upload_CRC(Sum, Upload_Buffer[Upload_Base+n]);
+   if (Sum!=CRC) return (UPLOAD_CRC);
+   if (Upload_Target==UPLOAD_SCRIPTS) {
+      Upload_Buffer[0]=Upload_Seq+1;
+      Upload_Buffer[1]=make8(Upload_Len,1);
+      Upload_Buffer[2]=make8(Upload_Len,0);
+      Upload_Buffer[3]=make8(CRC,1);
+      Upload_Buffer[4]=make8(CRC,0);
+      Upload_AddRun(Upload_Dest, 0, UploadHeader);   //The header last
+   }
+   else {
+      Upload_ConfigRuns();             //Config[] stays until power on
+      Upload_ConfigWaiting=TRUE;
+   }
+   Upload_State=UPLOAD_COMMIT;
+   return (UPLOAD_OK);
+}
+
+int1 Upload_Step()
+//Write the next byte that changes. False if there is nothing to write now
+{
+   int16 At, EE;
+   byte n;
+
+   if (Upload_State==UPLOAD_NONE) return (FALSE);
+   if (EE_Busy()) return (TRUE);
+   for(n=0;n<UploadScan;n++) {
+      if (Upload_Run==Upload_Runs) {
+         if (Upload_State!=UPLOAD_COMMIT) return (FALSE);
+         if (Upload_Target==UPLOAD_SCRIPTS) Upload_Use(Upload_Dest);
+         Upload_State=UPLOAD_NONE;      //All written and in use
+         return (FALSE);
+      }
+      At=Upload_RunAt[Upload_Run]+Upload_Pos;
+      if (At>=Upload_Filled) return (FALSE);  //Until the next block
+      EE=Upload_RunEE[Upload_Run]+Upload_Pos;
+      if (++Upload_Pos==Upload_RunLen[Upload_Run]) {
+         Upload_Run++;
+         Upload_Pos=0;
+      }
+      if (EE_Read(EE)!=Upload_Buffer[At]) {
+         EE_Start(EE, Upload_Buffer[At]);
+         Upload_Written++;
+         return (TRUE);
+      }
+   }
+   return (TRUE);
+}
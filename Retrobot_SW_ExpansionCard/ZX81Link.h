@@ -0,0 +1,341 @@
+/*
+Library:       ZX81Link.h
+Purpose:       Byte transfers with the ZX81 through its data bus, and frames of
+               commands on top of them
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      CCS PCH v4.057
+
+The ZX81 asks for a transfer by raising ZX81_READY (RB0/INT0), with ZX81_DIR
+(RA2) telling the direction. The INT0 interrupt (high priority) puts ZX81_WAIT
+low to stop the Z80, moves one byte between the data lines and a ring buffer,
+and puts ZX81_WAIT high again at once. The main program works only with the
+ring buffers, so the Z80 is stopped just the time needed for one byte.
+
+Data lines: D0 is RC5 and D1..D7 are RB1..RB7. When the ZX81 reads, the card
+drives the data lines until ZX81_READY goes low again (second INT0, on the
+falling edge). If there is nothing to send, ZX81_EMPTY is sent.
+
+FRAMES:
+ZX81 -> card:  ZX81_SYNC_IN,  Cmd, Len, Data[0..Len-1], Chk
+card -> ZX81:  ZX81_SYNC_OUT, Cmd, Len, Data[0..Len-1], Chk
+Chk makes the sum of Cmd, Len, Data and Chk equal to 0 (modulo 256). Len is up
+to ZX81_MaxData. Frames with a wrong Chk are answered with the command
+ZX81_CMD_ERROR. The meaning of each command is up to the main program.
+
+SNAPSHOT:
+A table of ZX81_SnapSize bytes of state (sensors, motors, counters) that the
+ZX81 reads in one burst, with no command frame and no wait for the main
+program: it writes ZX81_SNAP_IN between frames, then reads ZX81_SnapSize+2
+bytes: Seq, Data[0..ZX81_SnapSize-1], Chk (the sum of all of them is 0). The
+INT0 interrupt serves them straight from the snapshot published last, so the
+ZX81 gets a whole snapshot even if the program publishes a new one meanwhile.
+There are two buffers: the program fills one while the ZX81 reads the other,
+and publishing only swaps them, so a burst never sees half a snapshot. If the
+ZX81 is still reading the older buffer when the program starts the next
+snapshot, ZX81_SnapStart() returns false and the snapshot is skipped. Seq goes
+up by one with each snapshot published, so the ZX81 knows if it is a new one.
+Any write of the ZX81 ends the burst. The card does not see the address bus,
+so the snapshot is read in order, not at random like memory.
+
+FUNCTIONS:
+ZX81_Init(): Empty the buffers and enable INT0 on the rising edge
+ZX81_Receive(): Process the bytes received. Returns true when a complete
+frame has arrived. It is left at ZX81_Cmd, ZX81_Len and ZX81_Data[]
+ZX81_ReplyStart(byte Cmd, byte Len): Start a frame to the ZX81. Returns false
+(and nothing is sent) if there is no room for the whole frame
+ZX81_ReplyByte(byte Data): Add a data byte to the frame
+ZX81_ReplyEnd(): Finish the frame (checksum)
+ZX81_SnapStart(): Start a new snapshot. Returns false if the ZX81 is still
+reading the buffer it goes to (nothing must be written then)
+ZX81_SnapByte(byte Data): Add a byte to the snapshot
+ZX81_SnapPublish(): Finish the snapshot (bytes not written are 0) and make it
+the one the ZX81 reads
+
+Example:
+
+   if (ZX81_Receive()) {
+      if (ZX81_Cmd==0x01 && ZX81_ReplyStart(0x01, 1)) {
+         ZX81_ReplyByte(Distance);
+         ZX81_ReplyEnd();
+      }
+   }
+
+   //After each sensing cycle
+   if (ZX81_SnapStart()) {
+      ZX81_SnapByte(Distance);
+      ZX81_SnapByte(Temperature);
+      ZX81_SnapPublish();
+   }
+
+CONFIGURATION:
+Use #device HIGH_INTS=TRUE. RB0 and RA2 must be inputs and RA1 an output. The
+data lines start as inputs. This library is also compiled on a PC by the
+ZX81 stub of Retrobot_SW_Host, so it uses #define and keeps the CCS
+directives inside #ifdef __PCH__. #define ZX81_SnapSize before the #include
+to change the size of the snapshot, and ZX81_MaxData (up to ZX81_RxSize-4, so
+a whole frame fits in the receive buffer) for longer frames.
+*/
+
+#ifdef __PCH__
+#byte ZX81_PORTB   = 0xF81             //Data lines D1..D7 (RB1..RB7)
+#byte ZX81_LATB    = 0xF8A
+#byte ZX81_TRISB   = 0xF93
+#bit  ZX81_D0_IN   = 0xF82.5           //Data line D0 (RC5)
+#bit  ZX81_D0_LAT  = 0xF8B.5
+#bit  ZX81_D0_TRIS = 0xF94.5
+#bit  ZX81_DIR_IN  = 0xF80.2           //RA2. 1:ZX81->ExpCard, 0:ExpCard->ZX81
+#bit  ZX81_WAIT_LAT= 0xF89.1           //RA1. Active low
+#bit  ZX81_INTEDG0 = 0xFF1.6           //INT0 edge. 1:rising, 0:falling
+#endif
+
+#define  ZX81_RxSize      32            //Bytes of receive buffer (power of 2)
+#define  ZX81_TxSize      32            //Bytes of transmit buffer (power of 2)
+#ifndef ZX81_MaxData
+#define  ZX81_MaxData      8            //Max data bytes of a frame
+#endif
+#define  ZX81_EMPTY     0x00            //Sent when there is nothing to send
+#ifndef ZX81_SnapSize
+#define  ZX81_SnapSize    16            //Data bytes of the snapshot
+#endif
+#define  ZX81_SnapBytes  (ZX81_SnapSize+2)   //With Seq and Chk
+
+#define  ZX81_SYNC_IN   0xA5            //First byte of a frame from the ZX81
+#define  ZX81_SYNC_OUT  0x5A            //First byte of a frame to the ZX81
+#define  ZX81_CMD_ERROR 0x7F            //Answer to a wrong frame
+#define  ZX81_ERR_CHK   0x01            //  Data[0]: wrong checksum
+#define  ZX81_ERR_LEN   0x02            //  Data[0]: frame too long
+#define  ZX81_SNAP_IN   0xC3            //ZX81 starts reading the snapshot
+
+//Steps of the frame receiver
+#define  ZX81_RX_SYNC      0            //Waiting for ZX81_SYNC_IN
+#define  ZX81_RX_CMD       1
+#define  ZX81_RX_LEN       2
+#define  ZX81_RX_DATA      3
+#define  ZX81_RX_CHK       4
+
+//ZX81_RxLeft, bytes of the frame still to come as seen by INT0
+#define  ZX81_LEFT_CMD  0xFF            //Cmd, then Len
+#define  ZX81_LEFT_LEN  0xFE            //Len
+
+byte  ZX81_Rx[ZX81_RxSize];            //Bytes from the ZX81
+byte  ZX81_RxIn=0, ZX81_RxOut=0;       //Written by INT0, read by program
+byte  ZX81_Tx[ZX81_TxSize];            //Bytes to the ZX81
+byte  ZX81_TxIn=0, ZX81_TxOut=0;       //Written by program, read by INT0
+byte  ZX81_Overruns=0;                 //Bytes lost because Rx was full
+
+byte  ZX81_RxStep=ZX81_RX_SYNC;        //Step of the frame receiver
+byte  ZX81_Cmd;                        //Command of the frame received
+byte  ZX81_Len;                        //Data bytes of the frame received
+byte  ZX81_Data[ZX81_MaxData];         //Data of the frame received
+byte  ZX81_Count;                      //Data bytes received so far
+byte  ZX81_Sum;                        //Checksum of frame being received
+byte  ZX81_TxSum;                      //Checksum of frame being sent
+byte  ZX81_Errors=0;                   //Frames with errors
+
+byte  ZX81_RxLeft=0;                   //Bytes of frame to come. 0: between
+byte  ZX81_Snap[2*ZX81_SnapBytes];     //Snapshot buffers
+byte  ZX81_SnapFront=0;                //Start of the one published
+byte  ZX81_SnapBack;                   //Start of the one being filled
+byte  ZX81_SnapIn;                     //Next byte filled by the program
+byte  ZX81_SnapOut;                    //Next byte read by the ZX81
+byte  ZX81_SnapLeft=0;                 //Bytes left of the burst. 0: none
+byte  ZX81_SnapSeq=0;                  //Sequence of the last one published
+byte  ZX81_SnapSum;                    //Checksum of the one being filled
+int16 ZX81_SnapSkips=0;                //Snapshots skipped: buffer being read
+
+
+#ifdef __PCH__
+#INT_EXT HIGH
+#endif
+//INT0 Interrupt. The ZX81 wants to transfer a byte
+void ZX81_isr()
+{
+   byte Data, Next;
+
+   if (!ZX81_INTEDG0) {                //READY went low. End of ZX81 read
+      ZX81_TRISB|=0xFE;                //Release data lines
+      ZX81_D0_TRIS=1;
+      ZX81_INTEDG0=1;
+      return;
+   }
+   ZX81_WAIT_LAT=0;                    //Stop the Z80
+   if (ZX81_DIR_IN) {                  //ZX81 writes
+      Data=ZX81_PORTB & 0xFE;
+      if (ZX81_D0_IN) Data|=1;
+      Next=(ZX81_RxIn+1)&(ZX81_RxSize-1);
+      if (Next!=ZX81_RxOut) {
+         ZX81_Rx[ZX81_RxIn]=Data;
+         ZX81_RxIn=Next;
+      }
+      else ZX81_Overruns++;
+      ZX81_SnapLeft=0;                 //A write ends the snapshot burst
+      if (ZX81_RxLeft==0) {            //Between frames
+         if (Data==ZX81_SYNC_IN) ZX81_RxLeft=ZX81_LEFT_CMD;
+         else if (Data==ZX81_SNAP_IN) {
+            ZX81_SnapOut=ZX81_SnapFront;
+            ZX81_SnapLeft=ZX81_SnapBytes;
+         }
+      }
+      else if (ZX81_RxLeft==ZX81_LEFT_CMD) ZX81_RxLeft=ZX81_LEFT_LEN;
+      else if (ZX81_RxLeft==ZX81_LEFT_LEN)
+         ZX81_RxLeft=(Data>ZX81_MaxData) ? 0 : Data+1;   //Data and Chk
+      else ZX81_RxLeft--;
+   }
+   else {                              //ZX81 reads
+      Data=ZX81_EMPTY;
+      if (ZX81_SnapLeft) {             //Snapshot burst
+         Data=ZX81_Snap[ZX81_SnapOut++];
+         ZX81_SnapLeft--;
+      }
+      else if (ZX81_TxOut!=ZX81_TxIn) {
+         Data=ZX81_Tx[ZX81_TxOut];
+         ZX81_TxOut=(ZX81_TxOut+1)&(ZX81_TxSize-1);
+      }
+      ZX81_LATB=(ZX81_LATB & 0x01)|(Data & 0xFE);
+      ZX81_D0_LAT=Data & 1;
+      ZX81_TRISB&=0x01;                //Drive data lines
+      ZX81_D0_TRIS=0;
+      ZX81_INTEDG0=0;                  //Release them when READY goes low
+   }
+   ZX81_WAIT_LAT=1;                    //Let the Z80 go on
+}
+
+
+void ZX81_Init()
+//Empty buffers and wait for the ZX81
+{
+   ZX81_RxIn=ZX81_RxOut=0;
+   ZX81_TxIn=ZX81_TxOut=0;
+   ZX81_RxStep=ZX81_RX_SYNC;
+   ZX81_RxLeft=0;
+   ZX81_SnapLeft=0;
+   ZX81_WAIT_LAT=1;
+   ZX81_TRISB|=0xFE;                   //Data lines as inputs
+   ZX81_D0_TRIS=1;
+   ZX81_INTEDG0=1;                     //Rising edge of READY
+   clear_interrupt(INT_EXT);
+   enable_interrupts(INT_EXT);
+}
+
+byte ZX81_TxFree()
+//Free bytes in the transmit buffer
+{
+   return ((ZX81_TxOut-ZX81_TxIn-1)&(ZX81_TxSize-1));
+}
+
+void ZX81_Send(byte Data)
+//Put a byte in the transmit buffer (there must be room)
+{
+   ZX81_Tx[ZX81_TxIn]=Data;
+   ZX81_TxIn=(ZX81_TxIn+1)&(ZX81_TxSize-1);
+}
+
+int1 ZX81_ReplyStart(byte Cmd, byte Len)
+//Start a frame to the ZX81. False if it does not fit in the buffer
+{
+   if (ZX81_TxFree()<Len+4) return (false);
+   ZX81_Send(ZX81_SYNC_OUT);
+   ZX81_Send(Cmd);
+   ZX81_Send(Len);
+   ZX81_TxSum=Cmd+Len;
+   return (true);
+}
+
+void ZX81_ReplyByte(byte Data)
+//Add a data byte to the frame
+{
+   ZX81_Send(Data);
+   ZX81_TxSum+=Data;
+}
+
+void ZX81_ReplyEnd()
+//Finish the frame with the checksum
+{
+   ZX81_Send(-ZX81_TxSum);
+}
+
+int1 ZX81_SnapStart()
+//Start a new snapshot in the buffer not published. False if it is being read
+{
+   ZX81_SnapBack=(ZX81_SnapFront==0) ? ZX81_SnapBytes : 0;
+   if (ZX81_SnapLeft && (ZX81_SnapOut>=ZX81_SnapBack) &&
+       (ZX81_SnapOut<ZX81_SnapBack+ZX81_SnapBytes)) {
+      ZX81_SnapSkips++;                //The ZX81 is still reading it
+      return (false);
+   }
+   ZX81_SnapIn=ZX81_SnapBack+1;        //After Seq
+   ZX81_SnapSum=0;
+   return (true);
+}
+
+void ZX81_SnapByte(byte Data)
+//Add a byte to the snapshot
+{
+   ZX81_Snap[ZX81_SnapIn++]=Data;
+   ZX81_SnapSum+=Data;
+}
+
+void ZX81_SnapPublish()
+//Finish the snapshot and swap the buffers
+{
+   while (ZX81_SnapIn<ZX81_SnapBack+ZX81_SnapBytes-1) ZX81_SnapByte(0);
+   ZX81_SnapSeq++;
+   ZX81_Snap[ZX81_SnapBack]=ZX81_SnapSeq;
+   ZX81_Snap[ZX81_SnapIn]=-(byte)(ZX81_SnapSum+ZX81_SnapSeq);
+   ZX81_SnapFront=ZX81_SnapBack;       //Next bursts read this one
+}
+
+void ZX81_Error(byte Code)
+//Answer a wrong frame
+{
+   ZX81_Errors++;
+   if (!ZX81_ReplyStart(ZX81_CMD_ERROR, 1)) return;
+   ZX81_ReplyByte(Code);
+   ZX81_ReplyEnd();
+}
+
+int1 ZX81_Receive()
+//Process received bytes. True when a complete frame is ready
+{
+   byte Data;
+
+   while (ZX81_RxOut!=ZX81_RxIn) {
+      Data=ZX81_Rx[ZX81_RxOut];
+      ZX81_RxOut=(ZX81_RxOut+1)&(ZX81_RxSize-1);
+      switch (ZX81_RxStep) {
+         case ZX81_RX_SYNC:
+            if (Data==ZX81_SYNC_IN) ZX81_RxStep=ZX81_RX_CMD;
+            break;
+         case ZX81_RX_CMD:
+            ZX81_Cmd=Data;
+            ZX81_Sum=Data;
+            ZX81_RxStep=ZX81_RX_LEN;
+            break;
+         case ZX81_RX_LEN:
+            if (Data>ZX81_MaxData) {
+               ZX81_Error(ZX81_ERR_LEN);
+               ZX81_RxStep=ZX81_RX_SYNC;
+               break;
+            }
+            ZX81_Len=Data;
+            ZX81_Sum+=Data;
+            ZX81_Count=0;
+            ZX81_RxStep=(Data==0) ? ZX81_RX_CHK : ZX81_RX_DATA;
+            break;
+         case ZX81_RX_DATA:
+            ZX81_Data[ZX81_Count++]=Data;
+            ZX81_Sum+=Data;
+            if (ZX81_Count==ZX81_Len) ZX81_RxStep=ZX81_RX_CHK;
+            break;
+         case ZX81_RX_CHK:
+            ZX81_RxStep=ZX81_RX_SYNC;
+            if ((byte)(ZX81_Sum+Data)!=0) {
+               ZX81_Error(ZX81_ERR_CHK);
+               break;
+            }
+            return (true);
+      }
+   }
+   return (false);
+}
@@ -0,0 +1,281 @@
+/*
+Library:       HostDevices.h
+Purpose:       Models of the I2C chips of the Expansion Card (MCP23016, SRF02
+               and LM75) for the PC build of the firmware
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      g++ (Linux)
+
+Each chip answers on the simulated I2C bus of HostHAL.h the way the datasheet
+says, register by register, so the drivers of the firmware are tested as they
+are. Things the firmware must never do are counted as errors (ie. talking to
+the MCP23016 without the bus free time it needs, or polling the SRF02 before
+its ranging could be done), and the chip does not acknowledge, as the real one
+would fail.
+
+HostMCP23016(byte Address)
+   Registers GP0..IOCON1. The command byte selects a register; each data byte
+   then goes to it and the pointer toggles to the other register of the pair.
+   Writing GPn writes OLATn. GPn reads the latch for outputs and PinsIn[] for
+   inputs (IPOLn inverts the inputs). OnOutput is called when the level of the
+   output pins changes. Needs MinGap cycles of bus free time after each of its
+   Stops before the next Start (GapErrors otherwise).
+
+HostSRF02(byte Address)
+   Register 0: command (write) or software revision (read), 2-3: range,
+   4-5: minimum range. Commands 0x50, 0x51 and 0x52 start a ranging in inches,
+   cm or us, that takes RangingCycles; the range is given by Measure() when the
+   ranging starts. It does not answer while ranging, as the datasheet says:
+   that is how the end of the ranging is polled (Polls). Polls sooner than
+   MinPoll after the command only load the bus (EarlyPolls). Latency adds the
+   time from the end of each ranging to the read of its result. It obeys the
+   ranging commands sent to the general call address.
+
+HostLM75(byte Address)
+   Pointer 0: temperature (2 bytes, HalfDegrees/2 degrees), 1: configuration,
+   2: hysteresis, 3: overtemperature.
+
+CONFIGURATION:
+Include HostHAL.h before this library and attach the devices to the bus with
+Host_I2CAttach().
+*/
+
+#ifndef HOSTDEVICES_H
+#define HOSTDEVICES_H
+
+class HostMCP23016 : public HostI2CDevice
+{
+public:
+   byte Reg[12];                    //GP0,GP1,OLAT0,OLAT1 ... IOCON0,IOCON1
+   byte Pointer;                    //Register selected
+   int1 Command;                    //Next byte written is the command byte
+   int1 Selected;                   //Addressed since the last Start
+   byte PinsIn[2];                  //Level of the pins of port 0 and 1
+   uint64_t LastStop;               //Cycle of its last Stop
+   uint64_t MinGap;                 //Cycles of bus free time it needs
+   unsigned long Commands;          //Transactions with a command byte
+   unsigned long GapErrors;         //Started too soon after a Stop
+   void (*OnOutput)(int16 Old, int16 New);
+
+   HostMCP23016(byte A) : HostI2CDevice(A)
+   {
+      memset(Reg, 0, sizeof(Reg));
+      Reg[6]=Reg[7]=0xFF;           //IODIR: all inputs
+      Pointer=0;
+      Command=FALSE;
+      Selected=FALSE;
+      PinsIn[0]=PinsIn[1]=0;
+      LastStop=0;
+      MinGap=250;                   //50us
+      Commands=GapErrors=0;
+      OnOutput=NULL;
+   }
+
+   int16 Outputs()
+   //Level of the pins used as outputs (inputs read as 0)
+   {
+      return ((int16)(((Reg[3] & ~Reg[7])<<8)|(Reg[2] & ~Reg[6])));
+   }
+
+   int1 Start(int1 Read)
+   {
+      if (LastStop && (HostSspStartAt-LastStop<MinGap)) {
+         GapErrors++;
+         return (FALSE);
+      }
+      Selected=TRUE;
+      Command=!Read;
+      return (TRUE);
+   }
+
+   int1 Write(byte Data)
+   {
+      int16 Old;
+
+      if (Command) {                //Command byte: register to use
+         if (Data>11) return (FALSE);
+         Pointer=Data;
+         Command=FALSE;
+         Commands++;
+         return (TRUE);
+      }
+      Old=Outputs();
+      if (Pointer<=1) Reg[Pointer+2]=Data;     //GPn writes OLATn
+      else if (Pointer<8 || Pointer>9) Reg[Pointer]=Data;
+      Pointer^=1;
+      if (OnOutput && Outputs()!=Old) OnOutput(Old, Outputs());
+      return (TRUE);
+   }
+
+   byte Read()
+   {
+      byte Data, Port;
+
+      if (Pointer<=1) {
+         Port=Pointer;
+         Data=(Reg[Port+2] & ~Reg[Port+6])|
+              ((PinsIn[Port]^Reg[Port+4]) & Reg[Port+6]);
+      }
+      else Data=Reg[Pointer];
+      Pointer^=1;
+      return (Data);
+   }
+
+   void Stop()
+   {
+      if (Selected) LastStop=HostCycles;
+      Selected=FALSE;
+   }
+};
+
+
+class HostSRF02 : public HostI2CDevice
+{
+public:
+   byte Pointer;
+   int1 Command;                    //Next byte written is the register
+   uint64_t Ready;                  //Cycle the ranging in progress finishes
+   uint64_t RangingCycles;          //Time of a ranging
+   uint64_t MinPoll;                //Polls before this time are too early
+   int16 Range;                     //Result of last ranging
+   int1  Waiting;                   //Result not read yet
+   unsigned long Rangings;          //Rangings done
+   unsigned long Polls;             //Addressed while ranging (NAK)
+   unsigned long EarlyPolls;        //Polled too soon after the command
+   uint64_t Latency;                //Cycles from ranging done to result read
+   int16 (*Measure)();              //Distance in cm to the obstacle
+
+   HostSRF02(byte A) : HostI2CDevice(A)
+   {
+      Pointer=0;
+      Command=FALSE;
+      Ready=0;
+      RangingCycles=330000;         //66ms
+      MinPoll=300000;               //60ms
+      Range=0;
+      Waiting=FALSE;
+      Rangings=Polls=EarlyPolls=0;
+      Latency=0;
+      Measure=NULL;
+      General=TRUE;
+   }
+
+   int1 Start(int1 Read)
+   {
+      if (HostCycles<Ready) {
+         Polls++;
+         if (Ready-HostCycles>RangingCycles-MinPoll) EarlyPolls++;
+         return (FALSE);
+      }
+      Command=!Read;
+      return (TRUE);
+   }
+
+   int1 Write(byte Data)
+   {
+      int16 Cm;
+
+      if (Command) {
+         Pointer=Data;
+         Command=FALSE;
+         return (TRUE);
+      }
+      if (Pointer==0 && Data>=0x50 && Data<=0x52) {
+         Cm=Measure ? Measure() : 0;
+         Range=Cm;
+         if (Data==0x50) Range=(Cm*100+127)/254;
+         if (Data==0x52) Range=Cm*58;
+         Ready=HostCycles+RangingCycles;
+         Waiting=TRUE;
+         Rangings++;
+      }
+      Pointer++;
+      return (TRUE);
+   }
+
+   byte Read()
+   {
+      byte Data;
+
+      if (Pointer==2 && Waiting) {     //Result read
+         Latency+=HostCycles-Ready;
+         Waiting=FALSE;
+      }
+      switch (Pointer) {
+         case 0:  Data=6;                 break;   //Software revision
+         case 2:  Data=make8(Range,1);    break;
+         case 3:  Data=make8(Range,0);    break;
+         case 4:  Data=0;                 break;   //Minimum range: 16cm
+         case 5:  Data=16;                break;
+         default: Data=0x80;
+      }
+      Pointer++;
+      return (Data);
+   }
+};
+
+
+class HostLM75 : public HostI2CDevice
+{
+public:
+   byte Pointer;
+   int1 Command;
+   byte Index;                      //Byte of the register being read or written
+   byte Config;
+   int16 Hyst, Os;                  //Registers of 9 bits, left aligned
+   int HalfDegrees;                 //Temperature in 0.5 degrees
+
+   HostLM75(byte A) : HostI2CDevice(A)
+   {
+      Pointer=0;
+      Command=FALSE;
+      Index=0;
+      Config=0;
+      Hyst=75<<8;
+      Os=80<<8;
+      HalfDegrees=50;               //25 degrees
+   }
+
+   int16 Value()
+   //Register selected by the pointer, left aligned
+   {
+      switch (Pointer & 3) {
+         case 0:  return ((int16)(HalfDegrees<<7));
+         case 1:  return ((int16)(Config<<8));
+         case 2:  return (Hyst);
+      }
+      return (Os);
+   }
+
+   int1 Start(int1 Read)
+   {
+      Command=!Read;
+      Index=0;
+      return (TRUE);
+   }
+
+   int1 Write(byte Data)
+   {
+      if (Command) {
+         Pointer=Data & 3;
+         Command=FALSE;
+         return (TRUE);
+      }
+      if (Pointer==1) Config=Data;
+      if (Pointer==2) Hyst=Index ? (Hyst & 0xFF00)|(Data & 0x80) : (Data<<8);
+      if (Pointer==3) Os=Index ? (Os & 0xFF00)|(Data & 0x80) : (Data<<8);
+      Index++;
+      return (TRUE);
+   }
+
+   byte Read()
+   {
+      byte Byte=(Pointer==1) ? 0 : (Index & 1);
+
+      Index++;
+      if (Byte==0) return (make8(Value(),1));
+      return (make8(Value(),0) & 0x80);
+   }
+};
+
+#endif
@@ -0,0 +1,807 @@
+/*
+Library:       HostHAL.h
+Purpose:       CCS built-ins and PIC18F2620 peripherals used by the firmware of
+               the Expansion Card, for building it on a PC
+Developer:     Quark Robotics
+Date:          October 2026
+Compiler:      g++ (Linux)
+
+With this library the sources of Retrobot_SW_ExpansionCard compile with g++
+as they are. Each CCS built-in the firmware uses (delay_ms, output_high, input,
+set_pwm1_duty, enable_interrupts, read_eeprom...) is a function here, and the
+registers the libraries declare with #byte/#bit (MSSP) are objects that act
+like the peripheral.
+
+VIRTUAL CLOCK:
+HostCycles counts instruction cycles of the PIC (200ns at 20MHz). The clock
+only moves inside the built-ins: delays move it their time, every other
+built-in HostCallCycles, and each interrupt HostIsrCycles. Code between two
+built-ins takes no time, so the times measured for code are a lower bound,
+while delays, timers and the I2C bus are exact. A loop that waits for an
+interrupt must call a built-in (ie. delay_cycles(1)) or the PC never leaves it.
+
+INTERRUPTS:
+Timer0, Timer3, MSSP and INT0 set their flag when their event arrives in the
+virtual clock. If the interrupt and GLOBAL are enabled, the function given with
+Host_Interrupt() is run, as the #INT_xxx directive does in CCS. INT0 is served
+first (high priority). An interrupt never interrupts another one.
+INT0 comes at the cycle HostInt0At, after calling HostOnInt0 (that sets the
+data lines of the ZX81 and the next HostInt0At).
+
+SLEEP:
+sleep() moves the clock to the watchdog timeout (HostWdtCycles after the last
+restart_wdt(), TO bit cleared) or to the next INT0 if it is enabled, whichever
+comes first, plus the start of the oscillator. Timer0 and Timer3 do not count
+while sleeping, and the I2C bus must be idle. HostOnSleep is called with the
+cycles slept.
+
+I2C BUS:
+The MSSP module is simulated at the register level (SEN, RSEN, PEN, RCEN,
+ACKEN, ACKDT, ACKSTAT, SSPBUF) with the bit time given by SSPADD. The devices
+of the bus are objects derived from HostI2CDevice (see HostDevices.h) attached
+with Host_I2CAttach(). A write to address 0x00 (general call) goes to all the
+devices with General set.
+A bus fault can be made at a cycle with HostI2CHangAt: a device holds SDA low
+and the MSSP action in progress never ends (no more MSSP interrupts). The
+device lets SDA go after HostHangClocks clocks given on SCL with the MSSP off
+(TRISC3 low then high, LATC3 low), and the MSSP works again when it is turned
+on with SDA released.
+
+DATA EEPROM:
+read_eeprom() and write_eeprom() work on HostEEPROM[], and write_eeprom() takes
+the 4ms of the write as CCS waits for it. EEPROM.h writes in the background
+with the registers (EECON1, EECON2, EEDATA, EEADR, EEADRH): a write starts when
+WR is set with WREN just after 0x55 and 0xAA have been written to EECON2 with
+the interrupts disabled, and ends HostEEWrite cycles later (WR cleared, EEIF
+set). A write started any other way, or a read or write of the EEPROM while a
+write is in progress, counts in HostEEErrors.
+
+FUNCTIONS (for the PC program):
+Host_Interrupt(int Source, HostIsr Isr): Function run by an interrupt
+Host_I2CAttach(HostI2CDevice *Device): Put a device on the I2C bus
+Host_Advance(uint64_t Cycles): Move the virtual clock (built-ins use it)
+Host_Seconds(): Virtual time in seconds
+Host_PWM(byte Ccp): Duty cycle of PWM 1 or 2, from 0 to 1
+HostOnPin: Function called when the program changes a pin of the PIC
+HostOnPWM: Function called before the program changes the duty or the mode of
+PWM 1 or 2 (ie. to account the time run with the old one)
+HostOnSleep: Function called when the PIC wakes up, with the cycles slept
+HostReadPin: Function giving the level of an input pin of the PIC
+HostEnd: The run stops (HostStop is thrown) when the clock gets here
+HostEEPROM[]: Data EEPROM (starts erased, 0xFF)
+
+CONFIGURATION:
+Include this library before the firmware, and build the firmware without
+__PCH__ defined (it is only defined by the CCS compiler). The firmware uses C
+integer promotion here, so code that relies on 8 bit wrap-around must cast or
+mask, as the libraries do.
+*/
+
+#ifndef HOSTHAL_H
+#define HOSTHAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+//CCS types
+typedef uint8_t  byte;
+typedef uint8_t  int8;
+typedef uint16_t int16;
+typedef uint32_t int32;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+typedef bool     int1;
+
+#define TRUE   1
+#define FALSE  0
+
+//Pins: address of the port * 8 + bit, as CCS does
+#define PIN_A0 31744
+#define PIN_A1 31745
+#define PIN_A2 31746
+#define PIN_A3 31747
+#define PIN_A4 31748
+#define PIN_A5 31749
+#define PIN_A6 31750
+#define PIN_A7 31751
+#define PIN_B0 31752
+#define PIN_B1 31753
+#define PIN_B2 31754
+#define PIN_B3 31755
+#define PIN_B4 31756
+#define PIN_B5 31757
+#define PIN_B6 31758
+#define PIN_B7 31759
+#define PIN_C0 31760
+#define PIN_C1 31761
+#define PIN_C2 31762
+#define PIN_C3 31763
+#define PIN_C4 31764
+#define PIN_C5 31765
+#define PIN_C6 31766
+#define PIN_C7 31767
+
+//Interrupts (INT0 first: it is served before the others)
+#define GLOBAL        0
+#define INT_EXT       1
+#define INT_TIMER0    2
+#define INT_TIMER3    3
+#define INT_SSP       4
+#define INT_EEPROM    5
+#define INT_BUSCOL    6
+#define HostInts      7
+
+//Options of the timers and CCP modules (values of CCS for PIC18)
+#define T3_DISABLED      0x00
+#define T3_INTERNAL      0x85
+#define T3_DIV_BY_1      0x00
+#define T3_DIV_BY_2      0x10
+#define T3_DIV_BY_4      0x20
+#define T3_DIV_BY_8      0x30
+#define RTCC_INTERNAL    0x00
+#define RTCC_DIV_1       0x08
+#define RTCC_DIV_2       0x00
+#define RTCC_DIV_4       0x01
+#define RTCC_DIV_8       0x02
+#define RTCC_DIV_16      0x03
+#define RTCC_DIV_32      0x04
+#define RTCC_DIV_64      0x05
+#define RTCC_DIV_128     0x06
+#define RTCC_DIV_256     0x07
+#define RTCC_8_BIT       0x40
+#define T2_DISABLED      0x00
+#define T2_DIV_BY_1      0x04
+#define T2_DIV_BY_4      0x05
+#define T2_DIV_BY_16     0x06
+#define CCP_OFF          0x00
+#define CCP_PWM          0x0C
+
+#define HostCallCycles      4        //Cycles of a call to a built-in
+#define HostIsrCycles      40        //Cycles to enter and leave an interrupt
+#define HostEESize       1024        //Bytes of data EEPROM
+#define HostEEWrite     20000        //Cycles of an EEPROM write (4ms)
+#define HostNever  (~(uint64_t)0)
+#define HostWdtCycles 2560000        //Watchdog period: 4ms x 128 (WDT128)
+#define HostOstCycles     256        //Oscillator start up: 1024 Tosc
+
+typedef void (*HostIsr)();
+struct HostStop {};                  //Thrown when the clock reaches HostEnd
+
+uint64_t HostCycles=0;               //Instruction cycles since power on
+uint64_t HostEnd=HostNever;          //The run stops here
+int1     HostGIE=FALSE;              //GLOBAL enabled
+int1     HostInIsr=FALSE;            //An interrupt is being served
+int1     HostIE[HostInts];           //Interrupt enabled
+int1     HostIF[HostInts];           //Interrupt flag
+HostIsr  HostVector[HostInts];       //Function of each interrupt
+unsigned long HostIsrRuns[HostInts]; //Times each interrupt has been served
+
+uint64_t HostT3Base=0, HostT3Next=HostNever;   //Timer3: cycle of count 0 and
+unsigned HostT3Div=1;                          //of next overflow
+uint64_t HostT0Base=0, HostT0Next=HostNever;   //Timer0
+unsigned HostT0Div=2, HostT0Size=256;
+
+byte     HostPR2=0xFF;               //Period of Timer2 (PWM)
+byte     HostCcp[2];                 //Mode of CCP1 and CCP2
+int16    HostDuty[2];                //Duty of PWM1 and PWM2
+
+byte     HostEEPROM[HostEESize];     //Data EEPROM
+void   (*HostOnPin)(int16 Pin, int1 Level)=NULL;
+void   (*HostOnPWM)(byte Ccp)=NULL;
+int1   (*HostReadPin)(int16 Pin)=NULL;
+
+uint64_t HostInt0At=HostNever;       //Next INT0 (ZX81 READY rising)
+void   (*HostOnInt0)()=NULL;         //Called just before it
+uint64_t HostWdtLast=0;              //Cycle of the last restart_wdt()
+uint64_t HostSlept=0;                //Cycles slept
+void   (*HostOnSleep)(uint64_t Cycles)=NULL;
+
+extern uint64_t HostSspNext;         //See I2C bus below
+extern uint64_t HostI2CHangAt;
+void Host_SspEvent();
+void Host_I2CHang();
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Registers declared with #byte/#bit by the libraries
+
+class HostSFR
+//Register of 8 bits. OnWrite is called after each write with the old value
+{
+public:
+   byte Value;
+   void (*OnWrite)(byte Old);
+
+   HostSFR(byte Reset=0) { Value=Reset; OnWrite=NULL; }
+   operator byte() const { return (Value); }
+   HostSFR& operator=(int Data)
+   {
+      byte Old=Value;
+      Value=(byte)Data;
+      if (OnWrite) OnWrite(Old);
+      return (*this);
+   }
+   HostSFR& operator|=(int Data) { return (*this=Value|Data); }
+   HostSFR& operator&=(int Data) { return (*this=Value&Data); }
+};
+
+class HostBit
+//One bit of a register
+{
+public:
+   HostSFR &Reg;
+   byte Mask;
+
+   HostBit(HostSFR &R, byte Bit) : Reg(R), Mask(1<<Bit) {}
+   operator int1() const { return ((Reg.Value & Mask)!=0); }
+   HostBit& operator=(int1 Level)
+   {
+      Reg=Level ? (Reg.Value|Mask) : (Reg.Value & ~Mask);
+      return (*this);
+   }
+};
+
+HostSFR HostTris[3]={0xFF, 0xFF, 0xFF};   //TRISA, TRISB, TRISC
+HostSFR HostLat[3];                       //Output latches of ports A, B, C
+HostSFR HostPort[3];                      //Levels read (only RC4, SDA, is kept)
+
+//MSSP (I2CMaster.h)
+HostSFR SSPBUF, SSPADD, SSPSTAT, SSPCON1, SSPCON2;
+HostBit SEN(SSPCON2,0), RSEN(SSPCON2,1), PEN(SSPCON2,2), RCEN(SSPCON2,3);
+HostBit ACKEN(SSPCON2,4), ACKDT(SSPCON2,5), ACKSTAT(SSPCON2,6);
+HostBit TRISC3(HostTris[2],3), TRISC4(HostTris[2],4);
+HostBit LATC3(HostLat[2],3), LATC4(HostLat[2],4), RC4(HostPort[2],4);
+
+//Data bus of the ZX81 (ZX81Link.h). INT0 only comes if the PC program sets
+//HostInt0At. See also ZX81Stub.cpp
+byte ZX81_PORTB, ZX81_LATB, ZX81_TRISB=0xFF;
+int1 ZX81_D0_IN, ZX81_D0_LAT, ZX81_D0_TRIS=1;
+int1 ZX81_DIR_IN, ZX81_WAIT_LAT=1, ZX81_INTEDG0=1;
+
+//Sleep (Power.h)
+int1 Power_TO=1, Power_IDLEN=0;
+
+//Data EEPROM written in the background (EEPROM.h)
+HostSFR EE_CON1, EE_CON2, EE_DATA, EE_ADR, EE_ADRH;
+HostBit EE_WR(EE_CON1,1), EE_WREN(EE_CON1,2);
+uint64_t HostEEWriteAt=HostNever;    //Cycle the write in progress ends
+int16    HostEEAddress;              //Address and data of that write
+byte     HostEEData;
+byte     HostEEUnlock=0;             //Bytes of the 0x55, 0xAA sequence
+unsigned long HostEEWrites=0;        //Bytes written
+unsigned long HostEEErrors=0;        //Writes started wrong, accesses while
+                                     //writing
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Virtual clock and interrupts
+
+void Host_Interrupt(int Source, HostIsr Isr)
+//Function run by an interrupt
+{
+   HostVector[Source]=Isr;
+}
+
+double Host_Seconds()
+//Virtual time in seconds
+{
+   return (HostCycles/5e6);
+}
+
+void Host_Dispatch()
+//Serve the pending interrupts, if they are enabled
+{
+   int Source;
+
+   while (HostGIE && !HostInIsr) {
+      for(Source=1;Source<HostInts;Source++)
+         if (HostIE[Source] && HostIF[Source] && HostVector[Source]) break;
+      if (Source==HostInts) return;
+      HostIF[Source]=FALSE;
+      HostIsrRuns[Source]++;
+      HostInIsr=TRUE;
+      HostCycles+=HostIsrCycles;
+      HostVector[Source]();
+      HostInIsr=FALSE;
+   }
+}
+
+uint64_t Host_NextEvent()
+//Cycle of the next event of the peripherals
+{
+   uint64_t Next=HostT3Next;
+
+   if (HostT0Next<Next) Next=HostT0Next;
+   if (HostSspNext<Next) Next=HostSspNext;
+   if (HostI2CHangAt<Next) Next=HostI2CHangAt;
+   if (HostInt0At<Next) Next=HostInt0At;
+   if (HostEEWriteAt<Next) Next=HostEEWriteAt;
+   return (Next);
+}
+
+void Host_Events()
+//Events of the peripherals that have arrived
+{
+   if (HostT3Next<=HostCycles) {          //Timer3 overflow
+      HostT3Base=HostT3Next;
+      HostT3Next+=65536*(uint64_t)HostT3Div;
+      HostIF[INT_TIMER3]=TRUE;
+   }
+   if (HostT0Next<=HostCycles) {          //Timer0 overflow
+      HostT0Base=HostT0Next;
+      HostT0Next+=HostT0Size*(uint64_t)HostT0Div;
+      HostIF[INT_TIMER0]=TRUE;
+   }
+   if (HostSspNext<=HostCycles) Host_SspEvent();
+   if (HostI2CHangAt<=HostCycles) Host_I2CHang();
+   if (HostEEWriteAt<=HostCycles) {       //EEPROM write done
+      HostEEWriteAt=HostNever;
+      HostEEPROM[HostEEAddress % HostEESize]=HostEEData;
+      HostEEWrites++;
+      EE_CON1.Value&=~0x02;               //WR
+      HostIF[INT_EEPROM]=TRUE;
+   }
+   if (HostInt0At<=HostCycles) {          //ZX81 READY rising
+      HostInt0At=HostNever;
+      if (HostOnInt0) HostOnInt0();
+      HostIF[INT_EXT]=TRUE;
+   }
+}
+
+void Host_Advance(uint64_t Cycles)
+//Move the virtual clock, serving the events and interrupts on the way
+{
+   uint64_t Target=HostCycles+Cycles, Next;
+
+   while ((Next=Host_NextEvent())<=Target) {
+      if (Next>HostCycles) HostCycles=Next;
+      Host_Events();
+      Host_Dispatch();
+   }
+   if (Target>HostCycles) HostCycles=Target;
+   Host_Dispatch();
+   if ((HostCycles>=HostEnd) && !HostInIsr) throw HostStop();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  Built-ins of CCS
+
+void delay_cycles(int Cycles)    { Host_Advance(Cycles); }
+void delay_us(int16 Us)          { Host_Advance((uint64_t)Us*5); }
+void delay_ms(int16 Ms)          { Host_Advance((uint64_t)Ms*5000); }
+
+void enable_interrupts(int Source)
+{
+   if (Source==GLOBAL) HostGIE=TRUE;
+   else HostIE[Source]=TRUE;
+   Host_Advance(HostCallCycles);
+}
+
+void disable_interrupts(int Source)
+{
+   if (Source==GLOBAL) HostGIE=FALSE;
+   else HostIE[Source]=FALSE;
+   Host_Advance(HostCallCycles);
+}
+
+void restart_wdt()
+{
+   HostWdtLast=HostCycles;
+   Power_TO=1;
+   Host_Advance(HostCallCycles);
+}
+
+void sleep()
+//SLEEP instruction: the clock moves to the wake up
+{
+   uint64_t Wake, Slept;
+
+   Wake=HostWdtLast+HostWdtCycles;
+   Power_TO=1;
+   if (HostIE[INT_EXT]) {
+      if (HostIF[INT_EXT]) Wake=HostCycles;    //Wakes at once
+      else if (HostInt0At<Wake) Wake=HostInt0At;
+   }
+   if (Wake<HostCycles) Wake=HostCycles;
+   if (Wake>HostEnd) Wake=HostEnd;
+   Slept=Wake-HostCycles;
+   HostT3Base+=Slept;                     //Timers stopped
+   if (HostT3Next!=HostNever) HostT3Next+=Slept;
+   HostT0Base+=Slept;
+   if (HostT0Next!=HostNever) HostT0Next+=Slept;
+   HostCycles=Wake;
+   HostSlept+=Slept;
+   if (Wake==HostWdtLast+HostWdtCycles) {   //Watchdog timeout
+      Power_TO=0;
+      HostWdtLast=Wake;
+   }
+   if (HostOnSleep) HostOnSleep(Slept);
+   Host_Advance(HostOstCycles);
+}
+
+void clear_interrupt(int Source)
+{
+   HostIF[Source]=FALSE;
+   Host_Advance(HostCallCycles);
+}
+
+int1 interrupt_active(int Source)
+{
+   Host_Advance(HostCallCycles);
+   return (HostIF[Source]);
+}
+
+void setup_timer_3(int Mode)
+{
+   HostT3Div=1<<((Mode>>4)&3);
+   HostT3Base=HostCycles;
+   HostT3Next=(Mode & 1) ? HostCycles+65536*(uint64_t)HostT3Div : HostNever;
+   Host_Advance(HostCallCycles);
+}
+
+void set_timer3(int16 Count)
+{
+   if (HostT3Next!=HostNever) {
+      HostT3Base=HostCycles-(uint64_t)Count*HostT3Div;
+      HostT3Next=HostT3Base+65536*(uint64_t)HostT3Div;
+   }
+   Host_Advance(HostCallCycles);
+}
+
+int16 get_timer3()
+{
+   Host_Advance(HostCallCycles);
+   return ((int16)((HostCycles-HostT3Base)/HostT3Div));
+}
+
+void setup_timer_0(int Mode)
+{
+   HostT0Div=(Mode & RTCC_DIV_1) ? 1 : 2<<(Mode & 7);
+   HostT0Size=(Mode & RTCC_8_BIT) ? 256 : 65536;
+   HostT0Base=HostCycles;
+   HostT0Next=HostCycles+HostT0Size*(uint64_t)HostT0Div;
+   Host_Advance(HostCallCycles);
+}
+
+void set_timer0(int16 Count)
+{
+   HostT0Base=HostCycles-(uint64_t)(Count%HostT0Size)*HostT0Div;
+   HostT0Next=HostT0Base+HostT0Size*(uint64_t)HostT0Div;
+   Host_Advance(HostCallCycles);
+}
+
+int16 get_timer0()
+{
+   Host_Advance(HostCallCycles);
+   return ((int16)((HostCycles-HostT0Base)/HostT0Div));
+}
+
+void setup_timer_2(int Mode, int Period, int Postscale)
+{
+   HostPR2=Period;
+   Host_Advance(HostCallCycles);
+}
+
+void Host_SetPWM(byte Ccp, int Mode, int16 Duty)
+//Change the mode and the duty of a PWM
+{
+   if (HostOnPWM) HostOnPWM(Ccp);
+   HostCcp[Ccp-1]=Mode;
+   HostDuty[Ccp-1]=Duty;
+   Host_Advance(HostCallCycles);
+}
+
+void setup_ccp1(int Mode)        { Host_SetPWM(1, Mode, HostDuty[0]); }
+void setup_ccp2(int Mode)        { Host_SetPWM(2, Mode, HostDuty[1]); }
+void set_pwm1_duty(int16 Duty)   { Host_SetPWM(1, HostCcp[0], Duty); }
+void set_pwm2_duty(int16 Duty)   { Host_SetPWM(2, HostCcp[1], Duty); }
+
+double Host_PWM(byte Ccp)
+//Duty cycle of PWM 1 or 2 (0 to 1)
+{
+   double Duty;
+
+   if (HostCcp[Ccp-1]!=CCP_PWM) return (0);
+   Duty=HostDuty[Ccp-1]/(4.0*(HostPR2+1));
+   return (Duty>1 ? 1 : Duty);
+}
+
+void set_tris_a(int8 Tris)       { HostTris[0]=Tris; Host_Advance(HostCallCycles); }
+void set_tris_b(int8 Tris)       { HostTris[1]=Tris; Host_Advance(HostCallCycles); }
+void set_tris_c(int8 Tris)       { HostTris[2]=Tris; Host_Advance(HostCallCycles); }
+
+void Host_Output(int16 Pin, int1 Level)
+//Drive a pin of the PIC (standard_io: the pin becomes an output)
+{
+   byte Port=(Pin-PIN_A0)>>3, Mask=1<<(Pin & 7);
+
+   if (Level) HostLat[Port]|=Mask;
+   else HostLat[Port]&=~Mask;
+   HostTris[Port].Value&=~Mask;
+   if (HostOnPin) HostOnPin(Pin, Level);
+   Host_Advance(HostCallCycles);
+}
+
+void output_high(int16 Pin)      { Host_Output(Pin, TRUE); }
+void output_low(int16 Pin)       { Host_Output(Pin, FALSE); }
+void output_toggle(int16 Pin)    { Host_Output(Pin, !(HostLat[(Pin-PIN_A0)>>3] & (1<<(Pin & 7)))); }
+
+int1 input(int16 Pin)
+//Level of a pin of the PIC (standard_io: the pin becomes an input)
+{
+   HostTris[(Pin-PIN_A0)>>3].Value|=1<<(Pin & 7);
+   Host_Advance(HostCallCycles);
+   if (HostReadPin) return (HostReadPin(Pin));
+   return (FALSE);
+}
+
+int8 read_eeprom(int16 Address)
+{
+   if (HostEEWriteAt!=HostNever) HostEEErrors++;
+   Host_Advance(HostCallCycles);
+   return (HostEEPROM[Address % HostEESize]);
+}
+
+void write_eeprom(int16 Address, int8 Data)
+{
+   if (HostEEWriteAt!=HostNever) HostEEErrors++;
+   HostEEPROM[Address % HostEESize]=Data;
+   HostEEWrites++;
+   Host_Advance(HostEEWrite);             //CCS waits for the write to finish
+}
+
+int16 make16(int32 High, int32 Low)    { return ((int16)(((High & 0xFF)<<8)|(Low & 0xFF))); }
+int8  make8(int32 Value, int Byte)     { return ((int8)(Value>>(8*Byte))); }
+int32 make32(int32 High, int32 Low)    { return (((High & 0xFFFF)<<16)|(Low & 0xFFFF)); }
+#define bit_test(Var, Bit)  ((((Var)>>(Bit)) & 1)!=0)
+#define bit_set(Var, Bit)   ((Var)|=(1<<(Bit)))
+#define bit_clear(Var, Bit) ((Var)&=~(1<<(Bit)))
+
+
+///////////////////////////////////////////////////////////////////////////////
+//  I2C bus (MSSP module as master)
+
+class HostI2CDevice
+//A chip on the I2C bus
+{
+public:
+   byte Address;                    //Address (R/W bit 0)
+   int1 General;                    //Obeys the general call (address 0x00)
+   HostI2CDevice *Next;             //Next device of the bus
+
+   HostI2CDevice(byte A) { Address=A; General=FALSE; Next=NULL; }
+   virtual ~HostI2CDevice() {}
+   virtual int1 Start(int1 Read)=0; //Addressed after a Start. True: ACK
+   virtual int1 Write(byte Data)=0; //Byte written by the master. True: ACK
+   virtual byte Read()=0;           //Byte read by the master
+   virtual void Ack(int1 Nak) {}    //Acknowledge of the master after a read
+   virtual void Stop() {}           //Stop on the bus (sent to all devices)
+};
+
+//Actions of the MSSP module
+#define HOST_SSP_NONE      0
+#define HOST_SSP_START     1
+#define HOST_SSP_RESTART   2
+#define HOST_SSP_WRITE     3
+#define HOST_SSP_READ      4
+#define HOST_SSP_ACK       5
+#define HOST_SSP_STOP      6
+
+HostI2CDevice *HostI2CBus=NULL;      //Devices of the bus
+HostI2CDevice *HostI2CSelected=NULL; //Device addressed
+int1     HostSspAddress=FALSE;       //Next byte written is an address
+int1     HostSspReading=FALSE;       //Device addressed for reading
+int1     HostSspGeneral=FALSE;       //General call: writes go to all devices
+byte     HostSspAction=HOST_SSP_NONE;
+uint64_t HostSspNext=HostNever;      //Cycle the action finishes
+uint64_t HostSspStartAt=0;           //Cycle the last Start was requested
+
+uint64_t HostI2CHangAt=HostNever;    //A device hangs the bus at this cycle
+byte     HostHangClocks=5;           //Clocks it needs to release SDA
+byte     HostSDAHeld=0;              //Clocks left for it to release SDA
+int1     HostI2CHung=FALSE;          //MSSP stopped: its actions never end
+unsigned long HostI2CHangs=0;        //Times the bus has hung
+
+unsigned long HostI2CStarts=0;       //Start conditions (transactions)
+unsigned long HostI2CBytes=0;        //Bytes on the bus (address included)
+unsigned long HostI2CNaks=0;         //Bytes not acknowledged
+unsigned long HostI2CEmpty=0;        //Addresses with no device (also NAKs)
+unsigned long HostI2CErrors=0;       //Actions requested while MSSP was busy
+uint64_t HostI2CBusy=0;              //Cycles the bus has been in use
+
+void Host_I2CAttach(HostI2CDevice *Device)
+//Put a device on the bus
+{
+   Device->Next=HostI2CBus;
+   HostI2CBus=Device;
+}
+
+void Host_SspBegin(byte Action, unsigned Bits)
+//Start an action of the MSSP module that takes some bit times
+{
+   uint64_t Cycles=Bits*(uint64_t)(SSPADD.Value+1);
+
+   if (HostSspAction!=HOST_SSP_NONE) HostI2CErrors++;
+   HostSspAction=Action;
+   HostSspNext=HostI2CHung ? HostNever : HostCycles+Cycles;
+   HostI2CBusy+=Cycles;
+}
+
+void Host_SdaLevel()
+//Level of SDA as read at RC4
+{
+   int1 Level;
+
+   Level=(HostSDAHeld==0)&&((HostTris[2].Value & 0x10)||(HostLat[2] & 0x10));
+   if (Level) HostPort[2].Value|=0x10;
+   else HostPort[2].Value&=~0x10;
+}
+
+void Host_I2CHang()
+//A device holds SDA low and the MSSP module stops in the middle of its action
+{
+   HostI2CHangAt=HostNever;
+   HostI2CHung=TRUE;
+   HostSDAHeld=HostHangClocks;
+   HostSspNext=HostNever;
+   HostI2CHangs++;
+   Host_SdaLevel();
+}
+
+void Host_SspMode(byte Old)
+//Write to SSPCON1. Turning the MSSP off cancels its action
+{
+   if (!(SSPCON1.Value & 0x20)) {
+      HostSspAction=HOST_SSP_NONE;
+      HostSspNext=HostNever;
+   }
+   else if (!(Old & 0x20) && HostSDAHeld==0) HostI2CHung=FALSE;
+}
+
+void Host_TrisC(byte Old)
+//Write to TRISC. With the MSSP off, the program gives clocks on SCL by hand
+{
+   if (!(SSPCON1.Value & 0x20) && !(Old & 0x08) &&
+       (HostTris[2].Value & 0x08) && !(HostLat[2] & 0x08))
+      if (HostSDAHeld) HostSDAHeld--;       //SCL released: one clock
+   Host_SdaLevel();
+}
+
+void Host_SspControl(byte Old)
+//Write to SSPCON2: SEN, RSEN, PEN, RCEN or ACKEN set
+{
+   byte New=SSPCON2.Value & ~Old & 0x1F;
+
+   if (New & 0x01) {
+      HostSspStartAt=HostCycles;
+      Host_SspBegin(HOST_SSP_START, 1);
+   }
+   else if (New & 0x02) {
+      HostSspStartAt=HostCycles;
+      Host_SspBegin(HOST_SSP_RESTART, 1);
+   }
+   else if (New & 0x04) Host_SspBegin(HOST_SSP_STOP, 1);
+   else if (New & 0x08) Host_SspBegin(HOST_SSP_READ, 8);
+   else if (New & 0x10) Host_SspBegin(HOST_SSP_ACK, 1);
+}
+
+void Host_SspBuffer(byte Old)
+//Write to SSPBUF: send a byte
+{
+   Host_SspBegin(HOST_SSP_WRITE, 9);
+}
+
+void Host_SspEvent()
+//The action of the MSSP module has finished
+{
+   HostI2CDevice *Device;
+   int1 Ack=FALSE;
+
+   switch (HostSspAction) {
+      case HOST_SSP_START:
+         HostI2CStarts++;
+         //no break
+      case HOST_SSP_RESTART:
+         HostI2CSelected=NULL;
+         HostSspGeneral=FALSE;
+         HostSspAddress=TRUE;
+         SSPCON2.Value&=~0x03;
+         break;
+      case HOST_SSP_WRITE:
+         HostI2CBytes++;
+         if (HostSspAddress) {
+            HostSspAddress=FALSE;
+            HostSspReading=SSPBUF.Value & 1;
+            if (SSPBUF.Value==0x00) {           //General call
+               HostSspGeneral=TRUE;
+               for(Device=HostI2CBus;Device;Device=Device->Next)
+                  if (Device->General && Device->Start(FALSE)) Ack=TRUE;
+            }
+            else {
+               for(Device=HostI2CBus;Device;Device=Device->Next)
+                  if (Device->Address==(SSPBUF.Value & 0xFE)) break;
+               if (Device && Device->Start(HostSspReading)) {
+                  HostI2CSelected=Device;
+                  Ack=TRUE;
+               }
+               if (!Device) HostI2CEmpty++;
+            }
+         }
+         else if (HostSspGeneral) {
+            for(Device=HostI2CBus;Device;Device=Device->Next)
+               if (Device->General && Device->Write(SSPBUF.Value)) Ack=TRUE;
+         }
+         else if (HostI2CSelected && !HostSspReading)
+            Ack=HostI2CSelected->Write(SSPBUF.Value);
+         if (!Ack) HostI2CNaks++;
+         if (Ack) SSPCON2.Value&=~0x40;
+         else SSPCON2.Value|=0x40;
+         break;
+      case HOST_SSP_READ:
+         HostI2CBytes++;
+         SSPBUF.Value=0xFF;                  //Nobody drives SDA
+         if (HostI2CSelected && HostSspReading)
+            SSPBUF.Value=HostI2CSelected->Read();
+         SSPCON2.Value&=~0x08;
+         break;
+      case HOST_SSP_ACK:
+         if (HostI2CSelected) HostI2CSelected->Ack(ACKDT);
+         SSPCON2.Value&=~0x10;
+         break;
+      case HOST_SSP_STOP:
+         for(Device=HostI2CBus;Device;Device=Device->Next) Device->Stop();
+         HostI2CSelected=NULL;
+         HostSspGeneral=FALSE;
+         SSPCON2.Value&=~0x04;
+         break;
+   }
+   HostSspAction=HOST_SSP_NONE;
+   HostSspNext=HostNever;
+   HostIF[INT_SSP]=TRUE;
+}
+
+
+void Host_EEUnlock(byte Old)
+//Write to EECON2: the sequence that allows a write
+{
+   if (HostGIE) HostEEUnlock=0;              //An interrupt could break it
+   else if (EE_CON2.Value==0x55) HostEEUnlock=1;
+   else if (EE_CON2.Value==0xAA && HostEEUnlock==1) HostEEUnlock=2;
+   else HostEEUnlock=0;
+}
+
+void Host_EEControl(byte Old)
+//Write to EECON1: WR set starts a write
+{
+   if ((Old & 0x02) || !(EE_CON1.Value & 0x02)) return;
+   if (!(EE_CON1.Value & 0x04) || HostEEUnlock!=2 ||
+       HostEEWriteAt!=HostNever) {
+      HostEEErrors++;
+      if (HostEEWriteAt==HostNever) EE_CON1.Value&=~0x02;
+   }
+   else {
+      HostEEAddress=((int16)EE_ADRH.Value<<8)|EE_ADR.Value;
+      HostEEData=EE_DATA.Value;
+      HostEEWriteAt=HostCycles+HostEEWrite;
+   }
+   HostEEUnlock=0;
+}
+
+void Host_Reset()
+//Power on
+{
+   memset(HostEEPROM, 0xFF, sizeof(HostEEPROM));
+   SSPCON2.OnWrite=Host_SspControl;
+   SSPBUF.OnWrite=Host_SspBuffer;
+   SSPCON1.OnWrite=Host_SspMode;
+   HostTris[2].OnWrite=Host_TrisC;
+   EE_CON1.OnWrite=Host_EEControl;
+   EE_CON2.OnWrite=Host_EEUnlock;
+   Host_SdaLevel();
+}
+
+#endif
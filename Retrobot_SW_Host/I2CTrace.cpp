@@ -0,0 +1,335 @@
+/*
+PROGRAM:    I2CTrace
+DEVELOPER:  Quark Robotics
+DATE:       October 2026
+Purpose:    Decodes a trace of the I2C bus of the Expansion Card (see TRACE in
+            I2CMaster.h), tells where the traffic goes and replays it against
+            the models of the chips of HostDevices.h, so a dump taken from the
+            robot (ZX_TRACE) or from RetroSim (-d) can be studied on the PC.
+
+Build (Linux):
+   g++ -O2 -Wall -I../Retrobot_SW_ExpansionCard -o I2CTrace I2CTrace.cpp
+
+Usage:
+   ./I2CTrace [-l] Trace.bin [Other.bin]
+
+   -l          List every transaction
+   Other.bin   A second trace of the same run (ie. before and after a change
+               of a driver). The bytes written to each device are compared
+
+REPORT:
+For each device: transactions, bytes on the bus (address bytes included),
+NAKs of polls (the device was busy), NAKs that are errors, timeouts, and the
+longest time between two of its transactions (a latency spike of the driver or
+of the queue).
+
+REPLAY:
+The chips are at the addresses of RetroBot.c: MCP23016 0x40, SRF02 0xE0, LM75
+0x9E. Each transaction is sent to its model at the time of the trace. A
+transaction is a mismatch if the model does not acknowledge it as the real
+chip did, or if it reads other data (the sonar ranges and the temperature are
+measures, so they are not compared). Writes that do not change any register of
+the model are redundant: they only load the bus. The time of the trace is the
+end of the transaction, so the bus free time of the MCP23016 is not checked
+here (RetroSim checks it).
+
+COMPARE:
+With two traces, the bytes written to each device must be the same, one
+transaction after the other. The outputs of the MCP23016 (without repeating
+equal values) are compared too, so a change that only removes redundant
+writes shows as different writes but the same outputs.
+
+The program returns 1 if there are mismatches or the traces differ.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "HostHAL.h"
+#include "HostDevices.h"
+
+#define MCPAddress    0x40      //As in RetroBot.c
+#define SonarAddress  0xE0
+#define LM75Addr      0x9E
+#define MaxDevices      16
+
+struct Transaction {
+   uint64_t Time;               //Cycles (0.2us) at the end
+   byte Address;
+   byte WriteLen, ReadLen;
+   int1 Poll;
+   byte Result;                 //0 done, 1 NAK, 2 timeout
+   byte Write[8], Read[8];
+};
+
+struct Device {
+   byte Address;
+   unsigned long Trans, Bytes, PollNaks, Naks, Timeouts;
+   unsigned long Redundant, Mismatches;
+   uint64_t Last, MaxGap, MaxGapAt;
+   std::vector<byte> Written;   //Bytes written, all transactions
+   std::vector<int16> Outputs;  //MCP23016 outputs, each new value
+};
+
+const char *ResultName[]={"DONE", "NAK", "TIMEOUT", "?"};
+
+
+int Load(const char *Name, std::vector<Transaction> &Trace)
+//Read a trace. Returns bytes left over at the end (a cut transaction)
+{
+   FILE *File;
+   std::vector<byte> Data;
+   Transaction T;
+   size_t Pos=0;
+   uint32_t Now, Before=0;
+   uint64_t Wraps=0;
+   byte Info, n;
+   int c;
+
+   File=fopen(Name, "rb");
+   if (!File) { perror(Name); exit(2); }
+   while ((c=fgetc(File))!=EOF) Data.push_back((byte)c);
+   fclose(File);
+   while (Pos+6<=Data.size()) {
+      Info=Data[Pos+5];
+      T.WriteLen=Info>>5;
+      T.ReadLen=(Info>>3)&3;
+      T.Poll=(Info & 0x04)!=0;
+      T.Result=Info & 3;
+      if (Pos+6+T.WriteLen+(T.Result==0 ? T.ReadLen : 0)>Data.size()) break;
+      Now=((uint32_t)Data[Pos]<<24)|((uint32_t)Data[Pos+1]<<16)|
+          ((uint32_t)Data[Pos+2]<<8)|Data[Pos+3];
+      if (!Trace.empty() && Now<Before) Wraps+=(uint64_t)1<<32;  //14 minutes
+      Before=Now;
+      T.Time=Wraps+Now;
+      T.Address=Data[Pos+4];
+      Pos+=6;
+      for(n=0;n<T.WriteLen;n++) T.Write[n]=Data[Pos++];
+      memset(T.Read, 0, sizeof(T.Read));
+      if (T.Result==0) for(n=0;n<T.ReadLen;n++) T.Read[n]=Data[Pos++];
+      Trace.push_back(T);
+   }
+   return ((int)(Data.size()-Pos));
+}
+
+void List(const Transaction &T)
+//One line for a transaction
+{
+   byte n;
+
+   printf("%12.6fs  %02X%s  W", T.Time/5e6, T.Address, T.Poll ? "p" : " ");
+   for(n=0;n<4;n++)
+      if (n<T.WriteLen) printf(" %02X", T.Write[n]);
+      else printf("   ");
+   printf("  R");
+   for(n=0;n<2;n++)
+      if (n<T.ReadLen && T.Result==0) printf(" %02X", T.Read[n]);
+      else printf("   ");
+   printf("  %s\n", ResultName[T.Result]);
+}
+
+Device *Find(Device *Devs, int &Count, byte Address)
+//Counters of a device (new ones are added)
+{
+   int n;
+
+   for(n=0;n<Count;n++) if (Devs[n].Address==Address) return (&Devs[n]);
+   if (Count==MaxDevices) return (&Devs[MaxDevices-1]);
+   Devs[Count]=Device();
+   Devs[Count].Address=Address;
+   return (&Devs[Count++]);
+}
+
+byte Replay(HostI2CDevice **Chips, int Chips_n, const Transaction &T,
+            int1 &Changed, int1 &ReadOK)
+//Send a transaction to the models. Returns the result they give
+{
+   HostI2CDevice *Chip=NULL;
+   HostMCP23016 *Mcp;
+   HostLM75 *Lm;
+   byte Before[16], After[16], n, Data;
+   int1 Compare, Ack;
+   int c;
+
+   Changed=FALSE;
+   ReadOK=TRUE;
+   for(c=0;c<Chips_n;c++) if (Chips[c]->Address==T.Address) Chip=Chips[c];
+   if (T.Address!=0 && !Chip) return (1);          //Nobody there: NAK
+   Mcp=dynamic_cast<HostMCP23016 *>(Chip);
+   Lm=dynamic_cast<HostLM75 *>(Chip);
+   if (Mcp) memcpy(Before, Mcp->Reg, 12);
+   if (Lm) { Before[0]=Lm->Config; memcpy(Before+1, &Lm->Hyst, 2);
+             memcpy(Before+3, &Lm->Os, 2); }
+   HostCycles=T.Time-(uint64_t)(T.WriteLen+T.ReadLen+2)*450;   //Its Start
+   HostSspStartAt=HostCycles;
+   Ack=TRUE;
+   if (T.WriteLen>0) {
+      if (T.Address==0) {                           //General call
+         for(c=0;c<Chips_n;c++)
+            if (Chips[c]->General && Chips[c]->Start(FALSE))
+               for(n=0;n<T.WriteLen;n++) Chips[c]->Write(T.Write[n]);
+      }
+      else {
+         Ack=Chip->Start(FALSE);
+         for(n=0;Ack && n<T.WriteLen;n++) Ack=Chip->Write(T.Write[n]);
+      }
+   }
+   if (Ack && T.ReadLen>0 && Chip) {
+      Compare=!dynamic_cast<HostSRF02 *>(Chip) && !(Lm && Lm->Pointer==0);
+      Ack=Chip->Start(TRUE);
+      for(n=0;Ack && n<T.ReadLen;n++) {
+         Data=Chip->Read();
+         Chip->Ack(n+1==T.ReadLen);
+         if (Compare && T.Result==0 && Data!=T.Read[n]) ReadOK=FALSE;
+      }
+   }
+   HostCycles=T.Time;
+   for(c=0;c<Chips_n;c++) Chips[c]->Stop();
+   if (Mcp) {
+      memcpy(After, Mcp->Reg, 12);
+      Changed=memcmp(Before, After, 12)!=0;
+   }
+   else if (Lm) {
+      After[0]=Lm->Config; memcpy(After+1, &Lm->Hyst, 2);
+      memcpy(After+3, &Lm->Os, 2);
+      Changed=memcmp(Before, After, 5)!=0;
+   }
+   else Changed=TRUE;                               //Commands, not registers
+   return (Ack ? 0 : 1);
+}
+
+int Analyse(const char *Name, Device *Devs, int &Count, int1 Listing)
+//Report of a trace. Returns the mismatches of the replay
+{
+   std::vector<Transaction> Trace;
+   HostMCP23016 Mcp(MCPAddress);
+   HostSRF02 Sonar(SonarAddress);
+   HostLM75 Lm(LM75Addr);
+   HostI2CDevice *Chips[3]={&Mcp, &Sonar, &Lm};
+   Device *D;
+   int Left, n, Mismatches=0;
+   unsigned long Redundant=0;
+   int1 Changed, ReadOK;
+   byte Result;
+   size_t t;
+
+   Mcp.MinGap=0;                     //Not known from the trace
+   Left=Load(Name, Trace);
+   Count=0;
+   printf("%s: %lu transactions", Name, (unsigned long)Trace.size());
+   if (!Trace.empty())
+      printf(", %.3f s to %.3f s", Trace.front().Time/5e6, Trace.back().Time/5e6);
+   if (Left) printf(", %d bytes cut at the end", Left);
+   printf("\n");
+   for(t=0;t<Trace.size();t++) {
+      const Transaction &T=Trace[t];
+      if (Listing) List(T);
+      D=Find(Devs, Count, T.Address);
+      D->Trans++;
+      D->Bytes+=1+T.WriteLen+(T.ReadLen ? 1+T.ReadLen : 0);
+      if (T.Result==1 && T.Poll) D->PollNaks++;
+      else if (T.Result==1) D->Naks++;
+      if (T.Result==2) D->Timeouts++;
+      if (D->Trans>1 && T.Time-D->Last>D->MaxGap) {
+         D->MaxGap=T.Time-D->Last;
+         D->MaxGapAt=D->Last;
+      }
+      D->Last=T.Time;
+      if (T.Result==0)
+         D->Written.insert(D->Written.end(), T.Write, T.Write+T.WriteLen);
+      if (T.Result==2) continue;                    //Bus stuck: not replayed
+      Result=Replay(Chips, 3, T, Changed, ReadOK);
+      if (Result!=T.Result || !ReadOK) {
+         D->Mismatches++;
+         Mismatches++;
+         if (Listing) printf("   ^ model: %s%s\n", ResultName[Result],
+                             ReadOK ? "" : ", other data");
+      }
+      if (T.Result==0 && T.ReadLen==0 && T.WriteLen>1 && !Changed) {
+         D->Redundant++;
+         Redundant++;
+      }
+      if (T.Address==MCPAddress &&
+          (D->Outputs.empty() || D->Outputs.back()!=Mcp.Outputs()))
+         D->Outputs.push_back(Mcp.Outputs());
+   }
+   printf("Device  Trans  Bytes  Busy  NAK  Timeout  Redundant  Mismatch  "
+          "Longest gap\n");
+   for(n=0;n<Count;n++) {
+      D=&Devs[n];
+      printf("  %02X  %6lu %6lu %5lu %4lu %8lu %10lu %9lu  %8.1f ms at %.3f s\n",
+             D->Address, D->Trans, D->Bytes, D->PollNaks, D->Naks, D->Timeouts,
+             D->Redundant, D->Mismatches, D->MaxGap/5e3, D->MaxGapAt/5e6);
+   }
+   printf("Replay: %d mismatches, %lu redundant writes\n", Mismatches, Redundant);
+   return (Mismatches);
+}
+
+int Compare(Device *A, int CountA, Device *B, int CountB)
+//Bytes written to each device in both traces. Returns the devices that differ
+{
+   Device *D;
+   size_t i;
+   int n, Diff=0;
+
+   for(n=0;n<CountA;n++) {
+      D=NULL;
+      for(int m=0;m<CountB;m++) if (B[m].Address==A[n].Address) D=&B[m];
+      if (!D) {
+         printf("  %02X  only in the first trace\n", A[n].Address);
+         Diff++;
+         continue;
+      }
+      for(i=0;i<A[n].Written.size() && i<D->Written.size();i++)
+         if (A[n].Written[i]!=D->Written[i]) break;
+      if (i==A[n].Written.size() && i==D->Written.size())
+         printf("  %02X  same bytes written (%lu)\n", A[n].Address,
+                (unsigned long)i);
+      else {
+         printf("  %02X  writes differ at byte %lu (%lu and %lu bytes)\n",
+                A[n].Address, (unsigned long)i,
+                (unsigned long)A[n].Written.size(),
+                (unsigned long)D->Written.size());
+         Diff++;
+      }
+      if (A[n].Address==MCPAddress) {
+         if (A[n].Outputs==D->Outputs)
+            printf("  %02X  same outputs (%lu changes)\n", A[n].Address,
+                   (unsigned long)A[n].Outputs.size());
+         else printf("  %02X  outputs differ\n", A[n].Address);
+      }
+   }
+   for(n=0;n<CountB;n++) {
+      for(int m=0;m<CountA;m++) if (A[m].Address==B[n].Address) goto Found;
+      printf("  %02X  only in the second trace\n", B[n].Address);
+      Diff++;
+Found:;
+   }
+   return (Diff);
+}
+
+int main(int argc, char *argv[])
+{
+   static Device DevA[MaxDevices], DevB[MaxDevices];
+   const char *Name[2]={NULL, NULL};
+   int1 Listing=FALSE;
+   int n, Files=0, CountA=0, CountB=0, Errors;
+
+   for(n=1;n<argc;n++) {
+      if (!strcmp(argv[n],"-l")) Listing=TRUE;
+      else if (Files<2) Name[Files++]=argv[n];
+   }
+   if (Files==0) {
+      fprintf(stderr, "Usage: %s [-l] Trace.bin [Other.bin]\n", argv[0]);
+      return (2);
+   }
+   Errors=Analyse(Name[0], DevA, CountA, Listing);
+   if (Files==2) {
+      printf("\n");
+      Errors+=Analyse(Name[1], DevB, CountB, Listing);
+      printf("\nCompare:\n");
+      Errors+=Compare(DevA, CountA, DevB, CountB);
+   }
+   return (Errors ? 1 : 0);
+}
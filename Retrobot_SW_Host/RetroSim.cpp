@@ -0,0 +1,802 @@
+/*
+PROGRAM:    RetroSim
+DEVELOPER:  Quark Robotics
+DATE:       October 2026
+Purpose:    Runs the firmware of the Expansion Card on a PC, with the sources
+            of Retrobot_SW_ExpansionCard as they are. The PIC is HostHAL.h,
+            the I2C chips are the models of HostDevices.h, and the robot moves
+            in a room as the wheel outputs of the MCP23016 say, so the sonar
+            sees the walls getting closer. Time is virtual: the run takes the
+            time the PC needs, not the time of the robot.
+
+Build (Linux):
+   g++ -O2 -Wall -I../Retrobot_SW_ExpansionCard -o RetroSim RetroSim.cpp
+
+Usage:
+   ./RetroSim [Seconds] [-v] [-e EEPROM.bin] [-p PIRPeriod] [-t Celsius]
+              [-h HangAt] [-z ZX81Period] [-d Trace.bin] [-m]
+              [-s SonarAddress] [-x io|sonar|temp] [-n Percent] [-k Rise]
+              [-u] [-o Ahead]
+
+   Seconds     Virtual time to run (default 60)
+   -v          Print each change of the motor outputs and the position
+   -e          Load the data EEPROM from a file (up to 1024 bytes)
+   -p          The PIR sees someone for 2s every PIRPeriod seconds
+   -t          Temperature of the LM75 (default 25)
+   -h          A device hangs the I2C bus HangAt seconds after power on (see
+               HostHAL.h). The firmware must clear it and go on
+   -z          The ZX81 sends a PING every ZX81Period seconds, after a wake up
+               byte and 1ms (see Power.h). The answers are not read
+   -d          Trace the I2C bus from power on and save it at the end (see
+               I2CMaster.h). The trace keeps the last 64KB. Decode it with
+               I2CTrace
+   -m          Print the occupancy grid of Map.h at the end (# wall, + maybe,
+               . free, blank unknown; X up, the robot is R)
+   -s          The SRF02 answers at another address (ie. 0xE2). The firmware
+               must find it
+   -x          That chip is not on the bus. The firmware must go on without it
+   -n          Percent of the rangings of the sonar that are wrong: half of them
+               without echo, half a ghost echo 20 to 60cm away (always the same
+               sequence, so two runs can be compared)
+   -k          The card heats up with the wheel motors: Rise degrees over -t
+               with both wheels driven at full duty all the time (see CARD)
+   -u          The ZX81 uploads UpScripts motion scripts 1s after power on
+               and runs the last one (see UPLOAD). Not with -z
+   -o          A box of ObstacleSize cm in the room, its near side Ahead cm in
+               front of the robot at power on. The run fails if no stop for
+               an obstacle gets into the histogram of PERF_STOP
+
+The program ends with a report of the run. It returns 1 if the firmware broke
+a rule of the hardware (I2C actions while the MSSP was busy, MCP23016 without
+its bus free time, SRF02 polled too early, bytes not acknowledged other than
+the SRF02 polls), left the wheels, the PWM or the relay on while sleeping, let
+the card get to the shutdown of the H-bridges (-k), started an EEPROM write the
+wrong way or touched the EEPROM while it was being written, failed the upload
+(-u) or the robot hit a wall, so it can be used in regression tests. With -h, the errors
+of the transactions lost in the hang are expected: the run fails instead if
+the bus is not recovered or the wheels were left running without sonar. With
+-s and -x, the NAKs of addresses with no chip (the scan of the boot, the chip
+left out) are expected, and the run fails if the boot status of the firmware
+does not tell what happened.
+
+ROOM:
+A rectangle of RoomW x RoomH cm, the robot starting at the centre looking
+along X. Wheels at full speed move the robot WheelSpeed cm/s, scaled by the
+duty of PWM1 (the wheels are in group 1 of motors). The sonar measures along
+the heading, from 16cm to 600cm (0 if there is no echo). With -o there is also
+a square box in the room, that the robot can hit as a wall. The sonar sees it
+anywhere in the path of the robot, as its cone is wider than the robot.
+
+MOTORS:
+A driven wheel gets to the speed of its duty with a time constant of MotorTau,
+and a wheel that is not driven (stopped, or duty 0) slows down with CoastTau.
+The current of a driven motor is its duty minus its speed (back EMF), in units
+of the stall current at full duty: 1 when it starts at full duty, near 2 when
+it turns round at full speed. The report gives the highest current and the
+times a motor has gone over its stall current (current peaks that make the
+wheels slip).
+
+CARD:
+With -k, the H-bridges heat the card with the square of the duty of each
+driven wheel, and the LM75 reads it: the card gets to its temperature with a
+time constant of CardTau. At CardShutdown the H-bridges would stop on their
+own: each time the card gets there is an error of the run.
+
+UPLOAD:
+With -u, the Z80 sends an image of UpScripts scripts (each one shakes the
+maraca one more time than the one before) with ZX_UPLOAD of RetroBot.c: the
+blocks, one at a time, each after the answer to the one before, then UP_END.
+It moves a byte each UpByteCycles (the loop of its machine code) and reads the
+answers each UpPollCycles until it gets one. Then it asks UP_STATUS every
+10ms until the image is written, and runs the last script with ZX_SCRIPT. The
+report gives the time of the transfer and of the writes to the EEPROM.
+*/
+
+#include <time.h>
+#include <math.h>
+#include "HostHAL.h"
+#include "HostDevices.h"
+
+#define I2C_TraceSize 65536           //All the run, not 256 bytes as the PIC
+#define main RetroBot_main
+#include "RetroBot.c"
+#undef main
+
+#define RoomW         400.0     //cm
+#define RoomH         300.0     //cm
+#define RobotRadius    15.0     //cm
+#define WheelTrack     30.0     //cm between wheels
+#define WheelSpeed     20.0     //cm/s at full duty
+#define TickSeconds 0.0131072   //Tick of Timers.h: 65536 cycles of Timer3
+#define MotorTau       0.10     //s. Speed of a driven wheel
+#define CardTau        60.0     //s. Temperature of the card
+#define CardShutdown   85.0     //Degrees: thermal shutdown of the H-bridges
+#define CoastTau       0.20     //s. Speed of a wheel left free
+#define ObstacleSize   40.0     //cm. Side of the box of -o
+
+HostMCP23016 Expander(MCP23016Address);
+HostSRF02    Sonar(SRF02Address);
+HostLM75     Thermometer(LM75Address);
+
+double   RobotX=RoomW/2, RobotY=RoomH/2, RobotHeading=0;
+double   Travelled=0;                //cm
+uint64_t RobotTime=0;                //Cycle of the last update of the position
+int16    RobotOutputs=0;             //Outputs of the MCP23016
+int1     Touching=FALSE;             //Against a wall now
+unsigned long Collisions=0;
+double   WheelV[2]={0, 0};           //Speed of the right and left wheels
+                                     //(1: full speed forward)
+double   CurrentPeak=0;              //Highest current of a wheel motor
+int1     OverStall[2]={FALSE, FALSE};
+unsigned long StallPeaks=0;          //Times a wheel went over stall current
+unsigned long OutputChanges=0;
+int1     Verbose=FALSE;
+int1     MapPrint=FALSE;
+const char *Missing="";              //Chip left out of the bus
+uint64_t FirstMotion=0;              //Cycle a wheel was first driven
+const char *BehaviourName[BehavioursNumber]=
+   {"escape", "remote", "dance", "avoid", "wander"};
+const char *SensorName[SensorsNumber]={"sonar", "PIR", "temperature"};
+double   PIRPeriod=0;
+double   ObstacleX=-1;               //Near side of the box (-1: no box)
+uint64_t RelayOn=0, RelayTime=0;     //Cycles with the relay on
+double   ZXPeriod=0;
+double   NoisePercent=0;             //Wrong rangings of the sonar
+uint32_t NoiseSeed=12345;            //Random sequence of the wrong ones
+unsigned long NoiseRangings=0;
+double   CardRise=0;                 //Degrees over ambient at full duty
+double   Ambient, Card;              //Temperature of the room and the card
+double   CardPeak=0;
+int1     Shutdown=FALSE;             //Over CardShutdown now
+unsigned long Shutdowns=0;
+byte     ZXFrame[]={ZX81_EMPTY, ZX81_SYNC_IN, 0x01, 0, 0xFF};  //Wake up, PING
+unsigned ZXStep=0;                   //Next byte of ZXFrame
+unsigned long ZXFrames=0, ZXLost=0;  //Sent, and bytes lost by waking up
+unsigned long SleepErrors=0;         //Outputs on while sleeping
+
+#define UpScripts       20           //Scripts of the image of -u
+#define UpByteCycles    62           //40 T-states of the Z80 at 3.25MHz
+#define UpPollCycles  1000           //Between reads waiting for an answer
+#define UpReadCycles    50           //READY high while the Z80 reads
+#define UpStatusCycles 50000         //10ms between UP_STATUS
+
+//Steps of the Z80 with -u
+#define UPS_BEGIN        0
+#define UPS_BLOCK        1
+#define UPS_END          2
+#define UPS_STATUS       3
+#define UPS_SCRIPT       4
+#define UPS_DONE         5
+
+int1     Upload=FALSE;
+byte     UpImage[UploadMaxImage];    //Image sent
+int      UpLen;
+byte     UpOut[ZX81_MaxData+4];      //Frame being sent
+int      UpOutLen=0, UpOutPos=0;
+byte     UpIn[ZX81_MaxData+4];       //Frame being read
+int      UpInPos=0;
+int1     UpReading=FALSE;            //READY high for a read
+byte     UpStep=UPS_BEGIN;
+byte     UpBlock=0, UpBlocks;
+uint64_t UpBegin, UpEnd, UpWritten;  //Cycles: BEGIN sent, END answered,
+                                     //image written
+unsigned long UpAgain=0;             //Frames sent again
+unsigned long UpBusErrors=0;         //Card not driving the bus on a read
+byte     UpBank=0xFF, UpSeq=0, UpRan=0;
+int16    UpBytes=0;                  //Bytes written to the EEPROM
+
+
+int Wheel(byte Motor)
+//Direction of a wheel from the outputs: 1 forward, -1 backward, 0 stopped
+{
+   int1 S1=(RobotOutputs & MotorMapS1[Motor-1])!=0;
+   int1 S2=(RobotOutputs & MotorMapS2[Motor-1])!=0;
+
+   if (S2 && !S1) return (1);
+   if (S1 && !S2) return (-1);
+   return (0);
+}
+
+void Robot_Motors(double Step)
+//Speed and current of the wheel motors after Step seconds
+{
+   double Drive, Current, Heat=0;
+   int w;
+
+   for(w=0;w<2;w++) {
+      Drive=Wheel(w==0 ? Wheel_R : Wheel_L)*Host_PWM(1);
+      Heat+=Drive*Drive/2;
+      if (Drive==0) {                           //Free
+         WheelV[w]*=exp(-Step/CoastTau);
+         OverStall[w]=FALSE;
+         continue;
+      }
+      Current=fabs(Drive-WheelV[w]);
+      if (Current>CurrentPeak) CurrentPeak=Current;
+      if (Current>1.0 && !OverStall[w]) StallPeaks++;
+      OverStall[w]=(Current>1.0);
+      WheelV[w]+=(Drive-WheelV[w])*(1-exp(-Step/MotorTau));
+   }
+   if (CardRise==0) return;
+   Card+=(Ambient+CardRise*Heat-Card)*(1-exp(-Step/CardTau));
+   Thermometer.HalfDegrees=(int)(Card*2);
+   if (Card>CardPeak) CardPeak=Card;
+   if (Card>=CardShutdown && !Shutdown) Shutdowns++;
+   Shutdown=(Card>=CardShutdown);
+}
+
+int1 Obstacle_Hit(double X, double Y)
+//True if the robot at X,Y touches the box
+{
+   double Dx, Dy;
+
+   if (ObstacleX<0) return (FALSE);
+   Dx=fmax(fmax(ObstacleX-X, X-(ObstacleX+ObstacleSize)), 0);
+   Dy=fmax(fabs(Y-RoomH/2)-ObstacleSize/2, 0);
+   return (hypot(Dx, Dy)<RobotRadius);
+}
+
+double Obstacle_Ray(double X, double Y, double C, double S)
+//Distance in cm from X,Y to the box along the direction C,S (1e9 if it is not
+//in the way)
+{
+   double Near=0, Far=1e9, A, B;
+
+   if (fabs(C)<1e-9) {
+      if (X<ObstacleX || X>ObstacleX+ObstacleSize) return (1e9);
+   } else {
+      A=(ObstacleX-X)/C;
+      B=(ObstacleX+ObstacleSize-X)/C;
+      Near=fmax(Near, fmin(A, B));
+      Far=fmin(Far, fmax(A, B));
+   }
+   if (fabs(S)<1e-9) {
+      if (fabs(Y-RoomH/2)>ObstacleSize/2) return (1e9);
+   } else {
+      A=(RoomH/2-ObstacleSize/2-Y)/S;
+      B=(RoomH/2+ObstacleSize/2-Y)/S;
+      Near=fmax(Near, fmin(A, B));
+      Far=fmin(Far, fmax(A, B));
+   }
+   return (Near<=Far ? Near : 1e9);
+}
+
+double Obstacle_Sonar(double C, double S)
+//Distance in cm to the box if it is in the path of the robot. The cone of the
+//sonar is wider than the robot: a corner of the box is seen before it is hit
+{
+   double D=1e9, Side;
+
+   if (ObstacleX<0) return (1e9);
+   for(Side=-RobotRadius;Side<=RobotRadius;Side+=RobotRadius/2)
+      D=fmin(D, Obstacle_Ray(RobotX-S*Side, RobotY+C*Side, C, S));
+   return (D);
+}
+
+void Robot_Update()
+//Move the robot up to the current cycle
+{
+   double Right, Left, Dt, Step, Nx, Ny;
+
+   Dt=(HostCycles-RobotTime)/5e6;
+   RobotTime=HostCycles;
+   while (Dt>0) {
+      Step=Dt>0.01 ? 0.01 : Dt;
+      Dt-=Step;
+      Robot_Motors(Step);
+      Right=WheelV[0]*WheelSpeed;
+      Left=WheelV[1]*WheelSpeed;
+      RobotHeading+=(Right-Left)/WheelTrack*Step;
+      Nx=RobotX+cos(RobotHeading)*(Right+Left)/2*Step;
+      Ny=RobotY+sin(RobotHeading)*(Right+Left)/2*Step;
+      if (Nx<RobotRadius || Nx>RoomW-RobotRadius ||
+          Ny<RobotRadius || Ny>RoomH-RobotRadius || Obstacle_Hit(Nx, Ny)) {
+         if (!Touching) Collisions++;
+         Touching=TRUE;
+         continue;                              //Pushing against the wall
+      }
+      Touching=FALSE;
+      Travelled+=hypot(Nx-RobotX, Ny-RobotY);
+      RobotX=Nx;
+      RobotY=Ny;
+   }
+}
+
+int16 Robot_Sonar()
+//Distance in cm to the wall in front of the robot
+{
+   double C=cos(RobotHeading), S=sin(RobotHeading), D=1e9;
+
+   Robot_Update();
+   if (C>1e-9)  D=fmin(D, (RoomW-RobotX)/C);
+   if (C<-1e-9) D=fmin(D, -RobotX/C);
+   if (S>1e-9)  D=fmin(D, (RoomH-RobotY)/S);
+   if (S<-1e-9) D=fmin(D, -RobotY/S);
+   D=fmin(D, Obstacle_Sonar(C, S));
+   if (NoisePercent>0) {
+      NoiseSeed=NoiseSeed*1103515245+12345;
+      if ((NoiseSeed>>16)%10000<NoisePercent*100) {
+         NoiseRangings++;
+         if (NoiseSeed & 0x100) return (0);     //Echo lost
+         return ((int16)(20+(NoiseSeed>>8)%41));   //Ghost echo
+      }
+   }
+   if (D>600) return (0);
+   if (D<16) return (16);
+   return ((int16)(D+0.5));
+}
+
+void Robot_Outputs(int16 Old, int16 New)
+//The MCP23016 has changed its outputs
+{
+   Robot_Update();
+   RobotOutputs=New;
+   OutputChanges++;
+   if (!FirstMotion && (Wheel(Wheel_R) || Wheel(Wheel_L)))
+      FirstMotion=HostCycles;
+   if (Verbose)
+      printf("%9.3fs  outputs %04X  x=%5.1f y=%5.1f heading=%4.0f\n",
+             Host_Seconds(), New, RobotX, RobotY,
+             fmod(RobotHeading*180/M_PI+36000, 360));
+}
+
+void PWM_Changed(byte Ccp)
+//The firmware changes the duty of a PWM: the robot has moved with the old one
+{
+   if (Ccp==1) Robot_Update();
+}
+
+void Pin_Changed(int16 Pin, int1 Level)
+//The firmware has changed a pin of the PIC
+{
+   if (Pin!=Relay) return;
+   if (RelayOn) RelayTime+=HostCycles-RelayOn;
+   RelayOn=Level ? HostCycles : 0;
+}
+
+int1 Pin_Level(int16 Pin)
+//Level of an input of the PIC
+{
+   if (Pin==PIR && PIRPeriod>0) return (fmod(Host_Seconds(), PIRPeriod)<2);
+   return (FALSE);
+}
+
+void ZX81_Byte()
+//The ZX81 writes the next byte of ZXFrame (OUT, READY rising)
+{
+   byte Data=ZXFrame[ZXStep];
+
+   ZX81_DIR_IN=1;
+   ZX81_PORTB=Data & 0xFE;
+   ZX81_D0_IN=Data & 1;
+   if (++ZXStep<sizeof(ZXFrame))
+      HostInt0At=HostCycles+(ZXStep==1 ? 5000 : 500);   //1ms after waking up
+   else {
+      ZXStep=0;
+      ZXFrames++;
+      HostInt0At=(uint64_t)((floor(Host_Seconds()/ZXPeriod)+1)*ZXPeriod*5e6);
+   }
+}
+
+void Slept(uint64_t Cycles)
+//The PIC has woken up
+{
+   if ((Wheel(Wheel_R) || Wheel(Wheel_L) || Host_PWM(1)>0 || Host_PWM(2)>0 ||
+        RelayOn) && Cycles) SleepErrors++;
+   if (Power_TO && Cycles && HostInt0At<=HostCycles) {   //Woken up by INT0
+      ZX81_Byte();                    //The oscillator starts too late for it
+      ZXLost++;
+   }
+}
+
+int16 Up_CRC(const byte *Data, int Len)
+//CRC-16-CCITT of the Z80 side
+{
+   int16 CRC=0xFFFF;
+   int n, b;
+
+   for(n=0;n<Len;n++)
+      for(b=7;b>=0;b--) {
+         int1 Top=((CRC>>15)&1)!=((Data[n]>>b)&1);
+         CRC<<=1;
+         if (Top) CRC^=0x1021;
+      }
+   return (CRC);
+}
+
+void Up_Image()
+//UpScripts scripts: script k shakes the maraca k+1 times
+{
+   const byte Script[]={SC_LOOP, 1, SC_MOTORS, 1, SC_M(Maraca,SC_BACK),
+                        SC_WAIT, 20, SC_MOTORS, 1, SC_M(Maraca,SC_STOP),
+                        SC_WAIT, 20, SC_NEXT, SC_END};
+   int k, At;
+
+   UpImage[0]=UpScripts;
+   At=1+2*UpScripts;
+   for(k=0;k<UpScripts;k++) {
+      UpImage[1+2*k]=At>>8;
+      UpImage[2+2*k]=At & 0xFF;
+      memcpy(UpImage+At, Script, sizeof(Script));
+      UpImage[At+1]=k+1;
+      At+=sizeof(Script);
+   }
+   UpLen=At;
+   UpBlocks=(UpLen+UploadBlock-1)/UploadBlock;
+}
+
+void Up_Frame(byte Cmd, const byte *Data, int Len)
+//The next frame the Z80 sends
+{
+   byte Sum=Cmd+Len;
+   int n;
+
+   UpOut[0]=ZX81_SYNC_IN;
+   UpOut[1]=Cmd;
+   UpOut[2]=Len;
+   for(n=0;n<Len;n++) Sum+=UpOut[3+n]=Data[n];
+   UpOut[3+Len]=-Sum;
+   UpOutLen=Len+4;
+   UpOutPos=0;
+}
+
+void Up_Send()
+//Frame of the step of the Z80
+{
+   byte Data[ZX81_MaxData];
+   int At=UpBlock*UploadBlock, Len;
+   int16 CRC;
+
+   switch (UpStep) {
+      case UPS_BEGIN:
+         Data[0]=UP_BEGIN;
+         Data[1]=UPLOAD_SCRIPTS;
+         Data[2]=UpLen>>8;
+         Data[3]=UpLen & 0xFF;
+         Up_Frame(ZX_UPLOAD, Data, 4);
+         break;
+      case UPS_BLOCK:
+         Len=UpLen-At<UploadBlock ? UpLen-At : UploadBlock;
+         CRC=Up_CRC(UpImage+At, Len);
+         Data[0]=UP_BLOCK;
+         Data[1]=UpBlock;
+         Data[2]=CRC>>8;
+         Data[3]=CRC & 0xFF;
+         memcpy(Data+4, UpImage+At, Len);
+         Up_Frame(ZX_UPLOAD, Data, 4+Len);
+         break;
+      case UPS_END:
+         CRC=Up_CRC(UpImage, UpLen);
+         Data[0]=UP_END;
+         Data[1]=CRC>>8;
+         Data[2]=CRC & 0xFF;
+         Up_Frame(ZX_UPLOAD, Data, 3);
+         break;
+      case UPS_STATUS:
+         Data[0]=UP_STATUS;
+         Up_Frame(ZX_UPLOAD, Data, 1);
+         break;
+      case UPS_SCRIPT:
+         Data[0]=SCRIPT_EE+UpScripts-1;
+         Up_Frame(ZX_SCRIPT, Data, 1);
+         break;
+   }
+}
+
+void Up_Answer(byte Cmd, byte Len, const byte *Data)
+//The Z80 has read an answer: next step
+{
+   uint64_t Wait=UpByteCycles;
+
+   if (Cmd==ZX81_CMD_ERROR || Len==0) UpAgain++;
+   else switch (UpStep) {
+      case UPS_BEGIN:
+         if (Data[0]==UPLOAD_OK) UpStep=UPS_BLOCK;
+         else UpAgain++;
+         break;
+      case UPS_BLOCK:
+         if (Data[0]!=UPLOAD_OK) UpAgain++;
+         UpBlock=Data[1];                     //Block the card expects
+         if (UpBlock==UpBlocks) UpStep=UPS_END;
+         break;
+      case UPS_END:
+         if (Data[0]!=UPLOAD_OK) {
+            UpStep=UPS_DONE;                  //Failed
+            return;
+         }
+         UpEnd=HostCycles;
+         UpStep=UPS_STATUS;
+         Wait=UpStatusCycles;
+         break;
+      case UPS_STATUS:
+         Wait=UpStatusCycles;
+         if (Len<6 || Data[1]!=UPLOAD_NONE) break;
+         UpWritten=HostCycles;
+         UpBank=Data[2];
+         UpSeq=Data[3];
+         UpBytes=(Data[4]<<8)|Data[5];
+         UpStep=UPS_SCRIPT;
+         break;
+      case UPS_SCRIPT:
+         UpRan=Data[0];
+         UpStep=UPS_DONE;
+         return;
+   }
+   Up_Send();
+   HostInt0At=HostCycles+Wait;
+}
+
+void Up_Read(byte Data)
+//A byte read by the Z80
+{
+   byte Sum=0;
+   int n;
+
+   if (UpInPos==0 && Data!=ZX81_SYNC_OUT) {   //No answer yet
+      HostInt0At=HostCycles+UpPollCycles;
+      return;
+   }
+   UpIn[UpInPos++]=Data;
+   if (UpInPos==3 && Data>ZX81_MaxData) UpInPos=0;   //Not a frame
+   else if (UpInPos>3 && UpInPos==UpIn[2]+4) {
+      UpInPos=0;
+      for(n=1;n<UpIn[2]+4;n++) Sum+=UpIn[n];
+      if (Sum==0) {
+         Up_Answer(UpIn[1], UpIn[2], UpIn+3);
+         return;
+      }
+      UpAgain++;                              //Send it again
+      Up_Send();
+   }
+   HostInt0At=HostCycles+UpByteCycles;
+}
+
+void Up_Z80()
+//The Z80 of -u moves a byte (READY rising), or ends a read (falling)
+{
+   byte Data;
+
+   if (UpReading) {                           //The card drives the bus
+      UpReading=FALSE;
+      if (ZX81_INTEDG0 || ZX81_TRISB!=0x01) UpBusErrors++;
+      Up_Read((ZX81_LATB & 0xFE)|(ZX81_D0_LAT ? 1 : 0));
+      return;
+   }
+   if (UpStep==UPS_DONE) return;
+   if (UpOutPos<UpOutLen) {                   //OUT
+      if (UpStep==UPS_BEGIN && UpOutPos==0) UpBegin=HostCycles;
+      Data=UpOut[UpOutPos++];
+      ZX81_DIR_IN=1;
+      ZX81_PORTB=Data & 0xFE;
+      ZX81_D0_IN=Data & 1;
+      HostInt0At=HostCycles+(UpOutPos<UpOutLen ? UpByteCycles : UpPollCycles);
+      return;
+   }
+   ZX81_DIR_IN=0;                             //IN
+   UpReading=TRUE;
+   HostInt0At=HostCycles+UpReadCycles;
+}
+
+void Print_Hist(const char *Name, int16 *Hist)
+//A histogram of Perf.h, bucket by bucket (see the limits there)
+{
+   int n;
+
+   printf("%-20s", Name);
+   for(n=0;n<PerfBuckets;n++) printf(" %u", Hist[n]);
+   printf("\n");
+}
+
+void Print_Map()
+//Pose of Map.h against the real one, cells of the grid seen
+{
+   double Ex, Ey, Eh;
+   unsigned Count[4]={0, 0, 0, 0};
+   byte Cx, Cy;
+   const char Mark[4]={'.', ' ', '+', '#'};
+
+   Ex=Map_X/256.0-(RobotX-RoomW/2);
+   Ey=Map_Y/256.0-(RobotY-RoomH/2);
+   Eh=fmod(Map_Heading*360.0/65536-RobotHeading*180/M_PI+36180, 360)-180;
+   for(Cy=0;Cy<MapSize;Cy++)
+      for(Cx=0;Cx<MapSize;Cx++) Count[Map_Get(Cx, Cy)]++;
+   printf("Map                 pose error %.1f cm (x %.1f y %.1f), heading "
+          "%.1f deg\n", hypot(Ex, Ey), Ex, Ey, Eh);
+   printf("Map cells           %u free, %u maybe, %u wall, %u unknown\n",
+          Count[MAP_FREE], Count[MAP_MAYBE], Count[MAP_WALL],
+          Count[MAP_UNKNOWN]);
+   if (!MapPrint) return;
+   for(Cx=MapSize;Cx-->0;) {
+      printf("   ");
+      for(Cy=MapSize;Cy-->0;)
+         putchar((Cx==Map_Start(Map_X)>>8 && Cy==Map_Start(Map_Y)>>8) ?
+                 'R' : Mark[Map_Get(Cx, Cy)]);
+      putchar('\n');
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   double Seconds=60, Wall;
+   clock_t Begin;
+   FILE *File;
+   const char *TraceFile=NULL;
+   byte Chunk[64], Len;
+   int n, Errors, Expected;
+   byte SonarConfigured=SRF02Address;  //Address the firmware starts with
+
+   Host_Reset();
+   for(n=1;n<argc;n++) {
+      if (!strcmp(argv[n],"-v")) Verbose=TRUE;
+      else if (!strcmp(argv[n],"-e") && n+1<argc) {
+         File=fopen(argv[++n],"rb");
+         if (!File) { perror(argv[n]); return (2); }
+         fread(HostEEPROM, 1, HostEESize, File);
+         fclose(File);
+      }
+      else if (!strcmp(argv[n],"-p") && n+1<argc) PIRPeriod=atof(argv[++n]);
+      else if (!strcmp(argv[n],"-h") && n+1<argc)
+         HostI2CHangAt=(uint64_t)(atof(argv[++n])*5e6);
+      else if (!strcmp(argv[n],"-t") && n+1<argc)
+         Thermometer.HalfDegrees=(int)(atof(argv[++n])*2);
+      else if (!strcmp(argv[n],"-z") && n+1<argc) ZXPeriod=atof(argv[++n]);
+      else if (!strcmp(argv[n],"-d") && n+1<argc) TraceFile=argv[++n];
+      else if (!strcmp(argv[n],"-m")) MapPrint=TRUE;
+      else if (!strcmp(argv[n],"-s") && n+1<argc)
+         Sonar.Address=(byte)strtol(argv[++n], NULL, 0);
+      else if (!strcmp(argv[n],"-x") && n+1<argc) Missing=argv[++n];
+      else if (!strcmp(argv[n],"-n") && n+1<argc) NoisePercent=atof(argv[++n]);
+      else if (!strcmp(argv[n],"-k") && n+1<argc) CardRise=atof(argv[++n]);
+      else if (!strcmp(argv[n],"-u")) Upload=TRUE;
+      else if (!strcmp(argv[n],"-o") && n+1<argc)
+         ObstacleX=RoomW/2+atof(argv[++n]);
+      else Seconds=atof(argv[n]);
+   }
+
+   Ambient=Card=CardPeak=Thermometer.HalfDegrees/2.0;
+   if (strcmp(Missing,"io")) Host_I2CAttach(&Expander);
+   if (strcmp(Missing,"sonar")) Host_I2CAttach(&Sonar);
+   if (strcmp(Missing,"temp")) Host_I2CAttach(&Thermometer);
+   Expander.OnOutput=Robot_Outputs;
+   Sonar.Measure=Robot_Sonar;
+   HostOnPin=Pin_Changed;
+   HostOnPWM=PWM_Changed;
+   HostReadPin=Pin_Level;
+   HostOnSleep=Slept;
+   if (ZXPeriod>0) {
+      HostOnInt0=ZX81_Byte;
+      HostInt0At=(uint64_t)(ZXPeriod*5e6);
+   }
+   else if (Upload) {
+      Up_Image();
+      Up_Send();
+      HostOnInt0=Up_Z80;
+      HostInt0At=5000000;                     //1s
+   }
+
+   //One line for each #INT_xxx of the firmware
+   Host_Interrupt(INT_TIMER3, Timer3_isr);
+   Host_Interrupt(INT_SSP, I2C_isr);
+   Host_Interrupt(INT_TIMER0, I2C_Gap_isr);
+   Host_Interrupt(INT_EXT, ZX81_isr);
+
+   if (HostEEPROM[Config_EEBase]==ConfigSize)     //-e with a configuration
+      SonarConfigured=HostEEPROM[Config_EEBase+1+CFG_SONAR_ADDR];
+   HostEnd=(uint64_t)(Seconds*5e6);
+   I2C_Tracing=(TraceFile!=NULL);
+   Begin=clock();
+   try {
+      RetroBot_main();
+   }
+   catch (HostStop &) {
+   }
+   Wall=(double)(clock()-Begin)/CLOCKS_PER_SEC;
+   Robot_Update();
+   Pin_Changed(Relay, FALSE);
+   printf("Virtual time        %.3f s (%.2f s on the PC, x%.0f)\n",
+          Host_Seconds(), Wall, Wall>0 ? Host_Seconds()/Wall : 0.0);
+   printf("Interrupts          Timer3 %lu, MSSP %lu, Timer0 %lu\n",
+          HostIsrRuns[INT_TIMER3], HostIsrRuns[INT_SSP],
+          HostIsrRuns[INT_TIMER0]);
+   printf("I2C transactions    %lu (%lu bytes, bus in use %.1f%%)\n",
+          HostI2CStarts, HostI2CBytes, 100.0*HostI2CBusy/HostCycles);
+   printf("I2C errors          NAK %lu, MSSP busy %lu\n",
+          HostI2CNaks, HostI2CErrors);
+   printf("I2C faults          hangs %lu, bus clears %u, still hung %s\n",
+          HostI2CHangs, I2C_Recoveries, HostI2CHung ? "yes" : "no");
+   for(n=0;n<I2C_ErrDevices && I2C_ErrCount[n];n++)
+      printf("I2C device %02X       %u failed transactions\n",
+             I2C_ErrAddress[n], I2C_ErrCount[n]);
+   printf("MCP23016            %lu commands, %lu output changes, gap errors %lu\n",
+          Expander.Commands, OutputChanges, Expander.GapErrors);
+   printf("SRF02               %lu rangings, %lu polls (early %lu), "
+          "result read %.2f ms after done\n",
+          Sonar.Rangings, Sonar.Polls, Sonar.EarlyPolls,
+          Sonar.Rangings ? Sonar.Latency/5e3/Sonar.Rangings : 0.0);
+   printf("Relay on            %.1f s\n", RelayTime/5e6);
+   printf("Sleep               %u times, %.1f s, wakes by WDT %u, by ZX81 %u\n",
+          Power_Sleeps, HostSlept/5e6, Power_WdtWakes, Power_Int0Wakes);
+   printf("ZX81                %lu frames, %lu bytes lost waking up, "
+          "frame errors %u\n", ZXFrames, ZXLost, ZX81_Errors);
+   printf("Boot                status %02X, MCP23016 %02X, SRF02 %02X, LM75 %02X, "
+          "first motion %.1f ms\n", Boot_Status, Config[CFG_IO_ADDR],
+          Config[CFG_SONAR_ADDR], Config[CFG_TEMP_ADDR], FirstMotion/5e3);
+   printf("Robot               x=%.1f y=%.1f travelled %.0f cm, collisions %lu\n",
+          RobotX, RobotY, Travelled, Collisions);
+   Print_Map();
+   printf("Wheel motors        current peak %.2f x stall, %lu times over "
+          "stall current\n", CurrentPeak, StallPeaks);
+   printf("Firmware            Distance %u cm, Temperature %u\n",
+          Distance, Temperature);
+   printf("Filter sonar        %u accepted, %u rejected (%lu wrong rangings), "
+          "range %u cm, closing %d cm/s\n", Filter_Accepted[FILTER_FRONT],
+          Filter_Rejected[FILTER_FRONT], NoiseRangings, Range,
+          Filter_Speed[FILTER_FRONT]);
+   if (Thermal_Peak==ThermalNone) printf("Thermal             peak none");
+   else printf("Thermal             peak %d C", Thermal_Peak);
+   printf(" (card %.1f C), %u throttles, %u s derated, duty limit %u (lowest "
+          "%u), shutdowns %lu\n", CardPeak, Thermal_Throttles,
+          Thermal_Derated, Thermal_Limit, Thermal_Lowest, Shutdowns);
+   printf("EEPROM              %lu bytes written, errors %lu\n",
+          HostEEWrites, HostEEErrors);
+   if (Upload)
+      printf("Upload              %d bytes, %u blocks (%lu frames sent again) "
+             "in %.1f ms (%.1f KB/s), %u bytes written in %.2f s, bank %u "
+             "seq %u, bus errors %lu, script ran %s\n", UpLen, UpBlocks,
+             UpAgain, (UpEnd-UpBegin)/5e3, UpLen/((UpEnd-UpBegin)/5e6)/1024,
+             UpBytes, (UpWritten-UpEnd)/5e6, UpBank, UpSeq, UpBusErrors,
+             UpRan ? "yes" : "no");
+   for(n=0;n<PerfDevices && PerfI2CTrans[n];n++)
+      printf("Perf I2C %02X         %u transactions, %u bytes\n",
+             PerfAddress[n], PerfI2CTrans[n], PerfI2CBytes[n]);
+   printf("Perf blocked        %.3f s, %u loops, longest %.3f ms\n",
+          PerfBlockedUs/1e6, PerfLoops, PerfLoopMax/5e3);
+   Print_Hist("Perf loop period", PerfLoopHist);
+   Print_Hist("Perf obstacle stop", PerfStopHist);
+   for(n=0;n<BehavioursNumber;n++)
+      printf("Behaviour %-10s%4u times, %6.1f s (%.2f s each)\n",
+             BehaviourName[n], Behaviour_Wins[n],
+             Behaviour_Ticks[n]*TickSeconds, Behaviour_Wins[n] ?
+             Behaviour_Ticks[n]*TickSeconds/Behaviour_Wins[n] : 0.0);
+   printf("Behaviours taken    %u times by a higher one\n", Behaviour_Preempts);
+   for(n=0;n<SensorsNumber;n++)
+      printf("Sensor %-13s%5u samples (%.1f/s), %u failed, %u too old, "
+             "started up to %u ticks late\n", SensorName[n], Sensor_Samples[n],
+             Sensor_Samples[n]/(Host_Seconds()-HostSlept/5e6), Sensor_Fails[n],
+             Sensor_Stale[n], Sensor_LateMax[n]);
+   printf("Perf wake up        last %.3f ms, longest %.3f ms\n",
+          PerfWakeLast/5e3, PerfWakeMax/5e3);
+   Print_Hist("Perf wake up", PerfWakeHist);
+
+   if (TraceFile) {
+      HostEnd=HostNever;               //I2C_TraceTake() moves the clock
+      File=fopen(TraceFile,"wb");
+      if (!File) { perror(TraceFile); return (2); }
+      while ((Len=I2C_TraceTake(Chunk, sizeof(Chunk)))!=0)
+         fwrite(Chunk, 1, Len, File);
+      fclose(File);
+      printf("I2C trace           %s, %u transactions dropped\n", TraceFile,
+             I2C_TraceLost);
+   }
+
+   Expected=0;                         //Boot_Status of -s and -x
+   if (Sonar.Address!=SonarConfigured) Expected=BOOT_MOVED;
+   if (!strcmp(Missing,"io")) Expected|=BOOT_NO_IO;
+   if (!strcmp(Missing,"sonar")) Expected|=BOOT_NO_SONAR;
+   if (!strcmp(Missing,"temp")) Expected|=BOOT_NO_TEMP;
+   Errors=HostI2CNaks-Sonar.Polls+HostI2CErrors+Expander.GapErrors+
+          Sonar.EarlyPolls+Collisions+SleepErrors+ZX81_Errors+Shutdowns+
+          HostEEErrors+((Boot_Status & ~BOOT_DEFAULTS)!=Expected);
+   if (Upload) Errors+=UpBusErrors+(UpStep!=UPS_DONE)+(UpRan==0);
+   if (ObstacleX>=0) {                 //The stops must have been timed
+      for(n=0;n<PerfBuckets && !PerfStopHist[n];n++);
+      Errors+=(n==PerfBuckets);
+   }
+   if (Expected)                       //The chip is looked for at its address
+      Errors-=HostI2CEmpty;            //and scanned for, or is not there
+   if (Expected & BOOT_MOVED) Errors+=(Config[CFG_SONAR_ADDR]!=Sonar.Address);
+   if (HostI2CHangs)                   //Errors of the hang are expected
+      Errors=HostI2CHung+Collisions+SleepErrors+Shutdowns+
+             (I2C_Recoveries<HostI2CHangs);
+   return (Errors ? 1 : 0);
+}
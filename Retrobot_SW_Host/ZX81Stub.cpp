@@ -0,0 +1,207 @@
+/*
+PROGRAM:    ZX81Stub
+DEVELOPER:  Quark Robotics
+DATE:       October 2026
+Purpose:    Stand-in for the ZX81 side of the data bus link, running on a PC.
+            It compiles ZX81Link.h of the Expansion Card as it is, plays the
+            Z80 (OUT/IN through INT0, DIR and the data lines) and the main
+            loop of the card, and measures how the link behaves.
+
+Build (Linux):
+   g++ -O2 -Wall -I../Retrobot_SW_ExpansionCard -o ZX81Stub ZX81Stub.cpp
+
+Usage:
+   ./ZX81Stub [Frames] [ServiceEvery] [IsrCycles] [Z80Loop]
+
+   Frames        Number of request frames sent by the "ZX81" (default 1000)
+   ServiceEvery  Bytes moved by the Z80 between two runs of the card's ZX81
+                 task, ie. how slow the main loop of the card is (default 8)
+   IsrCycles     PIC instruction cycles (200ns) from READY to WAIT released,
+                 interrupt latency included. Take it from RetroBot.lst
+                 (default 40)
+   Z80Loop       T-states of the Z80 machine code loop for each byte,
+                 IN/OUT included (default 40)
+
+The Z80 runs at 3.25MHz (FAST mode). The time of a byte is Z80Loop T-states
+plus the time the Z80 is stopped by WAIT. Frames are checked byte by byte, so
+the program also tells if a frame was lost or corrupted (ie. because the card
+does not empty the receive buffer fast enough).
+
+After each answer the Z80 also reads the snapshot of ZX81Link.h in one burst,
+while the card publishes a new one on each run of its task. Every byte of a
+snapshot is made from its Seq, so the program tells if a burst mixed two of
+them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+//CCS types and built-ins used by ZX81Link.h
+typedef uint8_t byte;
+typedef bool    int1;
+typedef uint16_t int16;
+#define INT_EXT 1
+void clear_interrupt(int) {}
+void enable_interrupts(int) {}
+
+//Pins and registers of the PIC seen by ZX81Link.h
+byte ZX81_PORTB, ZX81_LATB, ZX81_TRISB=0xFF;
+int1 ZX81_D0_IN, ZX81_D0_LAT, ZX81_D0_TRIS=1;
+int1 ZX81_DIR_IN, ZX81_WAIT_LAT=1, ZX81_INTEDG0=1;
+
+#include "ZX81Link.h"
+
+//Commands answered by the card (as in RetroBot.c)
+#define ZX_PING      0x01
+#define ZX_MOTORS    0x10
+#define ZX_SENSORS   0x20
+
+static unsigned long Transfers=0;      //Bytes moved by the Z80
+static unsigned long WaitErrors=0;     //WAIT left low, or bus not released
+static unsigned long BusErrors=0;      //Card not driving the bus on a read
+static byte SnapSeq=0;                 //Seq of the last snapshot published
+
+static void Z80_Out(byte Data)
+//The Z80 writes a byte to the card
+{
+   ZX81_DIR_IN=1;
+   ZX81_PORTB=Data & 0xFE;
+   ZX81_D0_IN=Data & 1;
+   if (ZX81_INTEDG0) ZX81_isr();       //READY rising
+   if (!ZX81_WAIT_LAT) WaitErrors++;
+   Transfers++;
+}
+
+static byte Z80_In()
+//The Z80 reads a byte from the card
+{
+   byte Data;
+
+   ZX81_DIR_IN=0;
+   if (ZX81_INTEDG0) ZX81_isr();       //READY rising
+   if (!ZX81_WAIT_LAT) WaitErrors++;
+   if (ZX81_TRISB!=0x01 || ZX81_D0_TRIS) BusErrors++;
+   Data=(ZX81_LATB & 0xFE)|(ZX81_D0_LAT ? 1 : 0);
+   if (!ZX81_INTEDG0) ZX81_isr();      //READY falling. Bus released
+   if (ZX81_TRISB!=0xFF || !ZX81_D0_TRIS) WaitErrors++;
+   Transfers++;
+   return (Data);
+}
+
+static void CardService()
+//What ZX81Task does in the card, for the commands the stub uses
+{
+   byte n;
+
+   if (ZX81_SnapStart()) {             //A new snapshot each time
+      SnapSeq++;
+      for(n=0;n<ZX81_SnapSize;n++) ZX81_SnapByte((byte)(SnapSeq*7+n));
+      ZX81_SnapPublish();
+   }
+   while (ZX81_Receive()) {
+      switch (ZX81_Cmd) {
+         case ZX_PING:
+            if (!ZX81_ReplyStart(ZX_PING, 1)) continue;
+            ZX81_ReplyByte(0x01);
+            break;
+         case ZX_MOTORS:
+            if (!ZX81_ReplyStart(ZX_MOTORS, 0)) continue;
+            break;
+         case ZX_SENSORS:
+            if (!ZX81_ReplyStart(ZX_SENSORS, 5)) continue;
+            for(n=0;n<5;n++) ZX81_ReplyByte(n+1);
+            break;
+         default:
+            continue;
+      }
+      ZX81_ReplyEnd();
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   unsigned long Frames=1000, ServiceEvery=8, IsrCycles=40, Z80Loop=40;
+   unsigned long Sent=0, Answered=0, Lost=0, Bad=0, Since=0;
+   unsigned long Snaps=0, SnapBad=0, SnapNew=0;
+   unsigned long f, n, Polls;
+   byte Req[ZX81_MaxData+4], Len, Sum, Cmd, Data, Seq, Last=0;
+   double ByteTime, Stall, Total;
+
+   if (argc>1) Frames=strtoul(argv[1],NULL,0);
+   if (argc>2) ServiceEvery=strtoul(argv[2],NULL,0);
+   if (argc>3) IsrCycles=strtoul(argv[3],NULL,0);
+   if (argc>4) Z80Loop=strtoul(argv[4],NULL,0);
+   if (ServiceEvery==0) ServiceEvery=1;
+
+   for(f=0;f<Frames;f++) {
+      //Build a request: PING, SENSORS or MOTORS with 3 motors
+      switch (f%3) {
+         case 0:  Cmd=ZX_PING;    Len=0; break;
+         case 1:  Cmd=ZX_SENSORS; Len=0; break;
+         default: Cmd=ZX_MOTORS;  Len=6; break;
+      }
+      Req[0]=ZX81_SYNC_IN; Req[1]=Cmd; Req[2]=Len;
+      Sum=Cmd+Len;
+      for(n=0;n<Len;n++) { Req[3+n]=(byte)(n%2 ? 255 : 5+n/2); Sum+=Req[3+n]; }
+      Req[3+Len]=(byte)-Sum;
+      for(n=0;n<(unsigned long)Len+4;n++) {
+         Z80_Out(Req[n]);
+         if (++Since>=ServiceEvery) { CardService(); Since=0; }
+      }
+      Sent++;
+
+      //Poll for the answer: wait for the sync byte, then read the frame
+      for(Polls=0;Polls<64;Polls++) {
+         Data=Z80_In();
+         if (++Since>=ServiceEvery) { CardService(); Since=0; }
+         if (Data==ZX81_SYNC_OUT) break;
+      }
+      if (Polls==64) { Lost++; continue; }
+      Cmd=Z80_In(); Len=Z80_In(); Sum=Cmd+Len;
+      if (Len>ZX81_MaxData) { Bad++; continue; }
+      for(n=0;n<=Len;n++) Sum+=Z80_In();
+      Since+=Len+3;
+      if (Sum!=0 || Cmd!=Req[1]) Bad++;
+      else Answered++;
+      CardService();
+      Since=0;
+
+      //Read the snapshot: one write, then Seq, Data and Chk
+      Z80_Out(ZX81_SNAP_IN);
+      Seq=Z80_In(); Sum=Seq; Len=0;
+      for(n=0;n<=ZX81_SnapSize;n++) {
+         if (++Since>=ServiceEvery) { CardService(); Since=0; }
+         Data=Z80_In();
+         Sum+=Data;
+         if (n<ZX81_SnapSize && Data!=(byte)(Seq*7+n)) Len=1;
+      }
+      Snaps++;
+      if (Sum!=0 || Len) SnapBad++;
+      if (Seq!=Last) SnapNew++;
+      Last=Seq;
+   }
+
+   Stall=IsrCycles*0.2;                            //us, PIC at 20MHz
+   ByteTime=Z80Loop/3.25+Stall;                    //us, Z80 at 3.25MHz
+   Total=Transfers*ByteTime;
+
+   printf("Frames sent         %lu\n", Sent);
+   printf("Frames answered     %lu\n", Answered);
+   printf("Frames lost         %lu\n", Lost);
+   printf("Frames corrupted    %lu\n", Bad);
+   printf("Rx overruns         %u\n", ZX81_Overruns);
+   printf("Frame errors (card) %u\n", ZX81_Errors);
+   printf("WAIT/bus errors     %lu/%lu\n", WaitErrors, BusErrors);
+   printf("Bytes moved         %lu (%.1f per frame)\n", Transfers,
+          Sent ? (double)Transfers/Sent : 0.0);
+   printf("Z80 stall per byte  %.1f us (%.0f%% of each byte)\n", Stall,
+          100.0*Stall/ByteTime);
+   printf("Throughput          %.0f bytes/s, %.0f frames/s\n",
+          Transfers/(Total/1e6), Answered/(Total/1e6));
+   printf("Snapshots read      %lu (%lu new, %lu mixed or corrupted), "
+          "%u skipped by the card\n", Snaps, SnapNew, SnapBad, ZX81_SnapSkips);
+   printf("Snapshot cost       %d bytes moved for %d values\n",
+          ZX81_SnapBytes+1, ZX81_SnapSize);
+   return ((Lost||Bad||SnapBad||WaitErrors||BusErrors) ? 1 : 0);
+}